@@ -19,6 +19,9 @@ void CommandDRIVPARM(FDC::DiskDriveMediaParams* drive);
 void CommandFORMAT(FDC::DiskDriveMediaParams* drive);
 void CommandVERIFY(FDC::DiskDriveMediaParams* drive);
 void CommandIMAGE(FDC::DiskDriveMediaParams* drive);
+void CommandCALIBRATE(FDC::DiskDriveMediaParams* drive);
+void CommandINTERLEAVE(FDC::DiskDriveMediaParams* drive);
+bool ReadSectorAsFilesystem(WORD logicalSector);
 void CommandQFORMAT(FDC::DiskDriveMediaParams* drive, bool dontAskConfirm = false);
 void CommandXFER(const BYTE* fileName);
 
@@ -117,6 +120,7 @@ void SetupDrives()
     FDC::DiskDriveMediaParams* drive = &g_diskDrives[diskDrive];
     memset(drive, 0, sizeof(FDC::DiskDriveMediaParams)); // initialize with all 0s (the struct is POD)
     drive->DriveNumber = diskDrive; // store logical drive number (0 to 3)
+    memset(fdc->getCalibration(diskDrive), 0, sizeof(FDC::DriveCalibration)); // not calibrated
     
     ui->print("");
     ui->print(Progmem::getString(Progmem::specifyParams1), diskDrive + 65);
@@ -291,6 +295,9 @@ void ProcessCommands()
         memset(drive, 0, sizeof(FDC::DiskDriveMediaParams));
         drive->DriveNumber = chosenDrive;
         
+        // the calibration was of the drive as configured before
+        memset(fdc->getCalibration(chosenDrive), 0, sizeof(FDC::DriveCalibration));
+        
         ui->print("");
         ui->print(Progmem::getString(Progmem::specifyParams1), drive->DriveNumber + 65);
         ui->print(Progmem::getString(Progmem::specifyParams2));
@@ -312,7 +319,11 @@ void ProcessCommands()
         continue;
       }
      
-      // no, reset whole board
+      // no, reset whole board, calibration of all drives included
+      for (BYTE drive = 0; drive < 4; drive++)
+      {
+        memset(fdc->getCalibration(drive), 0, sizeof(FDC::DriveCalibration));
+      }
       ui->reset();
     }
     
@@ -395,6 +406,61 @@ void ProcessCommands()
       continue;
     }
     
+    // STATS - dump the disk operation statistics and start over
+    else if (strcmp(command, Progmem::getString(Progmem::cmdStats)) == 0)
+    {
+      fdc->printStatistics();
+      fdc->resetStatistics();
+      continue;
+    }
+    
+    // CALIBRATE
+    else if (strcmp(command, Progmem::getString(Progmem::cmdCalibrate)) == 0)
+    {
+      if (strlen(arguments))
+      {
+        BYTE chosenDrive = VerifySuppliedDrive(arguments);
+        if (chosenDrive == 0xFF)
+        {
+          continue;
+        }
+        
+        CommandCALIBRATE(&g_diskDrives[chosenDrive]);
+        continue;
+      }
+      
+      CommandCALIBRATE(fdc->getParams());
+      continue;
+    }
+    
+    // INTERLEAVE
+    else if (strcmp(command, Progmem::getString(Progmem::cmdInterleave)) == 0)
+    {
+      if (strlen(arguments))
+      {
+        BYTE chosenDrive = VerifySuppliedDrive(arguments);
+        if (chosenDrive == 0xFF)
+        {
+          continue;
+        }
+        
+        CommandINTERLEAVE(&g_diskDrives[chosenDrive]);
+        continue;
+      }
+      
+      CommandINTERLEAVE(fdc->getParams());
+      continue;
+    }
+    
+    // TRACE - binary dump of the recent disk commands over serial
+    else if (strcmp(command, Progmem::getString(Progmem::cmdTrace)) == 0)
+    {
+      ui->print(Progmem::getString(Progmem::traceSending));
+      fdc->sendTrace();
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      continue;
+    }
+    
     // QFORMAT
     else if (strcmp(command, Progmem::getString(Progmem::cmdQuickFormat)) == 0)
     {     
@@ -834,6 +900,25 @@ void ProcessCommands()
       ui->print(Progmem::getString(Progmem::uiNewLine2x));
       continue;
     }
+    
+    // DEFRAG
+    else if (strcmp(command, Progmem::getString(Progmem::cmdDefrag)) == 0)
+    {
+      
+      if (!fdc->getParams()->UseFAT12)
+      {
+        ui->print(Progmem::getString(Progmem::processNoFS));
+        ui->print(Progmem::getString(Progmem::uiNewLine2x));
+        continue;
+      }
+      
+      ui->print("");
+      
+      ui->disableKeyboard(true);
+      fatDefragCommand();
+      ui->disableKeyboard(false);
+      continue;
+    }
         
     // prompt bubbled through - unrecognized command
     ui->print(Progmem::getString(Progmem::processInvalidCmd));
@@ -1430,6 +1515,44 @@ void CommandHELP(const BYTE* details)
     return;
   }
   
+  // STATS
+  else if (strcmp(details, Progmem::getString(Progmem::cmdStats)) == 0)
+  {
+    ui->print(Progmem::getString(Progmem::helpStats1));
+    ui->print(Progmem::getString(Progmem::helpStats2));
+    ui->print(Progmem::getString(Progmem::helpStats3));
+    return;
+  }
+  
+  // TRACE
+  else if (strcmp(details, Progmem::getString(Progmem::cmdTrace)) == 0)
+  {
+    ui->print(Progmem::getString(Progmem::helpTrace1));
+    ui->print(Progmem::getString(Progmem::helpTrace2));
+    ui->print(Progmem::getString(Progmem::helpTrace3));
+    return;
+  }
+  
+  // CALIBRATE
+  else if (strcmp(details, Progmem::getString(Progmem::cmdCalibrate)) == 0)
+  {
+    ui->print(Progmem::getString(Progmem::helpCalibrate1));
+    ui->print(Progmem::getString(Progmem::helpCalibrate2));
+    ui->print(Progmem::getString(Progmem::helpCalibrate3));
+    ui->print(Progmem::getString(Progmem::helpCurrentDrive));
+    return;
+  }
+  
+  // INTERLEAVE
+  else if (strcmp(details, Progmem::getString(Progmem::cmdInterleave)) == 0)
+  {
+    ui->print(Progmem::getString(Progmem::helpInterleave1));
+    ui->print(Progmem::getString(Progmem::helpInterleave2));
+    ui->print(Progmem::getString(Progmem::helpInterleave3));
+    ui->print(Progmem::getString(Progmem::helpCurrentDrive));
+    return;
+  }
+  
   // QFORMAT
   else if (strcmp(details, Progmem::getString(Progmem::cmdQuickFormat)) == 0)
   {
@@ -1517,10 +1640,19 @@ void CommandHELP(const BYTE* details)
     return;
   }
   
+  // DEFRAG
+  else if (strcmp(details, Progmem::getString(Progmem::cmdDefrag)) == 0)
+  {
+    ui->print(Progmem::getString(Progmem::helpDefrag1));
+    ui->print(Progmem::getString(Progmem::helpDefrag2));
+    ui->print(Progmem::getString(Progmem::helpDefrag3));
+    return;
+  }
+  
   // show all commands
   // determine supported commands (generic, no filesystem enabled, FAT filesystem, CP/M)
-  BYTE startCommand = Progmem::cmdSupportedIndex;
-  BYTE endCommand = fdc->getParams()->UseFAT12 ? Progmem::cmdEndIndex : Progmem::cmdFSIndex;
+  WORD startCommand = Progmem::cmdSupportedIndex;
+  WORD endCommand = fdc->getParams()->UseFAT12 ? Progmem::cmdEndIndex : Progmem::cmdFSIndex;
   
   ui->print(Progmem::getString(startCommand));
   startCommand++;
@@ -1625,6 +1757,12 @@ void CommandDRIVPARM(FDC::DiskDriveMediaParams* drive)
   ui->print(Progmem::getString(Progmem::uiNewLine)); NEXT_LINE_PAUSE;
   ui->print(Progmem::getString(Progmem::drivParmHUT), drive->HUT);
   ui->print(Progmem::getString(Progmem::uiNewLine)); NEXT_LINE_PAUSE;
+  ui->print(Progmem::getString(Progmem::drivParmSpinUp), fdc->getSpinUpTime(drive->DriveNumber));
+  ui->print(Progmem::getString(Progmem::uiNewLine)); NEXT_LINE_PAUSE;
+  ui->print(Progmem::getString(Progmem::drivParmSettle), fdc->getSettleTime(drive->DriveNumber));
+  ui->print(Progmem::getString(Progmem::uiNewLine)); NEXT_LINE_PAUSE;
+  ui->print(Progmem::getString(Progmem::drivParmInterleave), fdc->getInterleave(drive->DriveNumber));
+  ui->print(Progmem::getString(Progmem::uiNewLine)); NEXT_LINE_PAUSE;
   
   // CHS and sector size
   ui->print(Progmem::getString(Progmem::drivParmCyls), drive->Cylinders);
@@ -1760,6 +1898,24 @@ void CommandFORMAT(FDC::DiskDriveMediaParams* drive)
     withVerify = key == 'Y';
   }  
   
+  // track skew in sectors, 0xFF: derive on the drive
+  BYTE headSkew = 0;
+  BYTE cylinderSkew = 0xFF;
+  if (drive->Heads > 1)
+  {
+    ui->print(Progmem::getString(Progmem::formatHeadSkew));
+    const BYTE* prompt = ui->prompt(2, Progmem::getString(Progmem::uiDecimalInput));
+    headSkew = strlen(prompt) ? (BYTE)atoi(prompt) : 0xFF;
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+  }
+  ui->print(Progmem::getString(Progmem::formatCylinderSkew));
+  const BYTE* prompt = ui->prompt(2, Progmem::getString(Progmem::uiDecimalInput));
+  if (strlen(prompt))
+  {
+    cylinderSkew = (BYTE)atoi(prompt);
+  }
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  
   // ask to proceed
   ui->print(Progmem::getString(Progmem::uiContinueAbort));
   key = ui->readKey("\r\e");
@@ -1778,6 +1934,20 @@ void CommandFORMAT(FDC::DiskDriveMediaParams* drive)
     fdc->setActiveDrive(&g_diskDrives[chosenDrive]);
   }
   
+  if ((headSkew == 0xFF) || (cylinderSkew == 0xFF))
+  {
+    BYTE derivedHeadSkew;
+    BYTE derivedCylinderSkew;
+    fdc->deriveSkew(derivedHeadSkew, derivedCylinderSkew);
+    headSkew = (headSkew == 0xFF) ? derivedHeadSkew : headSkew;
+    cylinderSkew = (cylinderSkew == 0xFF) ? derivedCylinderSkew : cylinderSkew;
+  }
+  ui->print(Progmem::getString(Progmem::formatSkew), headSkew, cylinderSkew);
+  
+  // as found by the INTERLEAVE command, 1:1 otherwise
+  const BYTE interleave = fdc->getInterleave(chosenDrive);
+  ui->print(Progmem::getString(Progmem::interleaveResult), interleave);
+  
   const WORD trackBytes = fdc->getParams()->SectorSizeBytes * fdc->getParams()->SectorsPerTrack;
   WORD badTracks = 0;
   BYTE head = 0;
@@ -1787,7 +1957,7 @@ void CommandFORMAT(FDC::DiskDriveMediaParams* drive)
   {
     ui->print(Progmem::getString(Progmem::diskIoProgress), cyl, head);
     fdc->seekDrive(cyl, head);    
-    fdc->formatTrack();
+    fdc->formatTrack(false, interleave, 1, headSkew, cylinderSkew);
     
     const bool formatError = fdc->getLastError();
     const bool formatBreakError = formatError ? fdc->wasErrorNoDiskInDrive() || fdc->wasErrorDiskProtected() : false;
@@ -1877,6 +2047,201 @@ void CommandFORMAT(FDC::DiskDriveMediaParams* drive)
 }
 
 // similar pattern to FORMAT
+// measure spin-up and head settle times and tune the step rate, kept in the EEPROM if the configuration is stored there
+void CommandCALIBRATE(FDC::DiskDriveMediaParams* drive)
+{
+  BYTE oldDriveNumber = fdc->getParams()->DriveNumber;
+  BYTE chosenDrive = drive->DriveNumber;
+    
+  ui->print("");
+  ui->print(Progmem::getString(Progmem::diskIoInsertDisk), chosenDrive + 65);
+  ui->print(Progmem::getString(Progmem::uiNewLine)); 
+  
+  ui->print(Progmem::getString(Progmem::uiContinueAbort));
+  key = ui->readKey("\r\e");
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  if (key == '\e')
+  {
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+    return;
+  }
+  
+  ui->disableKeyboard(true);
+  
+  if (oldDriveNumber != chosenDrive)
+  {
+    fdc->setActiveDrive(&g_diskDrives[chosenDrive]);  
+  }
+  
+  // either step keeps the previous values if it fails; what was measured is reported and stored on its own
+  ui->print(Progmem::getString(Progmem::uiOperationPending));
+  const bool calibrated = fdc->calibrateDrive();
+  const bool tuned = fdc->tuneStepRate();
+  ui->print(Progmem::getString((calibrated && tuned) ? Progmem::uiOK : Progmem::uiFAIL));
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  
+  if (calibrated)
+  {
+    ui->print(Progmem::getString(Progmem::calibrateResult), fdc->getSpinUpTime(chosenDrive), fdc->getSettleTime(chosenDrive));
+  }
+  else
+  {
+    ui->print(Progmem::getString(Progmem::calibrateTimesKept));
+  }
+  if (tuned)
+  {
+    ui->print(Progmem::getString(Progmem::calibrateStepRate), fdc->getParams()->SRT);
+  }
+  else
+  {
+    ui->print(Progmem::getString(Progmem::calibrateSRTKept));
+  }
+  
+  if ((calibrated || tuned) && eepromIsConfigurationPresent())
+  {
+    eepromStoreConfiguration();
+  }
+  
+  if (oldDriveNumber != chosenDrive)
+  {
+    fdc->setActiveDrive(&g_diskDrives[oldDriveNumber]);
+  }
+  
+  ui->disableKeyboard(false);
+}
+
+// one sector read into the buffer start with a command of its own, where the filesystem of the active drive puts it
+// no filesystem read-ahead or staging: those would read the rest of the track in one command whatever the interleave
+bool ReadSectorAsFilesystem(WORD logicalSector)
+{
+  BYTE cyl;
+  BYTE head;
+  BYTE sector;
+  fdc->convertLogicalSectorToCHS(logicalSector, cyl, head, sector);
+  
+  // CP/M logical sectors are 6:1 skewed on top of the interleave
+  if (fdc->getParams()->UseCPMFS)
+  {
+    sector = Progmem::cpmSkewSector(sector);
+  }
+  
+  if ((fdc->getCurrentCylinder() != cyl) || (fdc->getCurrentHead() != head))
+  {
+    fdc->seekDrive(cyl, head, true);
+  }
+  
+  fdc->readWriteSectors(false, sector, sector);
+  return !fdc->getLastError();
+}
+
+// similar pattern to CALIBRATE
+// format the last track at each interleave and time reading it in sequence, a sector per command
+// the time the program takes in between decides if the next sector can follow right away, or how many to skip
+void CommandINTERLEAVE(FDC::DiskDriveMediaParams* drive)
+{
+  BYTE oldDriveNumber = fdc->getParams()->DriveNumber;
+  BYTE chosenDrive = drive->DriveNumber;
+    
+  ui->print("");
+  ui->print(Progmem::getString(Progmem::diskIoInsertDisk), chosenDrive + 65);
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  ui->print(Progmem::getString(Progmem::interleaveScratch));
+  
+  ui->print(Progmem::getString(Progmem::uiContinueAbort));
+  key = ui->readKey("\r\e");
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  if (key == '\e')
+  {
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+    return;
+  }
+  
+  ui->disableKeyboard(true);
+  
+  if (oldDriveNumber != chosenDrive)
+  {
+    fdc->setActiveDrive(&g_diskDrives[chosenDrive]);  
+  }
+  
+  const BYTE sectorsPerTrack = fdc->getParams()->SectorsPerTrack;
+  const BYTE cyl = fdc->getParams()->Cylinders - 1;
+  const WORD firstSector = (WORD)cyl * fdc->getParams()->Heads * sectorsPerTrack;
+  const DWORD trackBytes = (DWORD)fdc->getParams()->SectorSizeBytes * sectorsPerTrack;
+  const BYTE tries = min(sectorsPerTrack - 1, INTERLEAVE_TRIES);
+  BYTE fastest = 0;
+  DWORD fastestTime = 0;
+  
+  ui->print(Progmem::getString(Progmem::interleaveTimings));
+  for (BYTE interleave = 1; interleave <= max(tries, 1); interleave++)
+  {
+    fdc->seekDrive(cyl, 0);
+    if (!fdc->formatTrack(false, interleave))
+    {
+      fastest = 0;
+      break;
+    }
+    
+    // the last sector first, then the track from its start as if reading on from the track before
+    BYTE sector = 0;
+    DWORD time = 0;
+    // timed by fdcMicros(), micros() loses time in the data ISR
+    if (ReadSectorAsFilesystem(firstSector + sectorsPerTrack - 1))
+    {
+      time = fdcMicros();
+      while ((sector < sectorsPerTrack) && ReadSectorAsFilesystem(firstSector + sector))
+      {
+        sector++;
+      }
+      time = fdcMicros() - time;
+    }
+    if (sector < sectorsPerTrack)
+    {
+      fastest = 0;
+      break;
+    }
+    
+    const DWORD ms = max(time / 1000, 1);
+    ui->print(Progmem::getString(Progmem::interleaveTiming), interleave, (trackBytes * 1000) / ms, ms);
+    if (!fastest || (time < fastestTime))
+    {
+      fastest = interleave;
+      fastestTime = time;
+    }
+  }
+  
+  // leave the track as FORMAT would have it
+  if (fastest)
+  {
+    fdc->seekDrive(cyl, 0);
+    fdc->formatTrack(false, fastest);
+  }
+  
+  if (fastest && !fdc->getLastError())
+  {
+    fdc->getCalibration(chosenDrive)->Interleave = fastest;
+    ui->print(Progmem::getString(Progmem::interleaveResult), fastest);
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+    
+    if (eepromIsConfigurationPresent())
+    {
+      eepromStoreConfiguration();
+    }
+  }
+  else
+  {
+    ui->print(Progmem::getString(Progmem::uiFAIL));
+    ui->print(Progmem::getString(Progmem::uiNewLine2x));
+  }
+  
+  fdc->seekDrive(0, 0);
+  if (oldDriveNumber != chosenDrive)
+  {
+    fdc->setActiveDrive(&g_diskDrives[oldDriveNumber]);
+  }
+  
+  ui->disableKeyboard(false);
+}
+
 void CommandVERIFY(FDC::DiskDriveMediaParams* drive)
 {
   BYTE oldDriveNumber = fdc->getParams()->DriveNumber;
@@ -2094,31 +2459,39 @@ void CommandQFORMAT(FDC::DiskDriveMediaParams* drive, bool dontAskConfirm)
 }
 
 // transfer files over serial link
-// CP/M disks: read only, for now
 void CommandXFER(const BYTE* fileName)
 {
   ui->print("");
   const bool fat = fdc->getParams()->UseFAT12;
 
   ui->print(Progmem::getString(Progmem::xferReadFile));
-  if (fat)
+  ui->print(Progmem::getString(Progmem::xferSaveFile));
+  ui->print(Progmem::getString(Progmem::uiCancelOption));
+  const BYTE operation = toupper(ui->readKey("RWC"));
+  ui->print(Progmem::getString(Progmem::uiEchoKey), operation);
+  
+  // offer XMODEM-1K for FAT12, its packets take whole sectors to and from the disk in one command
+  // CP/M goes by 128 byte records
+  bool useXMODEM1K = false;
+  if (fat && (operation != 'C'))
   {
-    ui->print(Progmem::getString(Progmem::xferSaveFile));
+    ui->print(Progmem::getString(Progmem::xmodemUse1k));
+    key = toupper(ui->readKey("YN"));
+    ui->print(Progmem::getString(Progmem::uiEchoKey), key);
+    
+    useXMODEM1K = (key == 'Y');
   }
-  ui->print(Progmem::getString(Progmem::uiCancelOption));
-  key = toupper(ui->readKey(fat ? "RWC" : "RC"));
-  ui->print(Progmem::getString(Progmem::uiEchoKey), key);
   
   // read and send file over XMODEM (FAT12, CP/M)
-  if (key == 'R')
+  if (operation == 'R')
   {
-    xmodemSendFile(fileName);
+    xmodemSendFile(fileName, useXMODEM1K);
   }
   
-  // receive file over XMODEM and write (FAT12)
-  else if (key == 'W')
+  // receive file over XMODEM and write (FAT12, CP/M user 0)
+  else if (operation == 'W')
   {   
-    xmodemReceiveFile(fileName);
+    xmodemReceiveFile(fileName, useXMODEM1K);
   }
 }
 
@@ -10,6 +10,9 @@
 // by default, build regular MegaFDC with command line and filesystem support
 // to work as an IMD imager, uncomment the following define
 //#define BUILD_IMD_IMAGER
+
+// uncomment to let 82077-class controllers seek by themselves within read and write commands (implied seek)
+//#define IMPLIED_SEEK
 // end conditional build options.
 
 /*
@@ -91,7 +94,16 @@
 #endif
 
 #define IO_TIMEOUT             8500000            // number of (32bit) decrements in a while loop checking a response from the FDC; about 5 seconds 
+#define IO_TIMEOUT_MS          5000               // the same in milliseconds, for overlapped disk I/O polled by the caller
 #define DISK_OPERATION_RETRIES 5                  // number of retries per disk operation (at least 5)
+#define RETRIES_IN_PLACE       2                  // of these, first repeat the command without moving the head
+#define RETRIES_SEEK_AWAY      1                  // then step a cylinder away and back; the rest recalibrate and seek back
+#define HEAD_SETTLE_TIME       15                 // ms, typical head settle time after the last step pulse, unless calibrated
+#define SPIN_UP_TIME           500                // ms, motor on until the spindle is up to speed, unless calibrated
+#define FIFO_OVERRUN_LIMIT     2                  // overruns at a data rate before its FIFO burst is halved
+#define TRACE_EVENTS           16                 // recent read, write, format and read ID commands kept for TRACE, power of 2
+#define SECTOR_POSITIONS       36                 // sector IDs per track whose angular positions are kept for rotational scheduling
+#define INTERLEAVE_TRIES       8                  // INTERLEAVE command times 1:1 up to this, or to sectors per track - 1
 
 // filesystem defines
 #define MAX_PATH               48                 // max path, MAX_PATH+1 size of path buffer
@@ -108,14 +120,26 @@
 #if defined(BUILD_IMD_IMAGER) && !defined(UI_ENABLED)
   #define UI_ENABLED
 #endif
+
+// IMD imager reads and writes with logical cylinders different from the physical ones, no implied seek there
+#ifdef BUILD_IMD_IMAGER
+  #undef IMPLIED_SEEK
+#endif
+
+// host-native build (see host/Makefile): serial console only, FDC is a software model
+#ifdef MEGAFDC_HOST
+  #undef UI_ENABLED
+#endif
  
 // internal includes and used libraries
 #include <Arduino.h>
 #include <avr/sfr_defs.h>
 #include <string.h>
 #include "src/XModem/XModem.h"
-#include "src/PS2KeyAdvanced/PS2KeyAdvanced.h"
-#include "src/U8g2/U8g2lib.h"
+#ifndef MEGAFDC_HOST
+  #include "src/PS2KeyAdvanced/PS2KeyAdvanced.h"
+  #include "src/U8g2/U8g2lib.h"
+#endif
 #ifndef BUILD_IMD_IMAGER
   #include <EEPROM.h>
   #include "src/FatFs/ff.h"
@@ -144,4 +168,9 @@ extern          BYTE  g_uiEnabled;
 extern          BYTE  g_numberOfDrives;
 extern          FDC::DiskDriveMediaParams* g_diskDrives;
 extern          Ui*   ui;
-extern          FDC*  fdc;
\ No newline at end of file
+extern          FDC*  fdc;
+
+#ifndef MEGAFDC_HOST
+// least free RAM between the heap and the stack since start, main.cpp
+WORD getLowestFreeMemory();
+#endif
\ No newline at end of file
@@ -13,6 +13,12 @@
 #define DIRECTORY_ENTRIES      (DIRECTORY_SECTORS*128)/DIRECTORY_ENTRY_SIZE // 64 files
 #define FILE_NAME_LENGTH       11   // 8 for the name, 3 for the extension
 #define DATA_SECTOR_START      DIRECTORY_SECTOR_START+DIRECTORY_SECTORS // 2002 sectors total (data end)
+#define ALLOCATION_BLOCKS      ((2002-DIRECTORY_SECTOR_START)/8) // 243 1K blocks from the directory on, the first two are the directory
+#define EXTENT_BLOCKS          16   // allocation blocks per directory entry
+
+#if DIRECTORY_SECTORS*128 > SECTOR_BUFFER_SIZE
+#error The CP/M directory has to fit in the sector buffer
+#endif
 
 // structure of one 32-byte directory entry (CP/M "extent"), addressed from disk buffer
 struct CPMDirectoryEntry
@@ -27,27 +33,43 @@ struct CPMDirectoryEntry
 };
 
 // structure of directory entries kept in memory - the entryIndexes are not sequential on disk, so need to read all
-// warning: userNumber and fileName must be in the same struct order in both CPMDirectoryEntry and CPMDir,
-// these are used to find all matches of the same file spanning thru multiple directory entries
+// they are sorted by user number, name (without attributes) and entryIndex, so the entries of a file follow each other
+// userNumber and fileName come first in both CPMDirectoryEntry and CPMDir, to be copied together
 struct CPMDir
 {
   BYTE userNumber;                 // same as above
   BYTE fileName[FILE_NAME_LENGTH]; // ditto
   BYTE entrySize;                  // size in 128-byte counts
   WORD entryIndex;                 // disk index of this entry (only max DIRECTORY_ENTRIES used)
-  BYTE* blocks;                    // dynamic array of allocation blocks of this entry (0 to 16 max)
+  BYTE* blocks;                    // allocation blocks of this entry (0 to 16 max), in the same allocation past the entries
   BYTE blocksCount;
+  BYTE diskEntry;                  // where the entry is in the directory on disk, 0 to DIRECTORY_ENTRIES-1
+  BYTE nextInBucket;               // on the first entry of a file, the first one of the next file with the same name hash; 0xFF if none
 };
 
-CPMDir* cpmDirectory = NULL;           // dynamic array of directory entries, NULL on not initialized/failure/no existing files on disk
+#define NAME_HASH_BUCKETS 16
+
+CPMDir* cpmDirectory = NULL;           // directory entries followed by their blocks, one allocation; NULL on not initialized/failure/no existing files on disk
 BYTE    cpmDirectoryCount = 0;         // max DIRECTORY_ENTRIES
+BYTE    cpmNameBucket[NAME_HASH_BUCKETS]; // first entry of the first file per name hash, 0xFF if none
 WORD    openFileSectorCount = 0;       // open file size in 128-byte sector count, 0 if no file open
 WORD    openFileSector = 0;            // current logical sector address during file I/O
 CPMDir* openFileDirEntry = NULL;       // current entry during file I/O, or NULL if it needs to be advanced to next one (all allocation blocks read)
-BYTE    openFileDirEntryIndex = 0;     // index of openFileDirEntry in the sorted buffer of entries, max DIRECTORY_ENTRIES
+BYTE    openFileDirEntryIndex = 0;     // index of the entry that comes after openFileDirEntry, max DIRECTORY_ENTRIES
+BYTE    openFileDirEntryEnd = 0;       // index past the last entry of the open file
 BYTE    openFileDirEntryCurBlock = 0;  // current allocation block of openFileDirEntry; if equal to blocksCount, reset to 0 and openFileDirEntry set to null
 BYTE    openFileSuccessfulRecords = 0; // count of successful 128-byte records so far, on 8 (8x128B done), reset to 0 and openFileDirEntryCurBlock incremented
 
+BYTE    allocation[(ALLOCATION_BLOCKS+7)/8]; // bit per allocation block in use, built by cpmReadDirectory()
+BYTE    unusedEntries = 0;             // 0xE5 directory entries, ditto
+bool    newFileOpen = false;           // file being written by cpmWriteFileRecord(), its block numbers are in the FatFs window
+bool    newFileFull = false;           // no block or directory entry left for it
+BYTE    newFileUser;
+BYTE    newFileName[FILE_NAME_LENGTH];
+BYTE    newFileEntries;                // directory entries it can take: the unused ones and those of the file it replaces
+BYTE    newFileBlocks;                 // allocation blocks taken so far
+WORD    newFileRecords;                // 128-byte records written so far
+
 // convert null-terminated command-line file name, with a dot, to 11-char 8.3
 // cpmName is exactly 11 bytes, padded with spaces, with no null terminator
 void convertCmdLineToCPMFileName(const BYTE* cmdLine, BYTE* cpmName)
@@ -158,9 +180,8 @@ bool cpmVerifyDirFileName(const BYTE* cpmFileName)
   return true;
 }
 
-// read or write one 128byte sector
-// there's usually not enough SECTOR_BUFFER_SIZE to load the whole 26x128B track
-// and the sectors are skewed by a factor of 6, so no point of doing multi sector operation
+// read or write one 128byte sector at the buffer start, a command each
+// reading whole files and the directory goes thru cpmReadSectors() below
 bool cpmReadWriteSector(bool write, WORD logicalAddress)
 {
   // logical sector starts at 0, CHS starts at 0/0/1
@@ -175,7 +196,7 @@ bool cpmReadWriteSector(bool write, WORD logicalAddress)
   // seek if necessary
   if ((fdc->getCurrentCylinder() != cyl) || (fdc->getCurrentHead() != head))
   {
-    fdc->seekDrive(cyl, head);
+    fdc->seekDrive(cyl, head, true);
   }
   
   // read/write
@@ -183,6 +204,228 @@ bool cpmReadWriteSector(bool write, WORD logicalAddress)
   return !fdc->getLastError();
 }
 
+// staged sectors, one 128B slot each over the whole buffer, tagged with their logical address:
+// a miss reads physically consecutive sectors of the track in one command, whatever order the 6:1 skew gives them,
+// they are found by their tags and de-skewed by exchanging the slots in RAM
+// anything else reading or writing the disk goes through the same buffer, so the FDC count of those commands must not have moved
+#define STAGED_SLOTS (SECTOR_BUFFER_SIZE / 128)
+#if STAGED_SLOTS > 255
+#error Staged slots are counted in a byte
+#endif
+WORD stagedSector[STAGED_SLOTS];
+BYTE stagedCount = 0;
+BYTE stagedDrive;
+WORD stagedBufferChanges;
+
+// slot of a staged sector, 0xFF if not there
+BYTE cpmFindStaged(WORD logicalAddress)
+{
+  for (BYTE slot = 0; slot < stagedCount; slot++)
+  {
+    if (stagedSector[slot] == logicalAddress)
+    {
+      return slot;
+    }
+  }
+  
+  return 0xFF;
+}
+
+// exchange two slots with their data
+void cpmSwapStaged(BYTE slot, BYTE other)
+{
+  const WORD sector = stagedSector[slot];
+  stagedSector[slot] = stagedSector[other];
+  stagedSector[other] = sector;
+  
+  for (BYTE index = 0; index < 128; index++)
+  {
+    const BYTE data = g_rwBuffer[(slot * 128) + index];
+    g_rwBuffer[(slot * 128) + index] = g_rwBuffer[(other * 128) + index];
+    g_rwBuffer[(other * 128) + index] = data;
+  }
+}
+
+// drop a slot, the last one moves into the gap so that the free ones stay at the end
+void cpmDropStaged(BYTE slot)
+{
+  stagedCount--;
+  if (slot != stagedCount)
+  {
+    stagedSector[slot] = stagedSector[stagedCount];
+    memcpy((BYTE*)&g_rwBuffer[slot * 128], (BYTE*)&g_rwBuffer[stagedCount * 128], 128);
+  }
+}
+
+// keep only the staged logical sectors from..to
+void cpmKeepStaged(WORD from, WORD to)
+{
+  for (BYTE slot = 0; slot < stagedCount; )
+  {
+    if ((stagedSector[slot] < from) || (stagedSector[slot] > to))
+    {
+      cpmDropStaged(slot);
+      continue;
+    }
+    
+    slot++;
+  }
+}
+
+// read consecutive logical sectors of one track into the buffer from its start, in logical order
+// each command starts at the missing one that comes under the head first (see FDC::scheduleSectors())
+// those after them on the track are read ahead as far as the slots allow, what was staged before them is dropped
+bool cpmReadSectors(WORD logicalAddress, BYTE count)
+{
+  const BYTE sectorsPerTrack = fdc->getParams()->SectorsPerTrack;
+  const WORD trackStart = logicalAddress - (logicalAddress % sectorsPerTrack);
+  const WORD trackEnd = trackStart + sectorsPerTrack - 1;
+  if (!count || (count > STAGED_SLOTS) || (logicalAddress + count - 1 > trackEnd))
+  {
+    return false;
+  }
+  
+  // still what we left there
+  if ((stagedDrive != fdc->getParams()->DriveNumber) || (stagedBufferChanges != fdc->getBufferChanges()))
+  {
+    stagedCount = 0;
+  }
+  cpmKeepStaged(logicalAddress, trackEnd);
+  
+  BYTE cyl;
+  BYTE head;
+  BYTE sector;
+  fdc->convertLogicalSectorToCHS(trackStart, cyl, head, sector);
+  
+  while (true)
+  {
+    BYTE missing[STAGED_SLOTS];
+    BYTE missingCount = 0;
+    for (BYTE index = 0; index < count; index++)
+    {
+      if (cpmFindStaged(logicalAddress + index) == 0xFF)
+      {
+        missing[missingCount++] = Progmem::cpmSkewSector(logicalAddress + index - trackStart + 1);
+      }
+    }
+    if (!missingCount)
+    {
+      break;
+    }
+    
+    if ((fdc->getCurrentCylinder() != cyl) || (fdc->getCurrentHead() != head))
+    {
+      fdc->seekDrive(cyl, head, true);
+    }
+    
+    // start at the missing one that comes under the head first, or the first one from the index hole if that cannot be told
+    const bool scheduled = fdc->scheduleSectors(missing, missingCount);
+    BYTE first = missing[0];
+    for (BYTE index = 1; !scheduled && (index < missingCount); index++)
+    {
+      first = min(first, missing[index]);
+    }
+    
+    // physically consecutive from there to the last missing one, the ones there already staged are read again
+    BYTE last = first;
+    bool wrapped = false;
+    for (BYTE index = 0; index < missingCount; index++)
+    {
+      wrapped = wrapped || (missing[index] < first);
+      last = max(last, missing[index]);
+    }
+    for (BYTE slot = 0; slot < stagedCount; )
+    {
+      sector = Progmem::cpmSkewSector(stagedSector[slot] - trackStart + 1);
+      if ((sector >= first) && (sector <= last))
+      {
+        cpmDropStaged(slot);
+        continue;
+      }
+      
+      slot++;
+    }
+    
+    // make room by dropping what was read ahead, the farthest first; the rest goes as far as the free slots do
+    while (last - first + 1 > STAGED_SLOTS - stagedCount)
+    {
+      BYTE farthest = 0xFF;
+      for (BYTE slot = 0; slot < stagedCount; slot++)
+      {
+        if ((stagedSector[slot] >= logicalAddress + count) && ((farthest == 0xFF) || (stagedSector[slot] > stagedSector[farthest])))
+        {
+          farthest = slot;
+        }
+      }
+      if (farthest == 0xFF)
+      {
+        break;
+      }
+      
+      cpmDropStaged(farthest);
+    }
+    last = min(last, first + (STAGED_SLOTS - stagedCount) - 1);
+    
+    // with none of them left before it on the track, read ahead up to the end of track, the first staged one or the free slots;
+    // otherwise stop there to get those still on this revolution
+    while (!wrapped && (last < sectorsPerTrack) && (last - first + 1 < STAGED_SLOTS - stagedCount))
+    {
+      bool staged = false;
+      for (BYTE slot = 0; !staged && (slot < stagedCount); slot++)
+      {
+        staged = (Progmem::cpmSkewSector(stagedSector[slot] - trackStart + 1) == last + 1);
+      }
+      if (staged)
+      {
+        break;
+      }
+      
+      last++;
+    }
+    
+    // a bad sector past the wanted one is not our business, read just that
+    BYTE end = last;
+    WORD position = stagedCount * 128;
+    fdc->readWriteSectors(false, first, end, &position);
+    if (fdc->getLastError() && (end > first) && !fdc->wasErrorNoDiskInDrive())
+    {
+      end = first;
+      position = stagedCount * 128;
+      fdc->readWriteSectors(false, first, end, &position);
+    }
+    if (fdc->getLastError())
+    {
+      stagedCount = 0;
+      return false;
+    }
+    
+    // tag them with the logical sectors the skew put there
+    for (sector = 1; sector <= sectorsPerTrack; sector++)
+    {
+      const BYTE physical = Progmem::cpmSkewSector(sector);
+      if ((physical >= first) && (physical <= end))
+      {
+        stagedSector[stagedCount + physical - first] = trackStart + sector - 1;
+      }
+    }
+    stagedCount += end - first + 1;
+    stagedDrive = fdc->getParams()->DriveNumber;
+    stagedBufferChanges = fdc->getBufferChanges();
+  }
+  
+  // de-skew to the buffer start
+  for (BYTE index = 0; index < count; index++)
+  {
+    const BYTE slot = cpmFindStaged(logicalAddress + index);
+    if (slot != index)
+    {
+      cpmSwapStaged(slot, index);
+    }
+  }
+  
+  return true;
+}
+
 // deallocate array
 void cpmFreeDirectory()
 { 
@@ -191,23 +434,87 @@ void cpmFreeDirectory()
     return;
   }
   
-  // deallocate blocks
-  for (BYTE index = 0; index < cpmDirectoryCount; index++)
+  // the blocks are in the same allocation
+  delete[] (BYTE*)cpmDirectory;
+  cpmDirectory = NULL;
+  cpmDirectoryCount = 0;
+}
+
+bool cpmIsBlockAllocated(BYTE block)
+{
+  return (block >= ALLOCATION_BLOCKS) || (allocation[block / 8] & (1 << (block % 8)));
+}
+
+void cpmSetBlockAllocated(BYTE block)
+{
+  if (block < ALLOCATION_BLOCKS)
+  {
+    allocation[block / 8] |= 1 << (block % 8);
+  }
+}
+
+// compare the user number and the name of an entry to the ones given, attributes aside
+// less than, equal to or greater than 0 as in memcmp
+int cpmCompareFile(const CPMDir* entry, BYTE userNumber, const BYTE* cpmFileName)
+{
+  if (entry->userNumber != userNumber)
   {
-    CPMDir* entry = &cpmDirectory[index];
-    if (entry->blocks)
+    return (int)entry->userNumber - userNumber;
+  }
+  
+  for (BYTE chr = 0; chr < FILE_NAME_LENGTH; chr++)
+  {
+    const BYTE sevenBit = entry->fileName[chr] & 0x7F;
+    if (sevenBit != (cpmFileName[chr] & 0x7F))
     {
-      delete[] entry->blocks;
+      return (int)sevenBit - (cpmFileName[chr] & 0x7F);
     }
   }
   
-  delete[] cpmDirectory;
-  cpmDirectory = NULL;
-  cpmDirectoryCount = 0;
+  return 0;
+}
+
+BYTE cpmHashName(const BYTE* cpmFileName)
+{
+  BYTE hash = 0;
+  for (BYTE chr = 0; chr < FILE_NAME_LENGTH; chr++)
+  {
+    hash = ((hash << 3) | (hash >> 5)) ^ (cpmFileName[chr] & 0x7F);
+  }
+  
+  return hash % NAME_HASH_BUCKETS;
+}
+
+// first entry of the file of this user, 0xFF if not there
+BYTE cpmFindFile(BYTE userNumber, const BYTE* cpmFileName)
+{
+  for (BYTE index = cpmNameBucket[cpmHashName(cpmFileName)]; index != 0xFF; index = cpmDirectory[index].nextInBucket)
+  {
+    if (cpmCompareFile(&cpmDirectory[index], userNumber, cpmFileName) == 0)
+    {
+      return index;
+    }
+  }
+  
+  return 0xFF;
+}
+
+// index past the last entry of the file starting at index
+BYTE cpmFileEnd(BYTE index)
+{
+  const CPMDir* first = &cpmDirectory[index];
+  while ((index < cpmDirectoryCount) && (cpmCompareFile(&cpmDirectory[index], first->userNumber, first->fileName) == 0))
+  {
+    index++;
+  }
+  
+  return index;
 }
 
-// read directory entries and allocate dynamic array
-bool cpmReadDirectory()
+// read directory entries into one allocation, sorted and hashed by name; note the blocks in use and the unused entries
+// emptyAllowed: no files on disk is not an error, returns true with cpmDirectory left NULL
+// the directory stays in the buffer, in logical order from its start
+bool cpmReadDirectory(bool emptyAllowed = false)
 {
   // 4 32-byte entries per one 128-byte sector
   const BYTE entryCount = fdc->getParams()->SectorSizeBytes / DIRECTORY_ENTRY_SIZE;
@@ -221,53 +528,74 @@ bool cpmReadDirectory()
     return false;
   }
   
-  // determine array size first
-  WORD sector = DIRECTORY_SECTOR_START;
-  while (sector < DATA_SECTOR_START)
+  // the whole directory into the buffer at once
+  if (!cpmReadSectors(DIRECTORY_SECTOR_START, DIRECTORY_SECTORS))
   {
-    // read 4 entries in a sector
-    if (!cpmReadWriteSector(false, sector))
-    {     
-      ui->print(Progmem::getString(Progmem::fsDiskError));
-      ui->print(Progmem::getString(Progmem::uiNewLine2x));
-      return false;
-    }
+    ui->print(Progmem::getString(Progmem::fsDiskError));
+    ui->print(Progmem::getString(Progmem::uiNewLine2x));
+    return false;
+  }
+  
+  // only the directory itself, until the entries say otherwise
+  memset(allocation, 0, sizeof(allocation));
+  cpmSetBlockAllocated(0);
+  cpmSetBlockAllocated(1);
+  unusedEntries = 0;
+  
+  // one pass over the entries for those valid and the size of their blocks
+  BYTE validEntries[DIRECTORY_ENTRIES];
+  BYTE blocksCount[DIRECTORY_ENTRIES];
+  WORD totalBlocks = 0;
+  for (BYTE diskEntry = 0; diskEntry < DIRECTORY_SECTORS * entryCount; diskEntry++)
+  {
+    CPMDirectoryEntry* entry = (CPMDirectoryEntry*)(&g_rwBuffer[diskEntry * DIRECTORY_ENTRY_SIZE]);
     
-    for (BYTE entryIndex = 0; entryIndex < entryCount; entryIndex++)
+    // the user number is invalid (shall be 0-15 or 0-31), 0xE5 means deleted/unused entry
+    if (entry->userNumber > 31)
     {
-      // sanity check: address the read buffer
-      CPMDirectoryEntry* entry = (CPMDirectoryEntry*)(&g_rwBuffer[entryIndex*DIRECTORY_ENTRY_SIZE]);
-      
-      // the user number is invalid (shall be 0-15 or 0-31), 0xE5 means deleted/unused entry
-      if (entry->userNumber > 31)
-      {
-        continue;
-      }
-      
-      // invalid filename in entry, skip      
-      else if (!cpmVerifyDirFileName(entry->fileName))
+      if (entry->userNumber == DIRECTORY_ENTRY_UNUSED)
       {
-        continue;
+        unusedEntries++;
       }
-      
-      // valid filename      
-      cpmDirectoryCount++;
+      continue;
     }
     
-    sector++;
+    // invalid filename in entry, skip
+    else if (!cpmVerifyDirFileName(entry->fileName))
+    {
+      continue;
+    }
+    
+    // in 250K disks, the allocation blocks are byte values each so stop at a zero (bigger disks: each value is a word, 2 bytes)
+    // 0 might mean a hole in the file block, but we don't support that so treat it as an end of file
+    BYTE blocks = 0;
+    while ((blocks < sizeof(entry->allocationBlocks)) && entry->allocationBlocks[blocks])
+    {
+      cpmSetBlockAllocated(entry->allocationBlocks[blocks]);
+      blocks++;
+    }
+    
+    validEntries[cpmDirectoryCount] = diskEntry;
+    blocksCount[cpmDirectoryCount++] = blocks;
+    totalBlocks += blocks;
   }
   
   // no files on disk
   if (!cpmDirectoryCount)
   {
+    if (emptyAllowed)
+    {
+      return true;
+    }
+    
     ui->print(Progmem::getString(Progmem::dirCPMEmpty));
     ui->print(Progmem::getString(Progmem::uiNewLine2x));
     return false;
   }
   
-  // allocate array and initialize with zeros (important)
-  cpmDirectory = new CPMDir[cpmDirectoryCount];
-  if (!cpmDirectory)
+  // the entries and all their blocks after them
+  BYTE* allocated = new BYTE[(cpmDirectoryCount * sizeof(CPMDir)) + totalBlocks];
+  if (!allocated)
   {
     cpmDirectoryCount = 0;
     
@@ -275,82 +603,57 @@ bool cpmReadDirectory()
     ui->print(Progmem::getString(Progmem::uiNewLine2x));
     return false;
   }
+  cpmDirectory = (CPMDir*)allocated;
+  BYTE* blocks = &allocated[cpmDirectoryCount * sizeof(CPMDir)];
   
-  BYTE cpmDirectoryIndex = 0;
-  for (; cpmDirectoryIndex < cpmDirectoryCount; cpmDirectoryIndex++)
-  {
-    memset(&cpmDirectory[cpmDirectoryIndex], 0, sizeof(CPMDir));
-  }  
-  
-  // load data from disk into the array
-  cpmDirectoryIndex = 0;
-  sector = DIRECTORY_SECTOR_START;
-  while (sector < DATA_SECTOR_START)
+  // insert in order
+  for (BYTE index = 0; index < cpmDirectoryCount; index++)
   {
-    if (!cpmReadWriteSector(false, sector))
-    {
-      cpmFreeDirectory();
-      
-      ui->print(Progmem::getString(Progmem::fsDiskError));
-      ui->print(Progmem::getString(Progmem::uiNewLine2x));
-      return false;
-    }
+    const CPMDirectoryEntry* entry = (const CPMDirectoryEntry*)(&g_rwBuffer[validEntries[index] * DIRECTORY_ENTRY_SIZE]);
+    const WORD entryIndex = ((WORD)(entry->entryIndexHi) << 5) | entry->entryIndexLo;
     
-    for (BYTE entryIndex = 0; entryIndex < entryCount; entryIndex++)
+    BYTE position = index;
+    while (position)
     {
-      // disk buffer entry
-      CPMDirectoryEntry* entry = (CPMDirectoryEntry*)(&g_rwBuffer[entryIndex*DIRECTORY_ENTRY_SIZE]);
-      
-      // exact same sanity check as above
-      if (entry->userNumber > 31)
-      {
-        continue;
-      }
-      else if (!cpmVerifyDirFileName(entry->fileName))
+      const CPMDir* previous = &cpmDirectory[position - 1];
+      const int order = cpmCompareFile(previous, entry->userNumber, entry->fileName);
+      if ((order < 0) || ((order == 0) && (previous->entryIndex <= entryIndex)))
       {
-        continue;
-      }
-      
-      // initialize memory entry
-      CPMDir* entryInMemory = &cpmDirectory[cpmDirectoryIndex++];
-      memcpy(entryInMemory->fileName, entry->fileName, FILE_NAME_LENGTH);
-      entryInMemory->userNumber = entry->userNumber;
-      entryInMemory->entrySize = entry->entrySize;
-      entryInMemory->entryIndex = ((WORD)(entry->entryIndexHi) << 5) | entry->entryIndexLo;
-           
-      // determine blocks count by going over the allocation bytes
-      for (; entryInMemory->blocksCount < sizeof(entry->allocationBlocks); entryInMemory->blocksCount++)
-      {
-        // in 250K disks, these are byte values each so stop at a zero (bigger disks: each value is a word, 2 bytes)
-        // 0 might mean a hole in the file block, but we don't support that so treat it as an end of file
-        if (!entry->allocationBlocks[entryInMemory->blocksCount])
-        {
-          break;
-        }
-      }
-      
-      // entry with no block count
-      if (!entryInMemory->blocksCount)
-      {
-        continue;
-      }
-
-      // allocate and copy only those indexes as required
-      entryInMemory->blocks = new BYTE[entryInMemory->blocksCount];
-      if (!entryInMemory->blocks)
-      {
-        // out of memory
-        cpmFreeDirectory();
-        
-        ui->print(Progmem::getString(Progmem::fsMemoryError));
-        ui->print(Progmem::getString(Progmem::uiNewLine2x));
-        return false;
+        break;
       }
       
-      memcpy(entryInMemory->blocks, entry->allocationBlocks, entryInMemory->blocksCount);
+      cpmDirectory[position] = *previous;
+      position--;
     }
     
-    sector++;
+    CPMDir* entryInMemory = &cpmDirectory[position];
+    memset(entryInMemory, 0, sizeof(CPMDir));
+    entryInMemory->userNumber = entry->userNumber;
+    memcpy(entryInMemory->fileName, entry->fileName, FILE_NAME_LENGTH);
+    entryInMemory->entrySize = entry->entrySize;
+    entryInMemory->entryIndex = entryIndex;
+    entryInMemory->diskEntry = validEntries[index];
+    
+    // an entry with no block count has no blocks
+    entryInMemory->blocksCount = blocksCount[index];
+    entryInMemory->blocks = blocks;
+    memcpy(blocks, entry->allocationBlocks, blocksCount[index]);
+    blocks += blocksCount[index];
+  }
+  
+  // hash the first entries of the files, so that each chain goes in the order of the entries
+  memset(cpmNameBucket, 0xFF, sizeof(cpmNameBucket));
+  for (BYTE index = cpmDirectoryCount; index > 0; index--)
+  {
+    CPMDir* entry = &cpmDirectory[index - 1];
+    if ((index > 1) && (cpmCompareFile(&cpmDirectory[index - 2], entry->userNumber, entry->fileName) == 0))
+    {
+      continue;
+    }
+    
+    const BYTE hash = cpmHashName(entry->fileName);
+    entry->nextInBucket = cpmNameBucket[hash];
+    cpmNameBucket[hash] = index - 1;
   }
   
   return true;
@@ -364,59 +667,25 @@ void cpmDirCommand()
     return;
   }
   
-  // reuse the FatFs buffer to sort indexes of CP/M entries (maximum DIRECTORY_ENTRIES is 64)
-  // FAT volumes are remounted anyway on drive change
-  BYTE* sortedEntryBuf = (BYTE*)getFat()->win;
   BYTE* printBuffer = ui->getPrintBuffer(); // snprintf
   BYTE displayedEntries = 0;
   BYTE totalOccupiedKilos = 0;
   
-  // iterate over all directory entries to check for files
-  for (BYTE cpmDirectoryIndex = 0; cpmDirectoryIndex < cpmDirectoryCount; cpmDirectoryIndex++)
+  // iterate over the files, their entries follow each other
+  for (BYTE cpmDirectoryIndex = 0; cpmDirectoryIndex < cpmDirectoryCount; )
   {
     CPMDir* entry = &cpmDirectory[cpmDirectoryIndex];
-
-    // did we already go through this one?
-    if (entry->userNumber == DIRECTORY_ENTRY_UNUSED)
-    {
-      continue;
-    }
     
     // 0th byte: user number, 1st to 11th: filename with attributes
     BYTE file[FILE_NAME_LENGTH+1];
     memcpy(file, entry, sizeof(file));
     
-    //255: uninitialized (current maximum DIRECTORY_ENTRIES is 64, there's space for a little more)
-    memset(sortedEntryBuf, 0xFF, DIRECTORY_ENTRIES);
-    
-    // find all occurences of this particular file over all entries and store indexes where they are spanned
-    for (BYTE index = 0; index < cpmDirectoryCount; index++)
-    {
-      CPMDir* ent = &cpmDirectory[index];
-      
-      if (memcmp(ent, file, sizeof(file)) == 0)
-      {
-        // make sorted buffer by entry index
-        sortedEntryBuf[ent->entryIndex] = index;
-      }
-    }    
-    
     WORD totalFileSize = 0; // 1: 128 bytes, 2: 256, 0x80: 16K, 0x100: 32K...
     
-    // sorted buffer will be used to make sequential reads of file blocks, here just compute the total size
-    for (BYTE index = 0; index < DIRECTORY_ENTRIES; index++)
+    const BYTE fileEnd = cpmFileEnd(cpmDirectoryIndex);
+    for (; cpmDirectoryIndex < fileEnd; cpmDirectoryIndex++)
     {
-      if (sortedEntryBuf[index] == 0xFF)
-      {
-        // nothing here
-        continue;
-      }
-      
-      CPMDir* ent = &cpmDirectory[sortedEntryBuf[index]];  
-      totalFileSize += ent->entrySize;
-      
-      // mark all of these as done
-      ent->userNumber = DIRECTORY_ENTRY_UNUSED;
+      totalFileSize += cpmDirectory[cpmDirectoryIndex].entrySize;
     }
     
     // null terminated string with a dot between filename and extension
@@ -424,7 +693,7 @@ void cpmDirCommand()
     convertCPMFileNameToCmdLine(&file[1], niceFileName); // file[0] is the user number    
     printBuffer[0] = 0;
 
-    // print user number in file[0] (original is now marked to skip due to multiple entries)
+    // print user number in file[0]
     ui->print(Progmem::getString(Progmem::dirCPMUser), file[0]);
         
     // under 1K, display bytes
@@ -505,7 +774,6 @@ void cpmDirCommand()
 
 // find specified file, get its size and all of its entries in sequential order
 // given fileName null terminated and userNumber (0-31)
-// processing analog to cpmReadDirectory above
 bool cpmOpenFile(const BYTE* cmdLine, BYTE userNumber)
 {
   // reset these
@@ -513,6 +781,7 @@ bool cpmOpenFile(const BYTE* cmdLine, BYTE userNumber)
   openFileSector = 0;
   openFileDirEntry = NULL;
   openFileDirEntryIndex = 0;
+  openFileDirEntryEnd = 0;
   openFileDirEntryCurBlock = 0;
   openFileSuccessfulRecords = 0;
   
@@ -528,91 +797,54 @@ bool cpmOpenFile(const BYTE* cmdLine, BYTE userNumber)
     return false;
   }
   
-  BYTE file[FILE_NAME_LENGTH+1];
-  file[0] = userNumber;
-  convertCmdLineToCPMFileName(cmdLine, &file[1]);
-  
-  BYTE* sortedEntryBuf = (BYTE*)getFat()->win;
+  BYTE file[FILE_NAME_LENGTH];
+  convertCmdLineToCPMFileName(cmdLine, file);
   
-  for (BYTE cpmDirectoryIndex = 0; cpmDirectoryIndex < cpmDirectoryCount; cpmDirectoryIndex++)
+  openFileDirEntryIndex = cpmFindFile(userNumber, file);
+  if (openFileDirEntryIndex == 0xFF)
   {
-    CPMDir* entry = &cpmDirectory[cpmDirectoryIndex];
-    if (entry->userNumber != userNumber) // not this user number
-    {
-      continue;
-    }
-    
-    memset(sortedEntryBuf, 0xFF, DIRECTORY_ENTRIES);     
-    bool fileFound = false;
-    
-    for (BYTE index = 0; index < cpmDirectoryCount; index++)
-    {
-      CPMDir* ent = &cpmDirectory[index];      
-      
-      // we are not using the array to display directory contents
-      // so get rid of any attributes (incl. user-defined), otherwise memcmp would fail
-      for (BYTE chr = 0; chr < FILE_NAME_LENGTH; chr++)
-      {
-        ent->fileName[chr] &= 0x7F;
-      }
-      
-      if (memcmp(ent, file, sizeof(file)) == 0)
-      {
-        sortedEntryBuf[ent->entryIndex] = index;
-        fileFound = true;
-      }
-    }
-    
-    if (!fileFound)
-    {
-      cpmFreeDirectory();
-      
-      ui->print(Progmem::getString(Progmem::fsCPMFileNotFound), userNumber);
-      ui->print(Progmem::getString(Progmem::uiNewLine2x));
-      return false;
-    }
-       
-    for (BYTE index = 0; index < DIRECTORY_ENTRIES; index++)
-    {
-      if (sortedEntryBuf[index] == 0xFF)
-      {
-        continue;
-      }
-      
-      CPMDir* ent = &cpmDirectory[sortedEntryBuf[index]];     
-      openFileSectorCount += ent->entrySize;
-    }
-       
-    // the file was found, but it is empty? no point on continuing
-    if (!openFileSectorCount)
-    {
-      cpmFreeDirectory();
-      
-      ui->print(Progmem::getString(Progmem::fsCPMFileEmpty));
-      ui->print(Progmem::getString(Progmem::uiNewLine2x));
-      return false;
-    }
+    cpmFreeDirectory();
     
-    // opened, size valid, sorted buffer ready
-    return true;
+    ui->print(Progmem::getString(Progmem::fsCPMFileNotFound), userNumber);
+    ui->print(Progmem::getString(Progmem::uiNewLine2x));
+    return false;
   }
   
-  cpmFreeDirectory();
+  openFileDirEntryEnd = cpmFileEnd(openFileDirEntryIndex);
+  for (BYTE index = openFileDirEntryIndex; index < openFileDirEntryEnd; index++)
+  {
+    openFileSectorCount += cpmDirectory[index].entrySize;
+  }
+  
+  // the file was found, but it is empty? no point on continuing
+  if (!openFileSectorCount)
+  {
+    cpmFreeDirectory();
+    
+    ui->print(Progmem::getString(Progmem::fsCPMFileEmpty));
+    ui->print(Progmem::getString(Progmem::uiNewLine2x));
+    return false;
+  }
   
-  ui->print(Progmem::getString(Progmem::fsCPMFileNotFound), userNumber);
-  ui->print(Progmem::getString(Progmem::uiNewLine2x));
-  return false;
+  // opened, size valid, entries in order
+  return true;
 }
 
-// alias to cpmFreeDirectory
+// alias to cpmFreeDirectory, also abandons a file being written (what was on the disk stays as it was)
 void cpmCloseFile()
 {
   cpmFreeDirectory();
+  
+  if (newFileOpen)
+  {
+    newFileOpen = false;
+    stagedCount = 0;
+  }
 }
 
 // read one CP/M file record (128 bytes), just right for XMODEM that stemmed from this...
 // returns false on error, or true if success (and true with size set to 0 if end of file)
-// on success, current file record is in g_rwBuffer[0..127]
+// on success, current file record is in g_rwBuffer[0..127], the rest of the buffer is its track read ahead
 bool cpmReadFileRecord(BYTE& size)
 {
   // error: nothing opened
@@ -632,27 +864,19 @@ bool cpmReadFileRecord(BYTE& size)
   }
   
   // get next sequential directory entry if at the end of all allocation blocks (or doing first time read)
-  const BYTE* sortedEntryBuf = (const BYTE*)getFat()->win;    
-  while(!openFileDirEntry && (openFileDirEntryIndex < DIRECTORY_ENTRIES))
+  while (!openFileDirEntry && (openFileDirEntryIndex < openFileDirEntryEnd))
   {
-    if (sortedEntryBuf[openFileDirEntryIndex] == 0xFF)
-    {
-      openFileDirEntryIndex++;
-      continue;
-    }
-    
-    openFileDirEntry = &cpmDirectory[sortedEntryBuf[openFileDirEntryIndex]];
-    openFileDirEntryIndex++;
+    openFileDirEntry = &cpmDirectory[openFileDirEntryIndex++];
     
     // also check for allocation blocks count
-    if (openFileDirEntry && openFileDirEntry->blocksCount)
+    if (!openFileDirEntry->blocksCount)
     {
-      break;
-    }    
+      openFileDirEntry = NULL;
+    }
   }
   
   // this should not happen, but we're at the end (openFileSector should reach sector count before this)
-  if (openFileDirEntryIndex == DIRECTORY_ENTRIES)
+  if (!openFileDirEntry)
   {
     cpmFreeDirectory();
     
@@ -664,7 +888,17 @@ bool cpmReadFileRecord(BYTE& size)
   // file blocks are numbered starting the directory extents
   WORD address = DIRECTORY_SECTOR_START + ((WORD)openFileDirEntry->blocks[openFileDirEntryCurBlock] * 8);
   address += openFileSuccessfulRecords;
-  if (!cpmReadWriteSector(false, address))
+  
+  // entering a block, or its rest on the next track: all of its records there are staged in one go,
+  // in the order they come under the head, and the calls for the records after this one find them in RAM
+  BYTE count = 1;
+  const BYTE trackSector = address % fdc->getParams()->SectorsPerTrack;
+  if (!openFileSuccessfulRecords || !trackSector)
+  {
+    count = min(8 - openFileSuccessfulRecords, fdc->getParams()->SectorsPerTrack - trackSector);
+    count = min(count, openFileSectorCount - openFileSector);
+  }
+  if (!cpmReadSectors(address, count))
   {
     // cannot read one single sector after multiple retries, abort
     cpmFreeDirectory();
@@ -699,74 +933,331 @@ bool cpmReadFileRecord(BYTE& size)
   return true;  
 }
 
-// deletes all entries of given file for all users
-bool cpmDeleteFile(const BYTE* cmdLine)
+// create a file written with cpmWriteFileRecord() and put into the directory by cpmCloseNewFile()
+// given fileName null terminated and userNumber (0-31); the same file of this user is replaced on close, not before
+bool cpmCreateFile(const BYTE* cmdLine, BYTE userNumber)
 {
-  const BYTE entryCount = fdc->getParams()->SectorSizeBytes / DIRECTORY_ENTRY_SIZE; 
+  cpmCloseFile();
+  newFileFull = false;
+  newFileBlocks = 0;
+  newFileRecords = 0;
   
-  // this routine does not require directory entries in memory
-  cpmFreeDirectory();
+  // 1-8 characters of name, up to 3 of extension
+  BYTE nameLength = 0;
+  while (cmdLine[nameLength] && (cmdLine[nameLength] != '.'))
+  {
+    nameLength++;
+  }
+  const BYTE extensionLength = cmdLine[nameLength] ? strlen(&cmdLine[nameLength + 1]) : 0;
   
-  if (!fdc->verifyTrack0())
+  convertCmdLineToCPMFileName(cmdLine, newFileName);
+  if ((userNumber > 31) || !nameLength || (nameLength > 8) || (extensionLength > 3) || !cpmVerifyDirFileName(newFileName))
   {
-    ui->print(Progmem::getString(Progmem::uiNewLine));
+    ui->print(Progmem::getString(Progmem::fsInvalidParameter));
+    ui->print(Progmem::getString(Progmem::uiNewLine2x));
     return false;
   }
   
-  bool deleteResult = false; // deleted at least 1 entry
-  BYTE cpmFileName[FILE_NAME_LENGTH];
-  convertCmdLineToCPMFileName(cmdLine, cpmFileName);
+  // the blocks in use and the entries it can take
+  if (!cpmReadDirectory(true))
+  {
+    return false;
+  }
   
-  WORD sector = DIRECTORY_SECTOR_START;
-  while (sector < DATA_SECTOR_START)
+  newFileUser = userNumber;
+  newFileEntries = unusedEntries;
+  const BYTE existing = cpmDirectory ? cpmFindFile(userNumber, newFileName) : 0xFF;
+  if (existing != 0xFF)
   {
-    // read
-    if (!cpmReadWriteSector(false, sector))
+    newFileEntries += cpmFileEnd(existing) - existing;
+  }
+  cpmFreeDirectory();
+  
+  // the slots take the records written from now on
+  stagedCount = 0;
+  newFileOpen = true;
+  return true;
+}
+
+// next block for the file being written: the one right after its last one, so that the records follow on the track,
+// otherwise the start of the longest free run; 0 if there is none
+BYTE cpmAllocateBlock()
+{
+  BYTE* blocks = (BYTE*)getFat()->win;
+  if (newFileBlocks && !cpmIsBlockAllocated(blocks[newFileBlocks - 1] + 1))
+  {
+    return blocks[newFileBlocks - 1] + 1;
+  }
+  
+  BYTE longestStart = 0;
+  BYTE longestLength = 0;
+  for (WORD block = 2; block < ALLOCATION_BLOCKS; )
+  {
+    if (cpmIsBlockAllocated(block))
     {
-      ui->print(Progmem::getString(Progmem::fsDiskError));
-      ui->print(Progmem::getString(Progmem::uiNewLine2x));
-      return false;
+      block++;
+      continue;
     }
     
-    for (BYTE entryIndex = 0; entryIndex < entryCount; entryIndex++)
+    const BYTE start = block;
+    while ((block < ALLOCATION_BLOCKS) && !cpmIsBlockAllocated(block))
     {
-      CPMDirectoryEntry* entry = (CPMDirectoryEntry*)(&g_rwBuffer[entryIndex*DIRECTORY_ENTRY_SIZE]);
-      if (entry->userNumber == DIRECTORY_ENTRY_UNUSED)
-      {
-        continue;
-      }      
-      if (!cpmVerifyDirFileName(entry->fileName))
-      {
-        continue;
-      }
-      
-      // erase any file attributes
-      for (BYTE chr = 0; chr < FILE_NAME_LENGTH; chr++)
+      block++;
+    }
+    if (block - start > longestLength)
+    {
+      longestStart = start;
+      longestLength = block - start;
+    }
+  }
+  
+  return longestStart;
+}
+
+// write the staged records, all on one track, in the order they come under the head
+// sorted by their physical sectors first, so that those following each other go in one command
+bool cpmWriteStaged()
+{
+  if (!stagedCount)
+  {
+    return true;
+  }
+  
+  const WORD trackStart = stagedSector[0] - (stagedSector[0] % fdc->getParams()->SectorsPerTrack);
+  BYTE sectors[STAGED_SLOTS];
+  for (BYTE slot = 0; slot < stagedCount; slot++)
+  {
+    sectors[slot] = Progmem::cpmSkewSector(stagedSector[slot] - trackStart + 1);
+  }
+  for (BYTE slot = 0; slot < stagedCount; slot++)
+  {
+    for (BYTE other = slot + 1; other < stagedCount; other++)
+    {
+      if (sectors[other] < sectors[slot])
       {
-        entry->fileName[chr] &= 0x7F;
+        const BYTE sector = sectors[slot];
+        sectors[slot] = sectors[other];
+        sectors[other] = sector;
+        cpmSwapStaged(slot, other);
       }
+    }
+  }
+  
+  BYTE cyl;
+  BYTE head;
+  BYTE sector;
+  fdc->convertLogicalSectorToCHS(trackStart, cyl, head, sector);
+  
+  // settled on a new cylinder, or the IDs to schedule by are not there yet
+  if (fdc->getCurrentCylinder() != cyl)
+  {
+    fdc->seekDrive(cyl, head);
+    delay(fdc->getSettleTime(fdc->getParams()->DriveNumber));
+  }
+  else if (fdc->getCurrentHead() != head)
+  {
+    fdc->seekDrive(cyl, head, true);
+  }
+  
+  const bool result = fdc->readWriteSectorSet(true, sectors, stagedCount) && !fdc->getLastError();
+  stagedCount = 0;
+  return result;
+}
+
+// write the directory sectors changed in the buffer, as cpmReadDirectory() left them there
+// changedSectors: bit per directory sector
+bool cpmWriteDirectory(WORD changedSectors)
+{
+  // keep just those, not the rest of the track read ahead
+  for (BYTE slot = 0; slot < stagedCount; )
+  {
+    const WORD sector = stagedSector[slot];
+    if ((sector >= DATA_SECTOR_START) || !(changedSectors & ((WORD)1 << (sector - DIRECTORY_SECTOR_START))))
+    {
+      cpmDropStaged(slot);
+      continue;
+    }
+    
+    slot++;
+  }
+  
+  return cpmWriteStaged();
+}
+
+// write the next 128-byte record of the file from cpmCreateFile()
+// records are staged a track at a time and written when the next one is elsewhere, or the slots are full
+// false on error, or if the disk or the directory is full (cpmIsDiskFull() tells)
+bool cpmWriteFileRecord(const BYTE* data)
+{
+  if (!newFileOpen)
+  {
+    return false;
+  }
+  
+  // entering a new block, a new directory entry every 16 of them
+  BYTE* blocks = (BYTE*)getFat()->win;
+  if (!(newFileRecords % 8))
+  {
+    const BYTE block = cpmAllocateBlock();
+    if (!block || ((newFileBlocks / EXTENT_BLOCKS) + 1 > newFileEntries))
+    {
+      newFileFull = true;
+      return false;
+    }
+    
+    blocks[newFileBlocks++] = block;
+    cpmSetBlockAllocated(block);
+  }
+  
+  const WORD address = DIRECTORY_SECTOR_START + ((WORD)blocks[newFileBlocks - 1] * 8) + (newFileRecords % 8);
+  const BYTE sectorsPerTrack = fdc->getParams()->SectorsPerTrack;
+  if (stagedCount && ((stagedCount == STAGED_SLOTS) || (stagedSector[0] / sectorsPerTrack != address / sectorsPerTrack)))
+  {
+    if (!cpmWriteStaged())
+    {
+      return false;
+    }
+  }
+  
+  memcpy((BYTE*)&g_rwBuffer[stagedCount * 128], data, 128);
+  stagedSector[stagedCount++] = address;
+  newFileRecords++;
+  return true;
+}
+
+bool cpmIsDiskFull()
+{
+  return newFileFull;
+}
+
+// write the rest of the records, then the directory: the entries of the replaced file are freed,
+// the new ones go into the first unused ones, and only the directory sectors changed are written, in one go
+bool cpmCloseNewFile()
+{
+  if (!newFileOpen || !cpmWriteStaged())
+  {
+    cpmCloseFile();
+    return false;
+  }
+  newFileOpen = false;
+  
+  if (!cpmReadSectors(DIRECTORY_SECTOR_START, DIRECTORY_SECTORS))
+  {
+    stagedCount = 0;
+    return false;
+  }
+  
+  const BYTE entryCount = fdc->getParams()->SectorSizeBytes / DIRECTORY_ENTRY_SIZE;
+  const BYTE* blocks = (const BYTE*)getFat()->win;
+  const WORD extents = newFileBlocks ? ((newFileBlocks + EXTENT_BLOCKS - 1) / EXTENT_BLOCKS) : 1;
+  WORD changedSectors = 0;
+  
+  for (BYTE pass = 0; pass < 2; pass++)
+  {
+    WORD extent = 0;
+    for (BYTE index = 0; index < DIRECTORY_ENTRIES; index++)
+    {
+      CPMDirectoryEntry* entry = (CPMDirectoryEntry*)(&g_rwBuffer[index * DIRECTORY_ENTRY_SIZE]);
       
-      if (memcmp(entry->fileName, cpmFileName, sizeof(cpmFileName)) != 0)
+      // first pass: free the entries of the file replaced
+      if (!pass)
       {
-        continue;
+        if (entry->userNumber != newFileUser)
+        {
+          continue;
+        }
+        
+        BYTE chr = 0;
+        while ((chr < FILE_NAME_LENGTH) && ((entry->fileName[chr] & 0x7F) == newFileName[chr]))
+        {
+          chr++;
+        }
+        if (chr < FILE_NAME_LENGTH)
+        {
+          continue;
+        }
+        
+        entry->userNumber = DIRECTORY_ENTRY_UNUSED;
       }
       
-      // found, write
-      entry->userNumber = DIRECTORY_ENTRY_UNUSED;      
-      if (!cpmReadWriteSector(true, sector))
+      // second pass: the extents, each up to 16 blocks and 128 records
+      else
       {
-        ui->print(Progmem::getString(Progmem::fsDiskError));
-        ui->print(Progmem::getString(Progmem::uiNewLine2x));
-        return false;
+        if ((entry->userNumber != DIRECTORY_ENTRY_UNUSED) || (extent == extents))
+        {
+          continue;
+        }
+        
+        const WORD records = newFileRecords - (extent * EXTENT_BLOCKS * 8);
+        memset(entry, 0, DIRECTORY_ENTRY_SIZE);
+        entry->userNumber = newFileUser;
+        memcpy(entry->fileName, newFileName, FILE_NAME_LENGTH);
+        entry->entryIndexLo = extent & 0x1F;
+        entry->entryIndexHi = extent >> 5;
+        entry->entrySize = min(records, EXTENT_BLOCKS * 8);
+        for (BYTE block = 0; (block < EXTENT_BLOCKS) && ((extent * EXTENT_BLOCKS) + block < newFileBlocks); block++)
+        {
+          entry->allocationBlocks[block] = blocks[(extent * EXTENT_BLOCKS) + block];
+        }
+        extent++;
       }
       
-      // continue in deletion
-      // - there might be identical filenames for files bigger than 16K
-      // or identical filenames for different user numbers
-      deleteResult = true;
+      changedSectors |= (WORD)1 << (index / entryCount);
     }
     
-    sector++;
+    // the entries counted on when created are not there anymore
+    if (pass && (extent < extents))
+    {
+      stagedCount = 0;
+      newFileFull = true;
+      return false;
+    }
+  }
+  
+  return cpmWriteDirectory(changedSectors);
+}
+
+// deletes all entries of given file for all users
+bool cpmDeleteFile(const BYTE* cmdLine)
+{
+  const BYTE entryCount = fdc->getParams()->SectorSizeBytes / DIRECTORY_ENTRY_SIZE; 
+  
+  if (!cpmReadDirectory(true))
+  {
+    return false;
+  }
+  
+  BYTE cpmFileName[FILE_NAME_LENGTH];
+  convertCmdLineToCPMFileName(cmdLine, cpmFileName);
+  
+  // the name hash takes to the files of this name for all users: there might be identical filenames for
+  // files bigger than 16K, or identical filenames for different user numbers
+  WORD changedSectors = 0;
+  for (BYTE index = cpmDirectory ? cpmNameBucket[cpmHashName(cpmFileName)] : 0xFF; index != 0xFF; index = cpmDirectory[index].nextInBucket)
+  {
+    if (cpmCompareFile(&cpmDirectory[index], cpmDirectory[index].userNumber, cpmFileName) != 0)
+    {
+      continue;
+    }
+    
+    // free its entries in the directory still in the buffer
+    const BYTE fileEnd = cpmFileEnd(index);
+    for (BYTE entry = index; entry < fileEnd; entry++)
+    {
+      const BYTE diskEntry = cpmDirectory[entry].diskEntry;
+      g_rwBuffer[diskEntry * DIRECTORY_ENTRY_SIZE] = DIRECTORY_ENTRY_UNUSED;
+      changedSectors |= (WORD)1 << (diskEntry / entryCount);
+    }
+  }
+  cpmFreeDirectory();
+  
+  // deleted at least 1 entry
+  const bool deleteResult = (changedSectors != 0);
+  if (deleteResult && !cpmWriteDirectory(changedSectors))
+  {
+    ui->print(Progmem::getString(Progmem::fsDiskError));
+    ui->print(Progmem::getString(Progmem::uiNewLine2x));
+    return false;
   }
   
   // not found anything
@@ -7,8 +7,15 @@
 bool cpmOpenFile(const BYTE* cmdLine, BYTE userNumber);
 bool cpmReadFileRecord(BYTE& size);
 void cpmCloseFile();
+bool cpmCreateFile(const BYTE* cmdLine, BYTE userNumber);
+bool cpmWriteFileRecord(const BYTE* data);
+bool cpmCloseNewFile();
+bool cpmIsDiskFull();
 bool cpmDeleteFile(const BYTE* cmdLine);
 void cpmDumpFile(const BYTE* fileName);
 
+bool cpmReadWriteSector(bool write, WORD logicalAddress);
+bool cpmReadSectors(WORD logicalAddress, BYTE count);
+
 void cpmDirCommand();
 void cpmQuickFormat();
\ No newline at end of file
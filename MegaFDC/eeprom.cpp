@@ -14,7 +14,14 @@
 // +29, 27, B: drive configuration
 // +56, 27, C: drive configuration
 // +83, 27, D: drive configuration
-// +110 to 4K: 0s
+// +110, 05, A: drive calibration, spin-up (2 bytes), head settle and step rate time in ms, interleave; 0s if not calibrated
+// +115, 05, B: drive calibration
+// +120, 05, C: drive calibration
+// +125, 05, D: drive calibration
+// +130 to 4K: 0s
+
+// past the 4 drive configurations
+#define EEPROM_CALIBRATION_OFFSET (2 + (4 * sizeof(FDC::DiskDriveMediaParams)))
 
 // simple 8-bit checksum
 BYTE eepromComputeChecksum()
@@ -56,6 +63,21 @@ void eepromStoreConfiguration()
     }
   }
   
+  // zeros for the drives not configured, then the calibrations after them
+  while (eepromOffset < EEPROM_CALIBRATION_OFFSET)
+  {
+    EEPROM.update(eepromOffset++, 0);
+  }
+  for (BYTE driveNo = 0; driveNo < g_numberOfDrives; driveNo++)
+  {
+    const BYTE* calibration = (const BYTE*)fdc->getCalibration(driveNo);
+    
+    for (BYTE bufIndex = 0; bufIndex < sizeof(FDC::DriveCalibration); bufIndex++)
+    {
+      EEPROM.update(eepromOffset++, calibration[bufIndex]);
+    }
+  }
+  
   // the rest is zeros
   while (eepromOffset < EEPROM.length())
   {
@@ -117,6 +139,18 @@ bool eepromLoadConfiguration()
       drive[bufIndex] = EEPROM.read(eepromOffset++);
     }
   }
+  
+  // configurations stored before calibration existed have 0s there, meaning not calibrated
+  WORD calibrationOffset = EEPROM_CALIBRATION_OFFSET;
+  for (BYTE driveNo = 0; driveNo < g_numberOfDrives; driveNo++)
+  {
+    BYTE* calibration = (BYTE*)fdc->getCalibration(driveNo);
+    
+    for (BYTE bufIndex = 0; bufIndex < sizeof(FDC::DriveCalibration); bufIndex++)
+    {
+      calibration[bufIndex] = EEPROM.read(calibrationOffset++);
+    }
+  }
 
   return true;
 }
@@ -9,6 +9,8 @@ volatile BYTE g_rwBuffer[SECTOR_BUFFER_SIZE];
 volatile BYTE intType = 0;
 volatile BYTE intFired = 0;
 volatile WORD dataPos = 0;
+volatile DWORD dataEndTime = 0;
+volatile BYTE dataBurst = 1;   // bytes the data ISRs move per FIFO threshold request
 
 // turn off floppy motor timer, if motor on and FDC idle for more than 2 seconds
 ISR(TIMER5_COMPA_vect)
@@ -39,6 +41,32 @@ ISR(TIMER5_COMPA_vect)
   }
 }
 
+// Timer3 runs free at 16MHz / 256 (16us), its overflows counted here
+// unlike micros(), the count goes on while the data ISRs keep interrupts off for a whole transfer: a cylinder
+// at most, well under the 1.05s it takes to overflow, so the one overflow then is still flagged and counted in
+volatile WORD timerOverflows = 0;
+
+ISR(TIMER3_OVF_vect)
+{
+  timerOverflows++;
+}
+
+// microseconds for timing the FDC commands and transfers, also from within the data ISRs
+DWORD fdcMicros()
+{
+  const BYTE sreg = SREG;
+  cli();
+  const WORD count = TCNT3;
+  WORD overflows = timerOverflows;
+  if ((TIFR3 & (1 << TOV3)) && (count < 0x8000))
+  {
+    overflows++;
+  }
+  SREG = sreg;
+  
+  return ((((DWORD)overflows) << 16) | count) * FDC_TICK_MICROS;
+}
+
 // singleton
 FDC::FDC()
 {   
@@ -57,6 +85,24 @@ FDC::FDC()
   
   // no special features support determined yet
   m_specialFeatures = 0;
+  
+  // nothing timed yet, also clears the retry counters
+  resetStatistics();
+  m_traceNext = 0;
+  m_traceCount = 0;
+  memset(m_calibration, 0, sizeof(m_calibration));
+  m_positionCount = 0;
+  m_bufferChanges = 0;
+  
+  // FIFO bursts per data rate (DRR code: 500, 300, 250, 1000 kbps), smaller on faster rates for more margin
+  static const BYTE rateBursts[4] = { 4, 8, 8, 2 };
+  memcpy(m_rateBurst, rateBursts, sizeof(m_rateBurst));
+  memset(m_rateOverruns, 0, sizeof(m_rateOverruns));
+  m_fifoBurst = 1;
+  m_fifoConfigured = 0;
+  m_fifoLocked = false;
+  m_impliedSeekConfigured = false;
+  m_seekPending = false;
    
   // current physical CHS values
   m_currentCylinder = 0;
@@ -96,6 +142,14 @@ FDC::FDC()
   // enable timer (interrupts still disabled for now)
   TIMSK5 |= (1 << OCIE5A);
   
+  // Timer3 free running for fdcMicros(), 256 prescaler, normal mode
+  TCCR3A = 0;
+  TCCR3B = 0;
+  TCNT3 = 0;
+  TIFR3 = (1 << TOV3);
+  TIMSK3 = (1 << TOIE3);
+  TCCR3B = (1 << CS32);
+  
   // attach FDC INT signal (pin 2, PORTE4)
   pinMode(2, INPUT);
   setInterrupt();
@@ -115,7 +169,16 @@ BYTE FDC::getData()
     // inspect main status register, receive byte only if RQM=1 and direction is FDC->AVR
     if ((readRegister(MSR) & 0xC0) == 0xC0)
     {
-      return readRegister(DTR);
+      const BYTE data = readRegister(DTR);
+      
+      // result phase of a timed command, starts with the first byte if the interrupt was not seen
+      if (m_timingOperation != TIMING_NONE)
+      {
+        const DWORD now = fdcMicros();
+        markTimingResult(now);
+        m_timingPhaseEnd[PHASE_RESULT] = now;
+      }
+      return data;
     }
   }
   
@@ -137,6 +200,12 @@ void FDC::sendData(BYTE data)
     if ((readRegister(MSR) & 0xC0) == 0x80)
     {
       writeRegister(DTR, data);
+      
+      // command phase of a timed command lasts till its last parameter byte
+      if ((m_timingOperation != TIMING_NONE) && (m_timingPhase == PHASE_COMMAND))
+      {
+        m_timingPhaseEnd[PHASE_COMMAND] = fdcMicros();
+      }
       return;
     }
   }
@@ -157,9 +226,11 @@ void FDC::waitForINT()
     {
       // interrupt as a command result needs to be "sensed" with cmd 0x8
       intFired = 0;
+      markTimingResult(fdcMicros());
       m_lastError = false;
       return;        
     }
+    HOST_POLL_DELAY();
   }
   
   // the FDC is deaf as a post
@@ -177,8 +248,10 @@ bool FDC::waitForDATA()
     if (intFired)
     {   
       intFired = 0; //reset flag
+      markTimingResult(fdcMicros());
       return true;
     }
+    HOST_POLL_DELAY();
   }
     
   return false;
@@ -189,12 +262,11 @@ void FDC::sendCommand(BYTE command)
   // calls sendData for main commands, erases MFM flag if FM on
   if (m_params && m_params->FM)
   {
-    sendData(command & 0xBF);
-  }
-  else
-  {
-    sendData(command);
+    command &= 0xBF;
   }
+  
+  beginTiming(command);
+  sendData(command);
 }
 
 void FDC::resetController()
@@ -237,27 +309,37 @@ void FDC::resetController()
   // determine special support - try out controller capabilities: CONFIGURE and PERPENDICULAR commands
   // the former to configure FIFO enabled to offer 1Mbps mode, the latter to offer 2.88MB drives
   // both commands have no result phase - if we get one, it means the FDC did not understand the command  
-  // start with 0x13 - Configure
-  sendCommand(0x13);
-  
-  // wait for RQM response after sending
-  while (!(readRegister(MSR) & 0x80)) {};
-  
-  // direction is now FDC->AVR instead of AVR->FDC? this means the FDC wants to tell us something
-  if ((readRegister(MSR) & 0xC0) == 0xC0)
-  {
-    // and we know what it is: 0x80 Invalid command in ST0, read it and trash it
-    getData();
-  }
-  
-  // no result phase - command understood and can be specified
-  else
+  // with the FIFO configuration locked, a software reset keeps it, and CONFIGURE is known to be supported
+  if (!m_fifoLocked)
   {
-    sendData(0); // unused
-    sendData(3); // configure: implied seek off, FIFO on, with 4 bytes threshold
-    sendData(0); // starting track for write precompensation - unused, default
+    // start with 0x13 - Configure
+    sendCommand(0x13);
+    
+    // wait for RQM response after sending
+    while (!(readRegister(MSR) & 0x80)) {};
     
-    m_specialFeatures |= SUPPORT_1MBPS;
+    // direction is now FDC->AVR instead of AVR->FDC? this means the FDC wants to tell us something
+    if ((readRegister(MSR) & 0xC0) == 0xC0)
+    {
+      // and we know what it is: 0x80 Invalid command in ST0, read it and trash it
+      getData();
+    }
+    
+    // no result phase - command understood and can be specified
+    else
+    {
+      m_specialFeatures |= SUPPORT_1MBPS;
+      sendData(0); // unused
+      sendData(getConfigureData()); // configure: implied seek if usable, FIFO on, threshold for the current burst
+      sendData(0); // starting track for write precompensation - unused, default
+      m_fifoConfigured = m_fifoBurst;
+      m_impliedSeekConfigured = isImpliedSeekUsable();
+      
+      // 0x94 Lock: keep it over the software resets on retries
+      // 82077AA and later answer with the lock bit, earlier ones with 0x80 Invalid command
+      sendCommand(0x94);
+      m_fifoLocked = (getData() == 0x10);
+    }
   }
   
   // 0x12 Perpendicular mode, same check as above
@@ -290,22 +372,7 @@ void FDC::resetController()
 void FDC::setCommunicationRate()
 {
   // set FDC communication rate in kbit/s, this also adjusts drive timings
-  if (m_params->CommRate == 300)
-  {
-    writeRegister(DRR, 1);
-  }
-  else if (m_params->CommRate == 250)
-  {
-    writeRegister(DRR, 2);
-  }
-  else if (m_params->CommRate == 1000)
-  {
-    writeRegister(DRR, 3);
-  }
-  else if (m_params->CommRate == 500)
-  {
-    writeRegister(DRR, 0);
-  }
+  writeRegister(DRR, getDataRateCode());
   
   // step rate time (SRT): 8": 16ms, 5.25": 8ms, 3.5": 4ms
   if (m_params->DriveInches == 8)
@@ -323,6 +390,13 @@ void FDC::setCommunicationRate()
     m_params->SRT = 4;
   }
   
+  // a tuned step rate only ever goes faster than that
+  const BYTE stepRate = m_calibration[m_params->DriveNumber & 0x03].StepRate;
+  if (stepRate && (stepRate < m_params->SRT))
+  {
+    m_params->SRT = stepRate;
+  }
+  
   // head load time (HLT): 16ms (250k, 500k, 1M rates), 16.67ms (300kbps)
   // head unload time (HUT): 224ms (250k, 500k rates), 240ms (300kbps), 127ms (1Mbps)
   switch(m_params->CommRate)
@@ -374,6 +448,293 @@ void FDC::setCommunicationRate()
   sendCommand(3);
   sendData(srtHut);
   sendData(hltNonDMA);
+  
+  // FIFO threshold for this rate
+  configureFIFO();
+}
+
+// DRR value for the data rate, also the index of the per-rate FIFO settings
+BYTE FDC::getDataRateCode()
+{
+  switch (m_params->CommRate)
+  {
+  case 300:
+    return 1;
+  case 250:
+    return 2;
+  case 1000:
+    return 3;
+  default:
+    return 0;
+  }
+}
+
+// CONFIGURE threshold byte: FIFO raises the request with 16 - threshold bytes in (read) or free (write),
+// so that a whole burst can be moved without checking the MSR in between
+BYTE FDC::getConfigureData()
+{
+  return (isImpliedSeekUsable() ? 0x40 : 0) | (15 - m_fifoBurst);
+}
+
+// set the FIFO burst for the current data rate; locked configuration is not sent again if unchanged
+void FDC::configureFIFO()
+{
+  if (!(m_specialFeatures & SUPPORT_1MBPS))
+  {
+    m_fifoBurst = 1;
+    return;
+  }
+  
+  m_fifoBurst = m_rateBurst[getDataRateCode()];
+  if (m_fifoLocked && (m_fifoConfigured == m_fifoBurst) && (m_impliedSeekConfigured == isImpliedSeekUsable()))
+  {
+    return;
+  }
+  
+  // 0x13 Configure
+  sendCommand(0x13);
+  sendData(0);
+  sendData(getConfigureData());
+  sendData(0);
+  m_fifoConfigured = m_fifoBurst;
+  m_impliedSeekConfigured = isImpliedSeekUsable();
+}
+
+// implied seek: built with IMPLIED_SEEK and CONFIGURE supported; not with double stepping,
+// the FDC would step to the media cylinder number in the command instead of twice that
+bool FDC::isImpliedSeekUsable()
+{
+#ifdef IMPLIED_SEEK
+  return (m_specialFeatures & SUPPORT_1MBPS) && m_params && !m_params->DoubleStepping;
+#else
+  return false;
+#endif
+}
+
+// do the seek left to the next read/write command, for commands that do not seek by themselves
+void FDC::completeSeek()
+{
+  if (m_seekPending)
+  {
+    seekDrive(m_currentCylinder, m_currentHead);
+  }
+}
+
+// a timed command starts with its command byte; sense interrupt status completes a seek or recalibrate
+void FDC::beginTiming(BYTE command)
+{
+  if ((command == 8) && ((m_timingOperation == TIMING_SEEK) || (m_timingOperation == TIMING_RECALIBRATE)))
+  {
+    return;
+  }
+  endTiming();
+  
+  BYTE operation;
+  switch (command & 0x1F)
+  {
+  case 0x06: // read data
+  case 0x0C: // read deleted data
+    operation = TIMING_READ;
+    break;
+  case 0x05: // write data
+  case 0x09: // write deleted data
+    operation = TIMING_WRITE;
+    break;
+  case 0x0D:
+    operation = TIMING_FORMAT;
+    break;
+  case 0x0A:
+    operation = TIMING_READ_ID;
+    break;
+  case 0x0F:
+    operation = TIMING_SEEK;
+    break;
+  case 0x07:
+    operation = TIMING_RECALIBRATE;
+    break;
+  default:
+    return;
+  }
+  
+  if (!m_params)
+  {
+    return;
+  }
+  
+  m_timingOperation = operation;
+  m_timingCommand = command;
+  m_timingDrive = m_params->DriveNumber & 0x03;
+  m_timingPhase = PHASE_COMMAND;
+  m_timingStart = fdcMicros();
+  m_timingPhaseEnd[PHASE_COMMAND] = m_timingStart;
+}
+
+// interrupt of a timed command: execution over
+void FDC::markTimingResult(DWORD time)
+{
+  if ((m_timingOperation != TIMING_NONE) && (m_timingPhase == PHASE_COMMAND))
+  {
+    m_timingPhaseEnd[PHASE_EXECUTION] = time;
+    m_timingPhaseEnd[PHASE_RESULT] = time;
+    m_timingPhase = PHASE_RESULT;
+  }
+}
+
+// account the command being timed, closed by the next command or by reading the statistics
+// commands with no interrupt in time are left out, as are new ones when the sums would overflow
+void FDC::endTiming()
+{
+  const BYTE operation = m_timingOperation;
+  m_timingOperation = TIMING_NONE;
+  if ((operation == TIMING_NONE) || (m_timingPhase != PHASE_RESULT))
+  {
+    return;
+  }
+  
+  // kept in ticks, nothing finer to lose
+  TimingStats& stats = m_timingStats[m_timingDrive][operation];
+  const DWORD total = (m_timingPhaseEnd[PHASE_RESULT] - m_timingStart) / FDC_TICK_MICROS;
+  if ((stats.Count == 0xFFFF) || (stats.Sum + total < stats.Sum))
+  {
+    return;
+  }
+  
+  DWORD phases[PHASE_COUNT];
+  DWORD phaseStart = m_timingStart;
+  for (BYTE phase = 0; phase < PHASE_COUNT; phase++)
+  {
+    phases[phase] = (m_timingPhaseEnd[phase] - phaseStart) / FDC_TICK_MICROS;
+    phaseStart = m_timingPhaseEnd[phase];
+    if (m_phaseSums[operation][phase] + phases[phase] < m_phaseSums[operation][phase])
+    {
+      return;
+    }
+  }
+  
+  const WORD clipped = (WORD)min(total, 0xFFFFUL);
+  if (!stats.Count || (clipped < stats.Min))
+  {
+    stats.Min = clipped;
+  }
+  if (clipped > stats.Max)
+  {
+    stats.Max = clipped;
+  }
+  stats.Sum += total;
+  stats.Count++;
+  
+  for (BYTE phase = 0; phase < PHASE_COUNT; phase++)
+  {
+    m_phaseSums[operation][phase] += phases[phase];
+  }
+}
+
+FDC::TimingStats* FDC::getTimingStats(BYTE drive, BYTE operation)
+{
+  endTiming();
+  return &m_timingStats[drive & 0x03][operation];
+}
+
+// microseconds a phase of the operation took on average, all drives
+DWORD FDC::getPhaseAverage(BYTE operation, BYTE phase)
+{
+  endTiming();
+  
+  const DWORD count = getTimingCount(operation);
+  return count ? (m_phaseSums[operation][phase] / count) * FDC_TICK_MICROS : 0;
+}
+
+DWORD FDC::getTimingCount(BYTE operation)
+{
+  DWORD count = 0;
+  for (BYTE drive = 0; drive < 4; drive++)
+  {
+    count += m_timingStats[drive][operation].Count;
+  }
+  return count;
+}
+
+// timings per drive and operation, phases per operation and the retries by rung of the ladder
+void FDC::printStatistics()
+{
+  ui->print("");
+  ui->print(Progmem::getString(Progmem::statsTimings));
+  
+  bool timed = false;
+  for (BYTE drive = 0; drive < 4; drive++)
+  {
+    for (BYTE operation = 0; operation < TIMING_OPERATIONS; operation++)
+    {
+      const TimingStats* stats = getTimingStats(drive, operation);
+      if (!stats->Count)
+      {
+        continue;
+      }
+      
+      const DWORD minimum = (DWORD)stats->Min * FDC_TICK_MICROS;
+      const DWORD average = (stats->Sum / stats->Count) * FDC_TICK_MICROS;
+      const DWORD maximum = (DWORD)stats->Max * FDC_TICK_MICROS;
+      ui->print("%c: ", drive + 65);
+      ui->print(Progmem::getString(Progmem::statsRead + operation));
+      ui->print(Progmem::getString(Progmem::statsTiming), stats->Count, minimum / 1000, (minimum % 1000) / 10,
+                average / 1000, (average % 1000) / 10, maximum / 1000, (maximum % 1000) / 10);
+      timed = true;
+    }
+  }
+  
+  if (!timed)
+  {
+    ui->print(Progmem::getString(Progmem::statsNone));
+  }
+  else
+  {
+    ui->print(Progmem::getString(Progmem::statsPhases));
+    for (BYTE operation = 0; operation < TIMING_OPERATIONS; operation++)
+    {
+      if (!getTimingCount(operation))
+      {
+        continue;
+      }
+      
+      ui->print(Progmem::getString(Progmem::statsRead + operation));
+      ui->print(Progmem::getString(Progmem::statsPhase), getPhaseAverage(operation, PHASE_COMMAND),
+                getPhaseAverage(operation, PHASE_EXECUTION), getPhaseAverage(operation, PHASE_RESULT));
+    }
+  }
+  
+  ui->print(Progmem::getString(Progmem::statsRetries));
+  for (BYTE rung = 0; rung < RETRY_RUNGS; rung++)
+  {
+    ui->print(Progmem::getString(Progmem::statsInPlace + rung));
+    ui->print(Progmem::getString(Progmem::statsRetry), m_retryAttempts[rung], m_retryRecoveries[rung]);
+  }
+#ifndef MEGAFDC_HOST
+  ui->print(Progmem::getString(Progmem::statsFreeMemory), getLowestFreeMemory());
+#endif
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+}
+
+void FDC::resetStatistics()
+{
+  m_timingOperation = TIMING_NONE;
+  memset(m_timingStats, 0, sizeof(m_timingStats));
+  memset(m_phaseSums, 0, sizeof(m_phaseSums));
+  memset(m_retryAttempts, 0, sizeof(m_retryAttempts));
+  memset(m_retryRecoveries, 0, sizeof(m_retryRecoveries));
+}
+
+// overrun: the data ISRs did not get to the FIFO in time at this rate
+// each FIFO_OVERRUN_LIMIT of these halve its burst, leaving more bytes of margin for the next request
+void FDC::countOverrun()
+{
+  const BYTE rate = getDataRateCode();
+  m_rateOverruns[rate]++;
+  
+  if ((m_specialFeatures & SUPPORT_1MBPS) && !(m_rateOverruns[rate] % FIFO_OVERRUN_LIMIT) && (m_rateBurst[rate] > 1))
+  {
+    m_rateBurst[rate] /= 2;
+    configureFIFO();
+  }
 }
 
 void FDC::recalibrateDrive()
@@ -411,6 +772,7 @@ void FDC::recalibrateDrive()
     sendCommand(8);
     BYTE st0 = getData(); // status register 0
     BYTE currentCylinder = getData();
+    endTiming();
 
     // was seek successful?
     if (st0 & 0x20)
@@ -459,7 +821,7 @@ void FDC::motorOn(bool withDelay)
     writeRegister(DCR, driveSelect | motorOn | 0x0C);
     if (withDelay)
     {
-      DELAY_MS(500);  
+      delay(getSpinUpTime(m_params->DriveNumber));
     }    
     
     m_motorOn = true;
@@ -482,14 +844,23 @@ void FDC::motorOff()
   }  
 }
 
-void FDC::seekDrive(BYTE cylinder, BYTE head)
+void FDC::seekDrive(BYTE cylinder, BYTE head, bool implied)
 { 
   if (!m_params)
   {
     return;
   }
   
-  if (!m_initialized || m_lastError)
+  // implied: for a read or write command that follows right away; it selects the head by itself,
+  // and with implied seek configured, also steps to the cylinder - only keep track of where it is going to be
+  if (implied && m_initialized && !m_lastError && ((cylinder == m_currentCylinder) || m_impliedSeekConfigured))
+  {
+    m_seekPending |= (cylinder != m_currentCylinder);
+    setCurrentTrack(cylinder, head);
+    return;
+  }
+  
+  if (needsRecalibration())
   {
     recalibrateDrive();
   }
@@ -524,6 +895,7 @@ void FDC::seekDrive(BYTE cylinder, BYTE head)
     sendCommand(8);
     BYTE st0 = getData();
     BYTE seekedCyl = getData();
+    endTiming();
     
     // seek successful ?
     if (st0 & 0x20)
@@ -546,22 +918,11 @@ void FDC::seekDrive(BYTE cylinder, BYTE head)
         else
         {
           // if double stepping, store the actual media number
-          m_currentCylinder = m_params->DoubleStepping ? cylinder/2 : cylinder;
-          m_currentHead = head;
+          setCurrentTrack(m_params->DoubleStepping ? cylinder/2 : cylinder, head);
+          m_seekPending = false;
           
           m_lastError = false;
           m_idle = true;
-          
-          // handle optional TG43 line on PD7
-          if (m_currentCylinder > 42)
-          {
-            PORTD &= 0x7F; //TG43 on
-          }
-          else
-          {
-            PORTD |= 0x80; //TG43 off
-          }
-          
           return;
         }
       }
@@ -572,7 +933,61 @@ void FDC::seekDrive(BYTE cylinder, BYTE head)
   fatalError(Progmem::errSeek);
 }
 
-WORD FDC::readWriteSectors(bool writeOperation, BYTE startSector, BYTE endSector, WORD* dataPosition, bool deleted, BYTE* overrideCyl, BYTE* overrideHead)
+void FDC::setCurrentTrack(BYTE cylinder, BYTE head)
+{
+  m_currentCylinder = cylinder;
+  m_currentHead = head;
+  
+  // handle optional TG43 line on PD7
+  if (m_currentCylinder > 42)
+  {
+    PORTD &= 0x7F; //TG43 on
+  }
+  else
+  {
+    PORTD |= 0x80; //TG43 off
+  }
+}
+
+// before a retry of a read, write or verify: the rungs of the ladder by retry number, see RETRIES_IN_PLACE and RETRIES_SEEK_AWAY
+// a CRC hiccup is usually over by reading again, an off-track head by coming back from the other side, and only then recalibrate
+BYTE FDC::retryPosition(BYTE retry)
+{
+  BYTE rung = RETRY_RECALIBRATE;
+  if (retry <= RETRIES_IN_PLACE)
+  {
+    rung = RETRY_IN_PLACE;
+  }
+  else if (retry <= RETRIES_IN_PLACE + RETRIES_SEEK_AWAY)
+  {
+    rung = RETRY_SEEK_AWAY;
+  }
+  m_retryAttempts[rung]++;
+  
+  const BYTE cylinder = m_currentCylinder;
+  const BYTE head = m_currentHead;
+  if (rung == RETRY_RECALIBRATE)
+  {
+    recalibrateDrive();
+    seekDrive(cylinder, head);
+  }
+  else if (rung == RETRY_SEEK_AWAY)
+  {
+    seekDrive(((cylinder+1) < m_params->Cylinders) ? cylinder+1 : cylinder-1, head);
+    seekDrive(cylinder, head);
+  }
+  
+  // the head moved: let it settle, or the sector may pass by while its ID cannot be read yet
+  if (rung != RETRY_IN_PLACE)
+  {
+    delay(getSettleTime(m_params->DriveNumber));
+  }
+  
+  m_idle = false;
+  return rung;
+}
+
+WORD FDC::readWriteSectors(bool writeOperation, BYTE startSector, BYTE endSector, WORD* dataPosition, bool deleted, BYTE* overrideCyl, BYTE* overrideHead, bool multiTrack)
 {
   // reads/writes chosen sector off current cylinder and head to/from ioBuffer
   // writeOperation false: read, true: write
@@ -581,21 +996,11 @@ WORD FDC::readWriteSectors(bool writeOperation, BYTE startSector, BYTE endSector
   // dataPosition: custom dataPos starting index (optional)
   // deleted: read or write deleted data mark (optional, false by default)
   // overrideCyl, overrideHead: logical sector information differs from what's in the current physical track (non-standard disks)
+  // multiTrack: from head 0 continue on head 1 within the same command, sectors 1 to endSector there (MT bit)
   // returns: bytes successfully read or written
    
-  // sanity checks
-  if (!m_params || (startSector > endSector))
-  {
-    return 0;
-  }
-  
-  // check for end-of-track and data position buffer overflow
-  const WORD sectorCount = endSector-startSector+1;
-  if ((sectorCount > 1) && (sectorCount > getMaximumSectorCountForRW(startSector)))
-  {
-    return 0;
-  }  
-  if (dataPosition && ((*dataPosition)+(sectorCount*m_params->SectorSizeBytes)) > SECTOR_BUFFER_SIZE)
+  // sanity checks, end-of-track and data position buffer overflow
+  if (!getSectorCountForRW(startSector, endSector, dataPosition, multiTrack))
   {
     return 0;
   }
@@ -603,8 +1008,8 @@ WORD FDC::readWriteSectors(bool writeOperation, BYTE startSector, BYTE endSector
   // set beginning sector number
   m_currentSector = startSector;
   
-  // needs recalibrate and seek?
-  if (!m_initialized || m_lastError)
+  // needs recalibrate and seek? (never initialized or the FDC timed out)
+  if (needsRecalibration())
   {
     recalibrateDrive();
     seekDrive(m_currentCylinder, m_currentHead);
@@ -615,57 +1020,23 @@ WORD FDC::readWriteSectors(bool writeOperation, BYTE startSector, BYTE endSector
   m_noDiskInDrive = false; // reset this flag, to be determined now
   motorOn();
    
+  BYTE rung = RETRY_IN_PLACE;
   for (BYTE retries = 0; retries < DISK_OPERATION_RETRIES; retries++)
   {    
-    // retrying disk operation - need to reset, recalibrate and reseek drive back
+    // retrying disk operation - up the ladder from a plain repeat to recalibrating and reseeking drive back
     if (retries)
     {      
-      recalibrateDrive();
-      seekDrive(m_currentCylinder, m_currentHead);
-      m_idle = false;
+      rung = retryPosition(retries);
     }
     
     // set buffer position to supplied, or do from buffer index 0
     dataPos = dataPosition ? *dataPosition : 0;
-    
-    // set ISR to data transfer R/W
-    setInterrupt(writeOperation ? INTERRUPT_WRITE : INTERRUPT_READ);
-    
-    // set longitudinal or perpendicular mode
-    setRecordingMode();
-    
-    // supplied cylinder or head number differs from the physical we're currently at?
-    BYTE currentCylinder = m_currentCylinder;
-    BYTE currentHead = m_currentHead;
-    if (overrideCyl)
-    {
-      currentCylinder = *overrideCyl;
-    }
-    if (overrideHead)
-    {
-      currentHead = *overrideHead;
-    }
-    
-    // 0x46 Read data : 0x45 Write data
-    BYTE command = writeOperation ? 0x45 : 0x46;
-    if (deleted)
-    {
-      // 0x4C Read deleted data : 0x49 Write deleted data
-      command = writeOperation ? 0x49 : 0x4C;
-    }
-    sendCommand(command);
-    sendData((m_currentHead << 2) | m_params->DriveNumber); // physical head and drive
-    sendData(currentCylinder); // logical cylinder
-    sendData(currentHead); // logical head
-    sendData(startSector); // which sector to read
-    sendData(convertSectorSize(m_params->SectorSizeBytes));  // sector size 0 to 5, 128B to 4096B
-    sendData(endSector); // which ending sector
-    sendData(m_params->GapLength); // gap length
-    sendData((m_params->SectorSizeBytes == 128) ? 0x80 : 0xFF); // data transfer length
+    sendReadWriteCommand(writeOperation, startSector, endSector, deleted, overrideCyl, overrideHead, multiTrack);
     
     // check if there is a disk in drive (no timeout from FDC)
     if (!waitForDATA())
     {
+      traceEvent(retries);
       m_idle = true;
       m_lastError = true;
       m_noDiskInDrive = true;
@@ -675,22 +1046,11 @@ WORD FDC::readWriteSectors(bool writeOperation, BYTE startSector, BYTE endSector
       return 0;
     }
     
-    // get status registers
-    BYTE st0 = getData();
-    BYTE st1 = getData();
-    BYTE st2 = getData();
-    
-    // cylinder, head, sector number and size
-    getData();
-    getData();
-    m_currentSector = getData();
-    getData();
-    
-    if (processIOResult(st0, st1, st2, endSector))
+    if (getReadWriteResult(writeOperation, endSector, retries))
     {
-      if (writeOperation)
+      if (retries)
       {
-        m_diskChangeInquired = false; // data changed on disk; return disk changed yes when asked once
+        m_retryRecoveries[rung]++;
       }
       
       // no errors during I/O, return total bytes read or written successfully
@@ -703,9 +1063,237 @@ WORD FDC::readWriteSectors(bool writeOperation, BYTE startSector, BYTE endSector
   m_lastError = true;
   if (!m_silentOnTrivialError || m_diskWriteProtected)
   {
-    ui->print(ui->getPrintBuffer());  
+    ui->print(ui->getPrintBuffer());  
+  }
+  return 0;
+}
+
+bool FDC::beginReadWriteSectors(bool writeOperation, BYTE startSector, BYTE endSector, WORD dataPosition, bool multiTrack)
+{
+  // overlapped variant of readWriteSectors(): issues the command and returns while the data ISR fills or drains the buffer
+  // the caller polls isReadWriteDone() and collects the result with endReadWriteSectors()
+  // single attempt only, on failure retry with readWriteSectors()
+  if (!getSectorCountForRW(startSector, endSector, &dataPosition, multiTrack))
+  {
+    return false;
+  }
+  
+  m_currentSector = startSector;
+  if (needsRecalibration())
+  {
+    recalibrateDrive();
+    seekDrive(m_currentCylinder, m_currentHead);
+  }
+  
+  m_idle = false;
+  m_noDiskInDrive = false;
+  motorOn();
+  
+  dataPos = dataPosition;
+  sendReadWriteCommand(writeOperation, startSector, endSector, false, NULL, NULL, multiTrack);
+  
+  m_overlappedWrite = writeOperation;
+  m_overlappedEndSector = endSector;
+  m_overlappedStart = millis();
+  return true;
+}
+
+bool FDC::isReadWriteDone()
+{
+  // result phase interrupt, or none in time (no disk in drive)
+  return intFired || ((millis() - m_overlappedStart) > IO_TIMEOUT_MS);
+}
+
+DWORD FDC::getTransferEndTime()
+{
+  // fdcMicros() when the data ISR saw the end of the last read or write
+  return dataEndTime;
+}
+
+bool FDC::endReadWriteSectors()
+{
+  while (!isReadWriteDone()) {};
+  
+  if (!intFired)
+  {
+    traceEvent(0);
+    m_idle = true;
+    m_lastError = true;
+    m_noDiskInDrive = true;
+    motorOff();
+    
+    ui->print(Progmem::getString(Progmem::errINTTimeout));
+    return false;
+  }
+  
+  // the interrupt follows the end of the data right away, this loop may have seen it only later
+  intFired = 0;
+  const DWORD now = fdcMicros();
+  markTimingResult(((dataEndTime - m_timingStart) < (now - m_timingStart)) ? dataEndTime : now);
+  
+  return getReadWriteResult(m_overlappedWrite, m_overlappedEndSector);
+}
+
+void FDC::sendReadWriteCommand(bool writeOperation, BYTE startSector, BYTE endSector, bool deleted, BYTE* overrideCyl, BYTE* overrideHead, bool multiTrack)
+{
+  // set ISR to data transfer R/W, whole FIFO bursts
+  setInterrupt(writeOperation ? INTERRUPT_WRITE : INTERRUPT_READ);
+  dataBurst = m_fifoBurst;
+  
+  // set longitudinal or perpendicular mode
+  setRecordingMode();
+  
+  // supplied cylinder or head number differs from the physical we're currently at?
+  BYTE currentCylinder = m_currentCylinder;
+  BYTE currentHead = m_currentHead;
+  if (overrideCyl)
+  {
+    currentCylinder = *overrideCyl;
+  }
+  if (overrideHead)
+  {
+    currentHead = *overrideHead;
+  }
+  
+  // 0x46 Read data : 0x45 Write data
+  BYTE command = writeOperation ? 0x45 : 0x46;
+  if (deleted)
+  {
+    // 0x4C Read deleted data : 0x49 Write deleted data
+    command = writeOperation ? 0x49 : 0x4C;
+  }
+  if (multiTrack)
+  {
+    // MT: after endSector on head 0 the FDC switches to head 1, sector 1
+    command |= 0x80;
+  }
+  sendCommand(command);
+  sendData((m_currentHead << 2) | m_params->DriveNumber); // physical head and drive
+  sendData(currentCylinder); // logical cylinder
+  sendData(currentHead); // logical head
+  sendData(startSector); // which sector to read
+  sendData(convertSectorSize(m_params->SectorSizeBytes));  // sector size 0 to 5, 128B to 4096B
+  sendData(endSector); // which ending sector
+  sendData(m_params->GapLength); // gap length
+  sendData((m_params->SectorSizeBytes == 128) ? 0x80 : 0xFF); // data transfer length
+}
+
+bool FDC::getReadWriteResult(bool writeOperation, BYTE endSector, BYTE retry)
+{
+  // status registers, cylinder, head, sector number and size
+  BYTE result[7];
+  getResult(result, retry);
+  m_currentSector = result[5];
+  
+  if (processIOResult(result[0], result[1], result[2], endSector))
+  {
+    if (writeOperation)
+    {
+      m_diskChangeInquired = false; // data changed on disk; return disk changed yes when asked once
+    }
+    return true;
+  }
+  
+  return false;
+}
+
+// result phase of read, write, format and read ID: ST0, ST1, ST2, C, H, R, N
+void FDC::getResult(BYTE* result, BYTE retry)
+{
+  for (BYTE index = 0; index < 7; index++)
+  {
+    result[index] = getData();
+  }
+  traceEvent(retry, result);
+}
+
+// into the ring of recent commands, overwriting the oldest
+void FDC::traceEvent(BYTE retry, const BYTE* result)
+{
+  TraceEvent& event = m_trace[m_traceNext];
+  m_traceNext = (m_traceNext + 1) & (TRACE_EVENTS - 1);
+  if (m_traceCount < TRACE_EVENTS)
+  {
+    m_traceCount++;
+  }
+  
+  event.Start = m_timingStart;
+  event.Duration = (WORD)min((fdcMicros() - m_timingStart) / FDC_TICK_MICROS, 0xFFFFUL);
+  event.Drive = m_params->DriveNumber;
+  event.Command = m_timingCommand;
+  event.Retry = retry;
+  
+  if (result)
+  {
+    memcpy(event.Result, result, sizeof(event.Result));
+    return;
+  }
+  
+  // no interrupt in time
+  memset(event.Result, 0xFF, 3);
+  event.Result[3] = m_currentCylinder;
+  event.Result[4] = m_currentHead;
+  event.Result[5] = m_currentSector;
+  event.Result[6] = convertSectorSize(m_params->SectorSizeBytes);
+}
+
+// binary dump of the trace over serial, decoded by fdctrace/fdctrace.py: signature, event size and count,
+// the events oldest first (as in memory, little endian), and a 16-bit sum of the bytes after the signature
+void FDC::sendTrace()
+{
+  Serial.write(Progmem::getString(Progmem::traceSignature), 8);
+  
+  const BYTE header[2] = { sizeof(TraceEvent), m_traceCount };
+  Serial.write(header, sizeof(header));
+  WORD sum = header[0] + header[1];
+  
+  BYTE index = (m_traceNext - m_traceCount) & (TRACE_EVENTS - 1);
+  for (BYTE count = 0; count < m_traceCount; count++)
+  {
+    const BYTE* data = (const BYTE*)&m_trace[index];
+    Serial.write(data, sizeof(TraceEvent));
+    for (BYTE position = 0; position < sizeof(TraceEvent); position++)
+    {
+      sum += data[position];
+    }
+    index = (index + 1) & (TRACE_EVENTS - 1);
+  }
+  
+  const BYTE footer[2] = { (BYTE)sum, (BYTE)(sum >> 8) };
+  Serial.write(footer, sizeof(footer));
+  Serial.flush();
+}
+
+void FDC::deriveSkew(BYTE& headSkew, BYTE& cylinderSkew)
+{
+  // track skew for sequential reads: what a head switch and a one-cylinder step with the settle take, in whole sectors
+  // the two are timed as zero- and one-cylinder seeks on the active drive, a fair bound of the turnaround between commands
+  headSkew = 0;
+  cylinderSkew = 0;
+  if (!m_params || (m_params->Cylinders < 2))
+  {
+    return;
+  }
+  
+  // at the nominal speed; without the index gap, the sector pitch comes out a little longer, as a margin
+  const WORD rpm = ((m_params->DriveInches == 8) || ((m_params->DriveInches == 5) && (m_params->CommRate != 250))) ? 360 : 300;
+  const DWORD pitch = (60000000UL / rpm) / m_params->SectorsPerTrack;
+  
+  seekDrive(0, 0);
+  DWORD start = micros();
+  seekDrive(0, (m_params->Heads > 1) ? 1 : 0);
+  const DWORD headTime = micros() - start;
+  
+  start = micros();
+  seekDrive(1, 0);
+  const DWORD cylinderTime = (micros() - start) + (getSettleTime(m_params->DriveNumber) * 1000UL);
+  seekDrive(0, 0);
+  
+  if (m_params->Heads > 1)
+  {
+    headSkew = (BYTE)min((DWORD)m_params->SectorsPerTrack - 1, (headTime + pitch - 1) / pitch);
   }
-  return 0;
+  cylinderSkew = (BYTE)min((DWORD)m_params->SectorsPerTrack - 1, (cylinderTime + pitch - 1) / pitch);
 }
 
 BYTE* FDC::getInterleaveTable(BYTE sectorsPerTrack, BYTE interleave, BYTE startSector)
@@ -759,17 +1347,22 @@ BYTE* FDC::getInterleaveTable(BYTE sectorsPerTrack, BYTE interleave, BYTE startS
   return result;
 }
 
-bool FDC::formatTrack(bool customCHSVTable, BYTE interleave, BYTE startSector)
+bool FDC::formatTrack(bool customCHSVTable, BYTE interleave, BYTE startSector, BYTE headSkew, BYTE cylinderSkew)
 {  
   // formats current physical track (without bad sector verify)
   // customCHSVTable: true if g_rwBuffer already contains the prepared 4-byte values (optional)
   // interleave: sector interleave factor, default 1:1 (optional)
   // startSector: starting logical sector number, default 1 (optional)
+  // headSkew, cylinderSkew: sectors the track starts later than the one before it when reading sequentially,
+  // across a head switch and a cylinder step; they add up from cylinder 0 head 0 (optional, none by default)
   if (!m_params)
   {
     return false;
   }
   
+  // format has no cylinder parameter to seek by itself
+  completeSeek();
+  
   m_currentSector = startSector;
   if (!customCHSVTable)
   {
@@ -779,21 +1372,25 @@ bool FDC::formatTrack(bool customCHSVTable, BYTE interleave, BYTE startSector)
       return false;
     }
     
+    // rotate the table by the skew of this track
+    const BYTE sectorsPerTrack = m_params->SectorsPerTrack;
+    const BYTE skew = (((WORD)m_currentCylinder * (cylinderSkew + ((m_params->Heads - 1) * headSkew))) + (m_currentHead * headSkew)) % sectorsPerTrack;
+    
     // clear and prepare write buffer with 4-byte 'CHSV' format values, for each sector in track
-    memset(&g_rwBuffer[0], 0, m_params->SectorsPerTrack * 4);
+    memset(&g_rwBuffer[0], 0, sectorsPerTrack * 4);
     dataPos = 0;
-    for (BYTE sector = 0; sector < m_params->SectorsPerTrack; sector++)
+    for (BYTE sector = 0; sector < sectorsPerTrack; sector++)
     {
-      g_rwBuffer[dataPos++] = m_currentCylinder;                            // C
-      g_rwBuffer[dataPos++] = m_currentHead;                                // H
-      g_rwBuffer[dataPos++] = interleaveTable[sector+1];                    // S (table index 1-based)
-      g_rwBuffer[dataPos++] = convertSectorSize(m_params->SectorSizeBytes); // V (value of sector size, 0 to 6)
+      g_rwBuffer[dataPos++] = m_currentCylinder;                                                // C
+      g_rwBuffer[dataPos++] = m_currentHead;                                                    // H
+      g_rwBuffer[dataPos++] = interleaveTable[((sector + sectorsPerTrack - skew) % sectorsPerTrack) + 1]; // S (table index 1-based)
+      g_rwBuffer[dataPos++] = convertSectorSize(m_params->SectorSizeBytes);                     // V (value of sector size, 0 to 6)
     }
     
     delete[] interleaveTable;
   }
   
-  if (!m_initialized || m_lastError)
+  if (needsRecalibration())
   {
     recalibrateDrive();
     seekDrive(m_currentCylinder, m_currentHead);
@@ -813,7 +1410,9 @@ bool FDC::formatTrack(bool customCHSVTable, BYTE interleave, BYTE startSector)
     }
     
     // reset buffer position, set ISR to data transfer write
+    // byte by byte, as the 4 bytes per sector ID need not add up to whole bursts
     dataPos = 0;
+    dataBurst = 1;
     setInterrupt(INTERRUPT_WRITE);
     
     // set longitudinal or perpendicular mode
@@ -829,6 +1428,7 @@ bool FDC::formatTrack(bool customCHSVTable, BYTE interleave, BYTE startSector)
        
     if (!waitForDATA())
     {
+      traceEvent(retries);
       m_idle = true;
       m_lastError = true;
       m_noDiskInDrive = true;
@@ -838,14 +1438,8 @@ bool FDC::formatTrack(bool customCHSVTable, BYTE interleave, BYTE startSector)
       return false;
     }
     
-    BYTE st0 = getData();
-    BYTE st1 = getData();
-    BYTE st2 = getData();
-    
-    getData();
-    getData();
-    getData();
-    getData();
+    BYTE result[7];
+    getResult(result, retries);
     
     BYTE endSector = m_params->SectorsPerTrack;
     if (startSector == 0)
@@ -857,9 +1451,10 @@ bool FDC::formatTrack(bool customCHSVTable, BYTE interleave, BYTE startSector)
       endSector += startSector-1;
     }
     
-    if (processIOResult(st0, st1, st2, endSector))
+    if (processIOResult(result[0], result[1], result[2], endSector))
     {
       m_diskChangeInquired = false; // data changed on disk; return disk changed yes when asked once
+      m_positionCount = 0; // and maybe its layout too
       return true; // no errors during I/O
     }
   }
@@ -900,7 +1495,7 @@ WORD FDC::verify(BYTE sector, bool wholeTrack, BYTE* overrideCyl, BYTE* override
     }
   }  
   
-  if (!m_initialized || m_lastError)
+  if (needsRecalibration())
   {
     recalibrateDrive();
     seekDrive(m_currentCylinder, m_currentHead);
@@ -910,17 +1505,17 @@ WORD FDC::verify(BYTE sector, bool wholeTrack, BYTE* overrideCyl, BYTE* override
   m_noDiskInDrive = false;
   motorOn();
    
+  BYTE rung = RETRY_IN_PLACE;
   for (BYTE retries = 0; retries < DISK_OPERATION_RETRIES; retries++)
   {    
     if (retries)
     {      
-      recalibrateDrive();
-      seekDrive(m_currentCylinder, m_currentHead);
-      m_idle = false;
+      rung = retryPosition(retries);
     }
     
     // reset buffer position, set ISR to data verify
     dataPos = 0;
+    dataBurst = m_fifoBurst;
     setInterrupt(INTERRUPT_VERIFY);
     
     // set longitudinal or perpendicular mode
@@ -951,6 +1546,7 @@ WORD FDC::verify(BYTE sector, bool wholeTrack, BYTE* overrideCyl, BYTE* override
     
     if (!waitForDATA())
     {
+      traceEvent(retries);
       m_idle = true;
       m_lastError = true;
       m_noDiskInDrive = true;
@@ -960,17 +1556,16 @@ WORD FDC::verify(BYTE sector, bool wholeTrack, BYTE* overrideCyl, BYTE* override
       return 0;
     }
     
-    BYTE st0 = getData();
-    BYTE st1 = getData();
-    BYTE st2 = getData();
-    
-    getData();
-    getData(); 
-    m_currentSector = getData();
-    getData();
+    BYTE result[7];
+    getResult(result, retries);
+    m_currentSector = result[5];
     
-    if (processIOResult(st0, st1, st2, endSector))
+    if (processIOResult(result[0], result[1], result[2], endSector))
     {
+      if (retries)
+      {
+        m_retryRecoveries[rung]++;
+      }
       return dataPos;
     }
   }
@@ -1023,6 +1618,11 @@ bool FDC::verifyTrack0(bool beforeWriteOperation)
 void FDC::setInterrupt(BYTE operation)
 {
   // operation - 1: interrupt acknowledge, 2: read, 3: verify (read without storing), 4: write  
+  if ((operation == INTERRUPT_READ) || (operation == INTERRUPT_WRITE))
+  {
+    m_bufferChanges++;
+  }
+  
   // no change
   if (intType == operation)
   {
@@ -1081,7 +1681,7 @@ bool FDC::processIOResult(BYTE st0, BYTE st1, BYTE st2, BYTE endSectorNo)
   }
   
   m_lastError = true;
-  BYTE errorMessage = 0;
+  WORD errorMessage = 0;
     
   // CRC error
   if ((st1 & 0x20) || (st2 & 0x20))
@@ -1099,6 +1699,7 @@ bool FDC::processIOResult(BYTE st0, BYTE st1, BYTE st2, BYTE endSectorNo)
   else if (st1 & 0x10)
   {
     errorMessage = Progmem::errOverrun;
+    countOverrun();
   }
   
   // sector not found
@@ -1172,7 +1773,7 @@ bool FDC::processIOResult(BYTE st0, BYTE st1, BYTE st2, BYTE endSectorNo)
 }
 
 // clears the screen (serial: newlines), informs and goes into infinite loop
-void FDC::fatalError(BYTE message)
+void FDC::fatalError(WORD message)
 {
   // make sure printing and keyboard are enabled, motor timer on
   ui->setPrintDisabled(false, false);
@@ -1225,6 +1826,7 @@ void FDC::setActiveDrive(DiskDriveMediaParams* newParams)
   m_currentCylinder = 0;
   m_currentHead = 0;
   m_currentSector = 1;  
+  m_seekPending = false;
 
   m_initialized = false;
   m_lastError = false;
@@ -1234,6 +1836,7 @@ void FDC::setActiveDrive(DiskDriveMediaParams* newParams)
   m_idle = false;
   m_silentOnTrivialError = false;
   m_controlMark = false;
+  m_positionCount = 0;
   sei();  
   
   // do a quick seek test  
@@ -1281,6 +1884,176 @@ bool FDC::seekTest(BYTE toCylinder, BYTE step)
   return (m_currentCylinder == 0) && onTrackZero;
 }
 
+// measure the active drive: from motor on until the sector IDs come in sequence, and from the end of a seek
+// until they can be read; needs a formatted disk. The times are kept with a quarter more as a margin, only if both were measured
+bool FDC::calibrateDrive()
+{
+  if (!m_params || (m_params->Cylinders < 2))
+  {
+    return false;
+  }
+  
+  // start on cylinder 0 with the time from one ID to the next; the previous calibration stays in use until done
+  recalibrateDrive();
+  seekDrive(0, 0);
+  
+  DWORD pitch;
+  if (!measureRevolutionTime(&pitch) || !pitch)
+  {
+    return false;
+  }
+  
+  // let the spindle stop, then read IDs from motor on; two revolutions of them in sequence count from the first one
+  motorOff();
+  delay(2000);
+  motorOn(false);
+  const DWORD motorOnTime = millis();
+  DWORD stableTime = motorOnTime;
+  BYTE inSequence = 0;
+  BYTE previous = 0;
+  while (inSequence < m_params->SectorsPerTrack * 2)
+  {
+    BYTE sector;
+    const bool read = readSectorID(NULL, NULL, &sector);
+    const DWORD now = millis();
+    if (now - motorOnTime > IO_TIMEOUT_MS)
+    {
+      return false;
+    }
+    
+    if (!read)
+    {
+      inSequence = 0;
+      continue;
+    }
+    if (!inSequence || ((sector != previous+1) && (sector >= previous)))
+    {
+      inSequence = 0;
+      stableTime = now;
+    }
+    inSequence++;
+    previous = sector;
+  }
+  const DWORD spinUp = stableTime - motorOnTime;
+  
+  // one cylinder seeks back and forth, started at phases spread over an ID pitch: the ID read first came later than a pitch
+  // after the seek ended, so the one before it passed by unread - the head was not settled at that time yet
+  DWORD settle = 0;
+  for (BYTE seek = 0; seek < 32; seek++)
+  {
+    const DWORD phaseStart = micros();
+    while (micros() - phaseStart < (pitch * seek) / 32) {};
+    
+    seekDrive((seek & 1) ? 0 : 1, 0);
+    const DWORD seekEnd = micros();
+    if (!readSectorID())
+    {
+      return false;
+    }
+    
+    const DWORD first = micros() - seekEnd;
+    if (first > pitch + settle)
+    {
+      settle = first - pitch;
+    }
+  }
+  seekDrive(0, 0);
+  
+  // step rate and interleave are not measured here
+  DriveCalibration calibration = m_calibration[m_params->DriveNumber & 0x03];
+  calibration.SpinUpTime = (spinUp + (spinUp / 4)) + 1;
+  calibration.SettleTime = (BYTE)min(255UL, ((settle + (settle / 4)) / 1000) + 1);
+  m_calibration[m_params->DriveNumber & 0x03] = calibration;
+  return true;
+}
+
+// sweep the step rate of the active drive from the drive type default down, each one verified by seeks across the whole
+// disk; the fastest that passed, with a quarter more as a margin, is kept. Needs a formatted disk
+bool FDC::tuneStepRate()
+{
+  if (!m_params || (m_params->Cylinders < 4))
+  {
+    return false;
+  }
+  
+  DriveCalibration& calibration = m_calibration[m_params->DriveNumber & 0x03];
+  const BYTE previousStepRate = calibration.StepRate;
+  calibration.StepRate = 0;
+  setCommunicationRate();
+  
+  // 2 to 32ms in 2ms steps at 250kbps, 1ms steps otherwise
+  const BYTE defaultStepRate = m_params->SRT;
+  const BYTE increment = (m_params->CommRate == 250) ? 2 : 1;
+  BYTE fastest = 0;
+  for (BYTE stepRate = defaultStepRate; stepRate >= increment; stepRate -= increment)
+  {
+    calibration.StepRate = stepRate;
+    setCommunicationRate();
+    if (!seekVerify())
+    {
+      break;
+    }
+    fastest = stepRate;
+  }
+  
+  // the default did not pass either: nothing to go by
+  if (!fastest)
+  {
+    calibration.StepRate = previousStepRate;
+    setCommunicationRate();
+    recalibrateDrive();
+    return false;
+  }
+  
+  BYTE margin = (fastest + 3) / 4;
+  margin = ((margin + increment - 1) / increment) * increment;
+  calibration.StepRate = min(defaultStepRate, fastest + margin);
+  
+  // the head is lost after a failed pass
+  setCommunicationRate();
+  recalibrateDrive();
+  return true;
+}
+
+// full, half and near-full strokes both ways, then single steps; every landing checked with the cylinder in the sector ID
+bool FDC::seekVerify()
+{
+  const BYTE last = m_params->Cylinders - 1;
+  const BYTE pattern[] = { last, 0, (BYTE)(last / 2), (BYTE)(last - 1), 1, last, 0, 1, 2, 3, 2, 1, 0 };
+  
+  recalibrateDrive();
+  for (BYTE index = 0; index < sizeof(pattern); index++)
+  {
+    seekDrive(pattern[index], 0);
+    
+    BYTE cylinder;
+    if (!readSectorID(&cylinder) || (cylinder != pattern[index]))
+    {
+      return false;
+    }
+  }
+  
+  return true;
+}
+
+WORD FDC::getSpinUpTime(BYTE drive)
+{
+  const WORD spinUp = m_calibration[drive & 0x03].SpinUpTime;
+  return spinUp ? spinUp : SPIN_UP_TIME;
+}
+
+BYTE FDC::getSettleTime(BYTE drive)
+{
+  const BYTE settle = m_calibration[drive & 0x03].SettleTime;
+  return settle ? settle : HEAD_SETTLE_TIME;
+}
+
+BYTE FDC::getInterleave(BYTE drive)
+{
+  const BYTE interleave = m_calibration[drive & 0x03].Interleave;
+  return interleave ? interleave : 1;
+}
+
 // determine if disk has been changed in the drive
 bool FDC::isDiskChanged()
 {
@@ -1357,6 +2130,57 @@ BYTE FDC::getMaximumSectorCountForRW(BYTE startSector, WORD operationBytes)
   return endSector - startSector + 1;
 }
 
+// sector count of a multi-track operation from startSector on head 0 through the end of head 1
+// 0 if the media is single sided, or if it does not fit into the sector buffer or bytes of operation
+BYTE FDC::getMaximumSectorCountForMT(BYTE startSector, WORD operationBytes)
+{
+  if (!m_params || (m_params->Heads < 2) || (startSector > m_params->SectorsPerTrack))
+  {
+    return 0;
+  }
+  
+  const WORD maxBytes = operationBytes ? operationBytes : SECTOR_BUFFER_SIZE;
+  const WORD sectorCount = m_params->SectorsPerTrack - startSector + 1 + m_params->SectorsPerTrack;
+  if (sectorCount > maxBytes / m_params->SectorSizeBytes)
+  {
+    return 0;
+  }
+  
+  return (BYTE)sectorCount;
+}
+
+// sector count of a read/write operation, 0 if it runs past the end of track or the sector buffer
+// with multiTrack, head 0 from startSector to endSector and then head 1 from sector 1 to endSector
+WORD FDC::getSectorCountForRW(BYTE startSector, BYTE endSector, WORD* dataPosition, bool multiTrack)
+{
+  if (!m_params || (startSector > endSector))
+  {
+    return 0;
+  }
+  
+  WORD sectorCount = endSector-startSector+1;
+  if (multiTrack)
+  {
+    // MT only continues from head 0 to head 1
+    if ((m_params->Heads < 2) || m_currentHead || (endSector > m_params->SectorsPerTrack))
+    {
+      return 0;
+    }
+    sectorCount += endSector;
+  }
+  else if ((sectorCount > 1) && (sectorCount > getMaximumSectorCountForRW(startSector)))
+  {
+    return 0;
+  }
+  
+  const WORD position = dataPosition ? *dataPosition : 0;
+  if ((dataPosition || multiTrack) && ((position+(sectorCount*m_params->SectorSizeBytes)) > SECTOR_BUFFER_SIZE))
+  {
+    return 0;
+  }
+  return sectorCount;
+}
+
 // translate sector size in bytes to FDC sector size "N"
 BYTE FDC::convertSectorSize(WORD sectorSize)
 {
@@ -1434,11 +2258,12 @@ bool FDC::readSectorID(BYTE* cyl, BYTE* head, BYTE* sector, BYTE* sectorSizeN)
     return false;
   }
   
-  if (!m_initialized || m_lastError)
+  if (needsRecalibration())
   {
     recalibrateDrive();
     seekDrive(m_currentCylinder, m_currentHead);
   }
+  completeSeek();
        
   m_noDiskInDrive = false;
   motorOn(false);
@@ -1453,6 +2278,7 @@ bool FDC::readSectorID(BYTE* cyl, BYTE* head, BYTE* sector, BYTE* sectorSizeN)
     sendData((m_currentHead << 2) | m_params->DriveNumber); // head and drive
     if (!waitForDATA())
     {
+      traceEvent(retries);
       resetController();
       m_idle = true;
       m_lastError = true;
@@ -1461,25 +2287,20 @@ bool FDC::readSectorID(BYTE* cyl, BYTE* head, BYTE* sector, BYTE* sectorSizeN)
       return false;
     }
     
-    const BYTE st0 = getData();
-    const BYTE st1 = getData();
-    getData();
-    
-    const BYTE _cyl   = getData();
-    const BYTE _head  = getData();
-    m_currentSector   = getData();
-    const BYTE _ssize = getData();
+    BYTE result[7];
+    getResult(result, retries);
+    m_currentSector = result[5];
         
     // on success, return values if pointers were provided
-    if (!(st0 & 0xC0) || (st1 & 0x80))
+    if (!(result[0] & 0xC0) || (result[1] & 0x80))
     {
       if (cyl)
       {
-        *cyl = _cyl;
+        *cyl = result[3];
       }    
       if (head)
       {
-        *head = _head;
+        *head = result[4];
       }
       if (sector)
       {
@@ -1487,7 +2308,7 @@ bool FDC::readSectorID(BYTE* cyl, BYTE* head, BYTE* sector, BYTE* sectorSizeN)
       }
       if (sectorSizeN)
       {
-        *sectorSizeN = _ssize;
+        *sectorSizeN = result[6];
       }
       
       m_idle = true;
@@ -1497,4 +2318,215 @@ bool FDC::readSectorID(BYTE* cyl, BYTE* head, BYTE* sector, BYTE* sectorSizeN)
   
   m_idle = true;
   return false;
+}
+
+DWORD FDC::measureRevolutionTime(DWORD* sectorPitch)
+{
+  // sync to the ID under the head and wait for the same ID to pass again
+  // returns microseconds per revolution, 0 if the track could not be read
+  // sectorPitch (optional): microseconds from one ID to the next, the gap at the index is usually longer
+  BYTE reference;
+  if (!m_params || !readSectorID(NULL, NULL, &reference))
+  {
+    return 0;
+  }
+  
+  const DWORD start = micros();
+  DWORD previousTime = start;
+  BYTE previous = reference;
+  if (sectorPitch)
+  {
+    *sectorPitch = 0;
+  }
+  
+  for (WORD ids = 0; ids < (WORD)m_params->SectorsPerTrack * 2; ids++)
+  {
+    BYTE sector;
+    if (!readSectorID(NULL, NULL, &sector))
+    {
+      return 0;
+    }
+    
+    // shortest time between IDs following each other
+    const DWORD now = micros();
+    if (sectorPitch && (sector == previous+1) && (!*sectorPitch || (now - previousTime < *sectorPitch)))
+    {
+      *sectorPitch = now - previousTime;
+    }
+    previous = sector;
+    previousTime = now;
+    
+    if (sector == reference)
+    {
+      return now - start;
+    }
+  }
+  
+  return 0;
+}
+
+
+bool FDC::scanSectorPositions()
+{
+  // timestamped ID scan of the current track: when each sector ID passes, relative to the first one, for one revolution
+  // the offsets stay valid on other tracks of the same layout, as only their rotation differs; see scheduleSectors()
+  m_positionCount = 0;
+  BYTE reference;
+  if (!m_params || !readSectorID(NULL, NULL, &reference))
+  {
+    return false;
+  }
+  
+  const DWORD start = micros();
+  m_positionSector[0] = reference;
+  m_positionOffset[0] = 0;
+  m_positionCount = 1;
+  
+  for (WORD ids = 0; ids < (WORD)m_params->SectorsPerTrack * 2; ids++)
+  {
+    BYTE sector;
+    if (!readSectorID(NULL, NULL, &sector))
+    {
+      break;
+    }
+    
+    const DWORD now = micros();
+    if (sector == reference)
+    {
+      m_revolutionTime = now - start;
+      m_positionDrive = m_params->DriveNumber;
+      return true;
+    }
+    
+    if ((m_positionCount < SECTOR_POSITIONS) && (findSectorPosition(sector) == 0xFF))
+    {
+      m_positionSector[m_positionCount] = sector;
+      m_positionOffset[m_positionCount++] = (WORD)((now - start) / 4);
+    }
+  }
+  
+  m_positionCount = 0;
+  return false;
+}
+
+// index into the scanned positions, 0xFF if that sector ID was not seen
+BYTE FDC::findSectorPosition(BYTE sector)
+{
+  for (BYTE index = 0; index < m_positionCount; index++)
+  {
+    if (m_positionSector[index] == sector)
+    {
+      return index;
+    }
+  }
+  
+  return 0xFF;
+}
+
+bool FDC::scheduleSectors(BYTE* sectors, BYTE count)
+{
+  // order the wanted sectors of the current track by when they come under the head, after the ID under it now
+  // scans the track first if there are no positions for this drive; false and the order unchanged if it cannot be read
+  if (!m_params || (count < 2) || (count > SECTOR_POSITIONS))
+  {
+    return false;
+  }
+  if (((m_positionDrive != m_params->DriveNumber) || !m_positionCount) && !scanSectorPositions())
+  {
+    return false;
+  }
+  
+  // an ID not seen in the scan: another layout, scan again once
+  BYTE now;
+  BYTE nowIndex = 0xFF;
+  for (BYTE attempt = 0; attempt < 2; attempt++)
+  {
+    if (!readSectorID(NULL, NULL, &now))
+    {
+      return false;
+    }
+    
+    nowIndex = findSectorPosition(now);
+    if ((nowIndex != 0xFF) || attempt || !scanSectorPositions())
+    {
+      break;
+    }
+  }
+  if (nowIndex == 0xFF)
+  {
+    return false;
+  }
+  
+  // the one that just passed is a revolution away, as are the IDs not seen
+  const WORD revolution = (WORD)(m_revolutionTime / 4);
+  WORD arrival[SECTOR_POSITIONS];
+  for (BYTE index = 0; index < count; index++)
+  {
+    const BYTE position = findSectorPosition(sectors[index]);
+    arrival[index] = revolution;
+    if ((position != 0xFF) && (position != nowIndex))
+    {
+      arrival[index] = (WORD)(((DWORD)m_positionOffset[position] + revolution - m_positionOffset[nowIndex]) % revolution);
+    }
+  }
+  
+  // insertion sort, up to a few dozen sectors
+  for (BYTE index = 1; index < count; index++)
+  {
+    const BYTE sector = sectors[index];
+    const WORD time = arrival[index];
+    BYTE insert = index;
+    while (insert && (arrival[insert-1] > time))
+    {
+      sectors[insert] = sectors[insert-1];
+      arrival[insert] = arrival[insert-1];
+      insert--;
+    }
+    sectors[insert] = sector;
+    arrival[insert] = time;
+  }
+  
+  return true;
+}
+
+bool FDC::readWriteSectorSet(bool writeOperation, const BYTE* sectors, BYTE count, WORD dataPosition)
+{
+  // read or write a set of sectors off the current track in the order they come under the head
+  // the data of sectors[n] is at dataPosition + n*SectorSizeBytes; sectors that follow each other both in the order
+  // and in the buffer go in one command. False on the first sector that failed, the last error set by readWriteSectors()
+  if (!m_params || !count || (count > SECTOR_POSITIONS))
+  {
+    return false;
+  }
+  
+  BYTE order[SECTOR_POSITIONS];
+  memcpy(order, sectors, count);
+  scheduleSectors(order, count);
+  
+  for (BYTE index = 0; index < count; )
+  {
+    // where in the buffer
+    BYTE slot = 0;
+    while (sectors[slot] != order[index])
+    {
+      slot++;
+    }
+    
+    BYTE runLength = 1;
+    while ((index + runLength < count) && (slot + runLength < count) &&
+           (order[index + runLength] == order[index] + runLength) && (sectors[slot + runLength] == order[index] + runLength))
+    {
+      runLength++;
+    }
+    
+    WORD position = dataPosition + (slot * m_params->SectorSizeBytes);
+    if (!readWriteSectors(writeOperation, order[index], order[index] + runLength - 1, &position) || m_lastError)
+    {
+      return false;
+    }
+    
+    index += runLength;
+  }
+  
+  return true;
 }
\ No newline at end of file
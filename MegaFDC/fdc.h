@@ -5,6 +5,10 @@
 #pragma once
 #include "config.h"
 
+// microseconds from Timer3, counting on while interrupts are off (see fdc.cpp), in steps of one timer tick
+DWORD fdcMicros();
+#define FDC_TICK_MICROS 16
+
 // compile-time clock delay
 #define DELAY_CYCLES(n) __builtin_avr_delay_cycles(n);
 #define DELAY_MS(n)     DELAY_CYCLES(16000UL*n);
@@ -21,10 +25,45 @@
 #define INTERRUPT_VERIFY      3 // read data from disk with no buffer storage
 #define INTERRUPT_WRITE       4 // write data to disk
 
+// retry ladder rungs, cheapest first
+#define RETRY_IN_PLACE        0 // repeat the command
+#define RETRY_SEEK_AWAY       1 // step a cylinder away and back
+#define RETRY_RECALIBRATE     2 // recalibrate and seek back
+#define RETRY_RUNGS           3
+
+// timed operations, by command
+#define TIMING_READ           0 // read data, also verify
+#define TIMING_WRITE          1 // write data
+#define TIMING_FORMAT         2 // format track
+#define TIMING_READ_ID        3 // read sector ID
+#define TIMING_SEEK           4 // seek with its sense interrupt status
+#define TIMING_RECALIBRATE    5 // recalibrate with its sense interrupt status
+#define TIMING_OPERATIONS     6
+#define TIMING_NONE           0xFF
+
+// phases of a timed command
+#define PHASE_COMMAND         0 // command and parameter bytes
+#define PHASE_EXECUTION       1 // till the interrupt
+#define PHASE_RESULT          2 // result bytes
+#define PHASE_COUNT           3
+
 // special feature bit flags
 #define SUPPORT_1MBPS         1 // supports CONFIGURE command to set up a FIFO buffer for 1 Mbps transfers (82077AA, PC8477)
 #define SUPPORT_PERPENDICULAR 2 // supports PERPENDICULAR command for 2.88MB 3.5" support (82077AA, PC8477)
 
+#ifdef MEGAFDC_HOST
+
+// host build: register accesses go to the controller model (host/fdcmodel.cpp)
+BYTE hostReadRegister(BYTE reg);
+void hostWriteRegister(BYTE reg, BYTE value);
+inline BYTE readRegister(BYTE reg) { return hostReadRegister(reg); }
+inline void writeRegister(BYTE reg, BYTE value) { hostWriteRegister(reg, value); }
+
+// a pass through the loops waiting for the FDC interrupt, lets the modelled time go on
+#define HOST_POLL_DELAY() hostDelayCycles(9)
+
+#else
+
 // inlined functions to query values from the FDC
 inline BYTE readRegister(BYTE reg) __attribute__((always_inline));
 inline void writeRegister(BYTE reg, BYTE value) __attribute__((always_inline));
@@ -53,6 +92,10 @@ void writeRegister(BYTE reg, BYTE value)
   PORTC ^= 0x20;                  // toggle /WR
 }
 
+#define HOST_POLL_DELAY()
+
+#endif
+
 class FDC
 {
 public:
@@ -89,13 +132,59 @@ public:
     WORD FATClusterSizeBytes;
   };
   
+  // timings of one operation on one drive, from the command to its last result byte in FDC_TICK_MICROS ticks,
+  // the resolution of fdcMicros(); Min and Max stop at 0xFFFF (1.05 s)
+  struct TimingStats
+  {
+    WORD Count;
+    WORD Min;
+    WORD Max;
+    DWORD Sum;
+  };
+  
+  // measured by calibrateDrive(), tuneStepRate() and the INTERLEAVE command, per drive; 0: not calibrated,
+  // HEAD_SETTLE_TIME, SPIN_UP_TIME, the drive type step rate and 1:1 apply
+  struct DriveCalibration
+  {
+    WORD SpinUpTime;  // ms, motor on until the sector IDs come in sequence
+    BYTE SettleTime;  // ms, end of a seek until the sector IDs can be read
+    BYTE StepRate;    // ms, SRT the seeks were verified at, with a margin
+    BYTE Interleave;  // fastest for reading a sector per command, as the filesystems do; FORMAT uses it
+  };
+  
+  // one traced command and its result phase
+  struct TraceEvent
+  {
+    DWORD Start;    // fdcMicros() at the command byte
+    WORD Duration;  // FDC_TICK_MICROS ticks until after the result, or until the interrupt timeout; stops at 0xFFFF
+    BYTE Drive;
+    BYTE Command;
+    BYTE Retry;
+    BYTE Result[7]; // ST0, ST1, ST2, C, H, R, N; no interrupt: ST0-2 0xFF and the CHRN asked for
+  };
+  
   // inquire status
   bool isIdle() { return m_idle; }
   bool isMotorOn() { return m_motorOn; }
   bool isDiskChanged();
   bool wasDiskChangeInquired() { return m_diskChangeInquired; }
+  void setDiskChangeInquired() { m_diskChangeInquired = true; }
+  WORD getBufferChanges() { return m_bufferChanges; }
   DiskDriveMediaParams* getParams() { return m_params; }
   BYTE getSpecialFeatures() { return m_specialFeatures; }
+  BYTE getFIFOBurst() { return m_fifoBurst; }
+  WORD getOverrunCount() { return m_params ? m_rateOverruns[getDataRateCode()] : 0; }
+  WORD getRetryAttempts(BYTE rung) { return m_retryAttempts[rung]; }
+  WORD getRetryRecoveries(BYTE rung) { return m_retryRecoveries[rung]; }
+  TimingStats* getTimingStats(BYTE drive, BYTE operation);
+  DWORD getPhaseAverage(BYTE operation, BYTE phase);
+  void printStatistics();
+  void resetStatistics();
+  void sendTrace();
+  DriveCalibration* getCalibration(BYTE drive) { return &m_calibration[drive & 0x03]; }
+  WORD getSpinUpTime(BYTE drive);
+  BYTE getSettleTime(BYTE drive);
+  BYTE getInterleave(BYTE drive);
   
   // errors signaled when all retry attempts were exhausted; no disk/write protected: only 1 attempt
   bool getLastError() { return m_lastError; }
@@ -113,6 +202,7 @@ public:
   void convertLogicalSectorToCHS(WORD logicalSector, BYTE& cyl, BYTE& head, BYTE& sector);
   WORD getTotalSectorCount();
   BYTE getMaximumSectorCountForRW(BYTE startSector, WORD operationBytes = 0);
+  BYTE getMaximumSectorCountForMT(BYTE startSector, WORD operationBytes = 0);
   BYTE convertSectorSize(WORD sectorSize);
   WORD getSectorSizeBytes(BYTE sectorSizeN);
   
@@ -121,15 +211,26 @@ public:
   void resetController();
   void recalibrateDrive();
   void setCommunicationRate();
-  void seekDrive(BYTE cylinder, BYTE head);
+  void seekDrive(BYTE cylinder, BYTE head, bool implied = false);
   bool readSectorID(BYTE* cyl = NULL, BYTE* head = NULL, BYTE* sector = NULL, BYTE* sectorSizeN = NULL);
-  WORD readWriteSectors(bool writeOperation, BYTE startSector, BYTE endSector, WORD* dataPosition = NULL, bool deleted = false, BYTE* overrideCyl = NULL, BYTE* overrideHead = NULL);
-  bool formatTrack(bool customCHSVTable = false, BYTE interleave = 1, BYTE startSector = 1);
+  DWORD measureRevolutionTime(DWORD* sectorPitch = NULL);
+  bool scanSectorPositions();
+  bool scheduleSectors(BYTE* sectors, BYTE count);
+  bool readWriteSectorSet(bool writeOperation, const BYTE* sectors, BYTE count, WORD dataPosition = 0);
+  WORD readWriteSectors(bool writeOperation, BYTE startSector, BYTE endSector, WORD* dataPosition = NULL, bool deleted = false, BYTE* overrideCyl = NULL, BYTE* overrideHead = NULL, bool multiTrack = false);
+  bool beginReadWriteSectors(bool writeOperation, BYTE startSector, BYTE endSector, WORD dataPosition, bool multiTrack = false);
+  bool isReadWriteDone();
+  bool endReadWriteSectors();
+  DWORD getTransferEndTime();
+  bool formatTrack(bool customCHSVTable = false, BYTE interleave = 1, BYTE startSector = 1, BYTE headSkew = 0, BYTE cylinderSkew = 0);
+  void deriveSkew(BYTE& headSkew, BYTE& cylinderSkew);
   WORD verify(BYTE sector = 1, bool wholeTrack = true, BYTE* overrideCyl = NULL, BYTE* overrideHead = NULL);
   bool verifyTrack0(bool beforeWriteOperation = false);
   void setActiveDrive(DiskDriveMediaParams* newParams);
   void setAutomaticMotorOff(bool enabled = true);
   bool seekTest(BYTE toCylinder, BYTE step = 1);
+  bool calibrateDrive();
+  bool tuneStepRate();
   
 private:  
   FDC();
@@ -142,8 +243,30 @@ private:
   void sendData(BYTE data);  
   void sendCommand(BYTE command);
   bool processIOResult(BYTE st0, BYTE st1, BYTE st2, BYTE endSectorNo);
-  void fatalError(BYTE message);
+  void sendReadWriteCommand(bool writeOperation, BYTE startSector, BYTE endSector, bool deleted = false, BYTE* overrideCyl = NULL, BYTE* overrideHead = NULL, bool multiTrack = false);
+  WORD getSectorCountForRW(BYTE startSector, BYTE endSector, WORD* dataPosition, bool multiTrack);
+  bool getReadWriteResult(bool writeOperation, BYTE endSector, BYTE retry = 0);
+  void getResult(BYTE* result, BYTE retry);
+  void traceEvent(BYTE retry, const BYTE* result = NULL);
+  void fatalError(WORD message);
   void setRecordingMode();
+  BYTE getDataRateCode();
+  BYTE getConfigureData();
+  void configureFIFO();
+  void countOverrun();
+  BYTE retryPosition(BYTE retry);
+  bool seekVerify();
+  BYTE findSectorPosition(BYTE sector);
+  void beginTiming(BYTE command);
+  void markTimingResult(DWORD time);
+  void endTiming();
+  DWORD getTimingCount(BYTE operation);
+  
+  // not after errors the FDC reported in a result phase, the retries move the head as needed; only when it did not respond
+  bool needsRecalibration() { return !m_initialized || (m_lastError && m_noDiskInDrive); }
+  bool isImpliedSeekUsable();
+  void completeSeek();
+  void setCurrentTrack(BYTE cylinder, BYTE head);
   BYTE* getInterleaveTable(BYTE sectorsPerTrack, BYTE interleave, BYTE startSector = 1);
   
   DiskDriveMediaParams* m_params;
@@ -156,9 +279,56 @@ private:
   bool m_noDiskInDrive;
   bool m_diskWriteProtected;
   bool m_diskChangeInquired;
+  WORD m_bufferChanges;      // read and write commands so far, so that what is left in g_rwBuffer can be told apart
   bool m_lastError;
   bool m_silentOnTrivialError;
   bool m_controlMark;
   
+  // command issued by beginReadWriteSectors()
+  bool m_overlappedWrite;
+  BYTE m_overlappedEndSector;
+  DWORD m_overlappedStart;
+  
   BYTE m_specialFeatures;
+  
+  // retries per rung of the ladder, and the ones that made the operation succeed
+  WORD m_retryAttempts[RETRY_RUNGS];
+  WORD m_retryRecoveries[RETRY_RUNGS];
+  
+  // command being timed (TIMING_NONE if none), its drive and phase, fdcMicros() at the start and at the ends of its phases
+  BYTE m_timingOperation;
+  BYTE m_timingCommand;
+  BYTE m_timingDrive;
+  BYTE m_timingPhase;
+  DWORD m_timingStart;
+  DWORD m_timingPhaseEnd[PHASE_COUNT];
+  
+  // per drive and operation, and the phase sums of all drives per operation
+  TimingStats m_timingStats[4][TIMING_OPERATIONS];
+  DWORD m_phaseSums[TIMING_OPERATIONS][PHASE_COUNT];
+  
+  DriveCalibration m_calibration[4];
+  
+  // from the last timestamped ID scan: sector IDs and when they came by after the first one, in 4us (micros() resolution)
+  BYTE m_positionSector[SECTOR_POSITIONS];
+  WORD m_positionOffset[SECTOR_POSITIONS];
+  BYTE m_positionCount;
+  BYTE m_positionDrive;
+  DWORD m_revolutionTime;
+  
+  // ring of the recent traced commands
+  TraceEvent m_trace[TRACE_EVENTS];
+  BYTE m_traceNext;
+  BYTE m_traceCount;
+  
+  // FIFO bursts and overruns per data rate, indexed by DRR code
+  BYTE m_rateBurst[4];
+  WORD m_rateOverruns[4];
+  BYTE m_fifoBurst;
+  BYTE m_fifoConfigured;
+  bool m_fifoLocked;
+  
+  // implied seek enabled by CONFIGURE, and a seek left to the next read/write command
+  bool m_impliedSeekConfigured;
+  bool m_seekPending;
 };
\ No newline at end of file
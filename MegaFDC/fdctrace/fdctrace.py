@@ -0,0 +1,60 @@
+# Decode the trace of recent disk commands sent by the MegaFDC TRACE command
+# (c) J. Bogin, 2025
+# Run: python fdctrace.py capture.bin
+# where capture.bin is the raw serial data received, e.g. a terminal log in binary mode
+
+import sys
+import struct
+
+SIGNATURE = b'FDCTRACE'
+EVENT_FORMAT = '<IHBBB7B'
+TICK_US = 16
+
+COMMANDS = { 0x05: 'WRITE', 0x06: 'READ', 0x09: 'WRITEDEL', 0x0A: 'READID', 0x0C: 'READDEL', 0x0D: 'FORMAT' }
+
+# Finds the last complete trace in the capture, returns the list of events or None
+def find_trace(data):
+  position = data.rfind(SIGNATURE)
+  while (position >= 0):
+    header = position + len(SIGNATURE)
+    if (header + 2 <= len(data)):
+      size = data[header]
+      count = data[header + 1]
+      end = header + 2 + (size * count)
+      if ((size >= struct.calcsize(EVENT_FORMAT)) and (end + 2 <= len(data))):
+        checksum = sum(data[header:end]) & 0xFFFF
+        if (checksum == struct.unpack_from('<H', data, end)[0]):
+          return [struct.unpack_from(EVENT_FORMAT, data, header + 2 + (index * size)) for index in range(count)]
+    position = data.rfind(SIGNATURE, 0, position)
+  return None
+
+def command_name(command):
+  name = COMMANDS.get(command & 0x1F, '%02X' % command)
+  if (command & 0x80):
+    name += ' MT'
+  name += ' MFM' if (command & 0x40) else ' FM'
+  return name
+
+def main():
+  if (len(sys.argv) != 2):
+    print('Usage: python fdctrace.py capture.bin')
+    return 1
+  with open(sys.argv[1], 'rb') as capture:
+    events = find_trace(capture.read())
+  if (events is None):
+    print('No valid trace found')
+    return 1
+  if (not events):
+    print('Trace is empty')
+    return 0
+
+  print('      start us   took us  drv command        try  ST0 ST1 ST2   C  H   R N')
+  first = events[0][0]
+  for (start, duration, drive, command, retry, st0, st1, st2, cyl, head, sector, size) in events:
+    status = ' no interrupt' if ((st0, st1, st2) == (0xFF, 0xFF, 0xFF)) else ' %02X  %02X  %02X ' % (st0, st1, st2)
+    print('%14u %9u  %c:  %-14s %3u %s %3u %2u %3u %u' % ((start - first) & 0xFFFFFFFF, duration * TICK_US, drive + 65,
+                                                          command_name(command), retry, status, cyl, head, sector, size))
+  return 0
+
+if __name__ == '__main__':
+  sys.exit(main())
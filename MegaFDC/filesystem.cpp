@@ -5,6 +5,19 @@
 
 #ifndef BUILD_IMD_IMAGER
 
+#include "src/FatFs/diskio.h"
+
+#define DEFRAG_MARKER (AM_HID | AM_SYS) // attributes of the temporary files of DEFRAG: under their names, files without these are the user's
+#define DEFRAG_BATCH  8                  // fragmented files noted per directory scan
+
+// a fragmented file found by the directory scan, made contiguous once the scan has let go of the directory
+struct DefragEntry
+{
+  FILINFO Info;
+  WORD Fragments;
+  WORD Seeks;
+};
+
 // get pointers to FATFS and FIL structs
 FATFS* getFat()
 {
@@ -18,6 +31,11 @@ FIL* getFatFile()
   return &file;
 }
 
+// the volume stays mounted between commands, with its FAT and directory window and the sector cache,
+// until the change line says otherwise, or on drives without one, until the boot sector sums up differently
+BYTE fatMountedDrive = 0xFF;
+WORD fatBootChecksum = 0;
+
 // create empty directory
 void fatMkdir(const BYTE* dirName)
 {
@@ -146,6 +164,27 @@ void fatWriteTextFile(const BYTE* fileName)
   ui->print(Progmem::getString(Progmem::uiNewLine));
 }
 
+// the size of a new file not known in advance (XMODEM), point its cluster allocation at the start of the largest free extent
+// halving from all free space down to a cluster; the file grows there without skipping from hole to hole, nothing to truncate
+void fatPrepareContiguous(FIL* file)
+{
+  FATFS* dummy;
+  DWORD sizeFree = 0;
+  if (f_getfree(Progmem::getString(Progmem::fsCurrentDrive), &sizeFree, &dummy) != FR_OK)
+  {
+    return;
+  }
+  
+  const DWORD clusterSize = (DWORD)getFat()->csize * FF_MAX_SS;
+  for (DWORD size = sizeFree * clusterSize; size >= clusterSize; size /= 2)
+  {
+    if (f_expand(file, size, 0) != FR_DENIED)
+    {
+      break;
+    }
+  }
+}
+
 // change working directory - check if what is in the path buffer exists
 bool fatChdir()
 {
@@ -270,9 +309,498 @@ void fatDirCommand()
   ui->disableKeyboard(false);
 }
 
+// DEFRAG helpers
+// first sector of a data cluster
+DWORD fatClusterSector(DWORD cluster)
+{
+  return getFat()->database + ((cluster - 2) * getFat()->csize);
+}
+
+BYTE fatSectorCylinder(DWORD logicalSector)
+{
+  BYTE cyl;
+  BYTE head;
+  BYTE sector;
+  fdc->convertLogicalSectorToCHS(logicalSector, cyl, head, sector);
+  return cyl;
+}
+
+// a step is not left to an implied seek, the head settles before the command as in disk_flush()
+BYTE fatSeekSector(DWORD logicalSector)
+{
+  BYTE cyl;
+  BYTE head;
+  BYTE sector;
+  fdc->convertLogicalSectorToCHS(logicalSector, cyl, head, sector);
+  
+  if (fdc->getCurrentCylinder() != cyl)
+  {
+    fdc->seekDrive(cyl, head);
+    delay(fdc->getSettleTime(fdc->getParams()->DriveNumber));
+  }
+  else if (fdc->getCurrentHead() != head)
+  {
+    fdc->seekDrive(cyl, head, true);
+  }
+  
+  return sector;
+}
+
+// raw copy through the part of g_rwBuffer below the file window, as much of the source track as fits at a time
+bool fatCopySectors(DWORD from, DWORD to, DWORD count)
+{
+  while (count)
+  {
+    BYTE sector = fatSeekSector(from);
+    const BYTE chunk = min(count, fdc->getMaximumSectorCountForRW(sector, SECTOR_BUFFER_SIZE - FF_MAX_SS));
+    fdc->readWriteSectors(false, sector, sector + chunk - 1);
+    if (fdc->getLastError())
+    {
+      return false;
+    }
+    
+    // the destination can go on to the next track
+    BYTE done = 0;
+    while (done < chunk)
+    {
+      sector = fatSeekSector(to);
+      const BYTE part = min(chunk - done, fdc->getParams()->SectorsPerTrack - sector + 1);
+      WORD position = done * FF_MAX_SS;
+      fdc->readWriteSectors(true, sector, sector + part - 1, &position);
+      if (fdc->getLastError())
+      {
+        return false;
+      }
+      
+      done += part;
+      to += part;
+    }
+    
+    from += chunk;
+    count -= chunk;
+  }
+  
+  return true;
+}
+
+// follow the clusters of an open file: runs of adjacent clusters (fragments), and jumps between them to another cylinder (seeks)
+// with a destination cluster, the runs are copied there one after another
+bool fatFileLayout(FIL* file, WORD& fragments, WORD& seeks, DWORD destination = 0)
+{
+  const DWORD clusterBytes = (DWORD)getFat()->csize * FF_MAX_SS;
+  const DWORD size = f_size(file);
+  DWORD runStart = 0;
+  DWORD runLength = 0;
+  DWORD copied = 0;
+  
+  fragments = 0;
+  seeks = 0;
+  for (DWORD offset = clusterBytes; ; offset += clusterBytes)
+  {
+    // seeking to the end of a cluster leaves the file on it, no data read
+    const bool last = offset >= size;
+    if (fatResult(f_lseek(file, last ? size : offset)) != FR_OK)
+    {
+      return false;
+    }
+    
+    const DWORD cluster = file->clust;
+    if (runLength && (cluster == runStart + runLength))
+    {
+      runLength++;
+    }
+    else
+    {
+      if (runLength)
+      {
+        if (fatSectorCylinder(fatClusterSector(cluster)) != fatSectorCylinder(fatClusterSector(runStart + runLength) - 1))
+        {
+          seeks++;
+        }
+        
+        if (destination && !fatCopySectors(fatClusterSector(runStart), fatClusterSector(destination + copied), runLength * getFat()->csize))
+        {
+          return false;
+        }
+        
+        fragments++;
+        copied += runLength;
+      }
+      
+      runStart = cluster;
+      runLength = 1;
+    }
+    
+    if (last)
+    {
+      break;
+    }
+  }
+  
+  fragments++;
+  return !destination || fatCopySectors(fatClusterSector(runStart), fatClusterSector(destination + copied), runLength * getFat()->csize);
+}
+
+// FR_OK if no file has this name, FR_EXIST if one has
+FRESULT fatDefragNameFree(BYTE* path)
+{
+  FILINFO info = {0};
+  const FRESULT result = f_stat(path, &info);
+  if (result == FR_NO_FILE)
+  {
+    return FR_OK;
+  }
+  return (result == FR_OK) ? FR_EXIST : result;
+}
+
+// unlink a temporary file of DEFRAG if there is one and it is marked as such
+bool fatDefragUnlink(BYTE* path)
+{
+  FILINFO info = {0};
+  const FRESULT result = f_stat(path, &info);
+  if ((result == FR_NO_FILE) || ((result == FR_OK) && ((info.fattrib & DEFRAG_MARKER) != DEFRAG_MARKER)))
+  {
+    return true;
+  }
+  
+  return (fatResult(result) == FR_OK) && (fatResult(f_unlink(path)) == FR_OK);
+}
+
+// finish or undo the name swap an interrupted DEFRAG left in a directory, path extended in place:
+// DEFRAG.OLD goes back under the name kept in DEFRAG.NAM, or is dropped if the copy already took the name; a copy still under DEFRAG.$$$ is dropped
+bool fatDefragRecover(BYTE* path)
+{
+  const BYTE length = strlen(path);
+  
+  // too deep for DEFRAG to have worked on a file here
+  if ((length + 12 + 1) > MAX_PATH)
+  {
+    return true;
+  }
+  
+  BYTE oldPath[MAX_PATH+1] = {0};
+  strcpy(oldPath, path);
+  strcat(oldPath, Progmem::getString(Progmem::defragOldName));
+  
+  // the name of the file being swapped, written down before its first rename; marked once complete
+  FILINFO info = {0};
+  BYTE name[13] = {0};
+  UINT count = 0;
+  strcat(path, Progmem::getString(Progmem::defragNameFile));
+  if ((f_stat(path, &info) == FR_OK) && ((info.fattrib & DEFRAG_MARKER) == DEFRAG_MARKER))
+  {
+    FIL* file = getFatFile();
+    FAT_EXECUTE_0(f_open(file, path, FA_READ));
+    f_read(file, name, sizeof(name) - 1, &count);
+    f_close(file);
+  }
+  path[length] = 0;
+  
+  // DEFRAG does not start on a file while DEFRAG.OLD is taken: with the name on record, it is the file that was being swapped
+  if (count && (f_stat(oldPath, &info) == FR_OK))
+  {
+    strcat(path, name);
+    FILINFO target = {0};
+    const FRESULT found = f_stat(path, &target);
+    if (found == FR_NO_FILE)
+    {
+      FAT_EXECUTE_0(f_rename(oldPath, path));
+    }
+    else if (fatResult(found) == FR_OK)
+    {
+      // the copy has the name, and perhaps still the marker: attributes and time as in fatDefragFile()
+      FAT_EXECUTE_0(f_chmod(path, info.fattrib, AM_RDO | AM_ARC | AM_SYS | AM_HID));
+      FAT_EXECUTE_0(f_utime(path, &info));
+      FAT_EXECUTE_0(f_chmod(oldPath, 0, AM_RDO));
+      FAT_EXECUTE_0(f_unlink(oldPath));
+    }
+    else
+    {
+      path[length] = 0;
+      return false;
+    }
+    path[length] = 0;
+  }
+  
+  strcat(path, Progmem::getString(Progmem::defragTempName));
+  bool result = fatDefragUnlink(path);
+  path[length] = 0;
+  strcat(path, Progmem::getString(Progmem::defragNameFile));
+  result = result && fatDefragUnlink(path);
+  path[length] = 0;
+  return result;
+}
+
+// make one fragmented file contiguous: copy it raw into a temporary file allocated in one piece from the start of the disk on, then swap the names
+// at any time, the complete file is there under its name or under one of the temporary ones, with its name in DEFRAG.NAM
+bool fatDefragFile(BYTE* path, BYTE dirLength, DefragEntry* entry, WORD& seeksAfter)
+{
+  FIL* file = getFatFile();
+  FILINFO* info = &entry->Info;
+  WORD fragments = entry->Fragments;
+  WORD seeks = entry->Seeks;
+  
+  ui->print(Progmem::getString(Progmem::defragFragments), path, fragments);
+  
+  // boot code may expect these where they are
+  if (info->fattrib & AM_SYS)
+  {
+    ui->print(Progmem::getString(Progmem::defragSystemFile));
+    seeksAfter += seeks;
+    return true;
+  }
+  
+  BYTE tempPath[MAX_PATH+1] = {0};
+  BYTE oldPath[MAX_PATH+1] = {0};
+  BYTE namePath[MAX_PATH+1] = {0};
+  strncat(tempPath, path, dirLength);
+  strncat(oldPath, path, dirLength);
+  strncat(namePath, path, dirLength);
+  strcat(tempPath, Progmem::getString(Progmem::defragTempName));
+  strcat(oldPath, Progmem::getString(Progmem::defragOldName));
+  strcat(namePath, Progmem::getString(Progmem::defragNameFile));
+  
+  // files of the user's own under the temporary names are left alone, and so is this file
+  FRESULT names = fatDefragNameFree(tempPath);
+  if (names == FR_OK)
+  {
+    names = fatDefragNameFree(oldPath);
+  }
+  if (names == FR_OK)
+  {
+    names = fatDefragNameFree(namePath);
+  }
+  if (names == FR_EXIST)
+  {
+    ui->print(Progmem::getString(Progmem::defragNamesTaken));
+    seeksAfter += seeks;
+    return true;
+  }
+  FAT_EXECUTE_0(names);
+  
+  FAT_EXECUTE_0(f_open(file, tempPath, FA_WRITE | FA_CREATE_NEW));
+  getFat()->last_clst = 0;
+  FRESULT expanded = f_expand(file, info->fsize, 1);
+  const DWORD destination = file->obj.sclust;
+  FAT_EXECUTE_0(f_close(file));
+  if (expanded == FR_OK)
+  {
+    expanded = f_chmod(tempPath, DEFRAG_MARKER, DEFRAG_MARKER);
+  }
+  
+  if (expanded != FR_OK)
+  {
+    f_unlink(tempPath);
+    if (expanded == FR_DENIED)
+    {
+      ui->print(Progmem::getString(Progmem::defragNoRoom));
+      seeksAfter += seeks;
+      return true;
+    }
+    
+    fatResult(expanded);
+    return false;
+  }
+  
+  FAT_EXECUTE_0(f_open(file, path, FA_READ));
+  const bool copied = fatFileLayout(file, fragments, seeks, destination);
+  f_close(file);
+  if (!copied)
+  {
+    f_unlink(tempPath);
+    return false;
+  }
+  
+  // the name on record before the swap, for fatDefragRecover(); marked only when complete
+  UINT written;
+  FAT_EXECUTE_0(f_open(file, namePath, FA_WRITE | FA_CREATE_NEW));
+  const FRESULT recorded = f_write(file, path + dirLength, strlen(path + dirLength), &written);
+  FAT_EXECUTE_0(f_close(file));
+  FAT_EXECUTE_0(recorded);
+  FAT_EXECUTE_0(f_chmod(namePath, DEFRAG_MARKER, DEFRAG_MARKER));
+  
+  FAT_EXECUTE_0(f_rename(path, oldPath));
+  const FRESULT renamed = f_rename(tempPath, path);
+  if (renamed != FR_OK)
+  {
+    // the file goes back under its name
+    f_rename(oldPath, path);
+    f_unlink(tempPath);
+    f_unlink(namePath);
+    fatResult(renamed);
+    return false;
+  }
+  
+  FAT_EXECUTE_0(f_chmod(path, info->fattrib, AM_RDO | AM_ARC | AM_SYS | AM_HID));
+  FAT_EXECUTE_0(f_utime(path, info));
+  FAT_EXECUTE_0(f_chmod(oldPath, 0, AM_RDO));
+  FAT_EXECUTE_0(f_unlink(oldPath));
+  FAT_EXECUTE_0(f_unlink(namePath));
+  
+  ui->print(Progmem::getString(Progmem::uiOK));
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  return true;
+}
+
+// the files of one directory: scanned with nothing changed in it, seeks counted and up to DEFRAG_BATCH fragmented ones noted,
+// which are then made contiguous with the directory closed; the next scan goes on after the last one noted.
+// A swapped file met again is contiguous and counts no seeks
+bool fatDefragFiles(BYTE* path, WORD& seeksBefore, WORD& seeksAfter)
+{
+  const BYTE length = strlen(path);
+  const BYTE tempLength = strlen(Progmem::getString(Progmem::defragTempName));
+  DefragEntry batch[DEFRAG_BATCH];
+  DWORD scanned = 0;
+  bool full = true;
+  
+  while (full)
+  {
+    DIR dir = {0};
+    BYTE count = 0;
+    full = false;
+    
+    FAT_EXECUTE_0(f_opendir(&dir, path));
+    while (!full)
+    {
+      FILINFO* info = &batch[count].Info;
+      memset(info, 0, sizeof(FILINFO));
+      if (fatResult(f_readdir(&dir, info)) != FR_OK)
+      {
+        f_closedir(&dir);
+        return false;
+      }
+      
+      // end of directory
+      BYTE* name = info->fname;
+      if (!strlen(name))
+      {
+        break;
+      }
+      
+      // before the previous batch, temporary files of DEFRAG, directories, empty files and too deep paths skipped
+      if ((dir.dptr <= scanned) ||
+          (info->fattrib & AM_DIR) || !info->fsize ||
+          (strcmp(name, Progmem::getString(Progmem::defragTempName)) == 0) ||
+          (strcmp(name, Progmem::getString(Progmem::defragOldName)) == 0) ||
+          (strcmp(name, Progmem::getString(Progmem::defragNameFile)) == 0) ||
+          ((length + max(strlen(name), tempLength) + 1) > MAX_PATH))
+      {
+        continue;
+      }
+      
+      FIL* file = getFatFile();
+      WORD fragments;
+      WORD seeks;
+      strcat(path, name);
+      const FRESULT opened = f_open(file, path, FA_READ);
+      path[length] = 0;
+      if ((fatResult(opened) != FR_OK) || !fatFileLayout(file, fragments, seeks))
+      {
+        f_close(file);
+        f_closedir(&dir);
+        return false;
+      }
+      f_close(file);
+      
+      seeksBefore += seeks;
+      if (fragments < 2)
+      {
+        seeksAfter += seeks;
+        continue;
+      }
+      
+      batch[count].Fragments = fragments;
+      batch[count].Seeks = seeks;
+      scanned = dir.dptr;
+      full = (++count == DEFRAG_BATCH);
+    }
+    f_closedir(&dir);
+    
+    for (BYTE index = 0; index < count; index++)
+    {
+      strcat(path, batch[index].Info.fname);
+      const bool result = fatDefragFile(path, length, &batch[index], seeksAfter);
+      path[length] = 0;
+      if (!result)
+      {
+        return false;
+      }
+    }
+  }
+  
+  return true;
+}
+
+// all files in a directory, then the directories below it, path extended in place
+bool fatDefragDirectory(BYTE* path, WORD& seeksBefore, WORD& seeksAfter)
+{
+  DIR dir = {0};
+  const BYTE length = strlen(path);
+  bool result = true;
+  
+  if (!fatDefragRecover(path) || !fatDefragFiles(path, seeksBefore, seeksAfter))
+  {
+    return false;
+  }
+  
+  FAT_EXECUTE_0(f_opendir(&dir, path));
+  while (result)
+  {
+    FILINFO info = {0};
+    if (fatResult(f_readdir(&dir, &info)) != FR_OK)
+    {
+      result = false;
+      break;
+    }
+    
+    // end of directory
+    BYTE* name = info.fname;
+    if (!strlen(name))
+    {
+      break;
+    }
+    
+    // too deep paths skipped
+    if (!(info.fattrib & AM_DIR) ||
+        ((length + max(strlen(name), strlen(Progmem::getString(Progmem::defragTempName))) + 1) > MAX_PATH))
+    {
+      continue;
+    }
+    
+    strcat(path, name);
+    strcat(path, "\\");
+    result = fatDefragDirectory(path, seeksBefore, seeksAfter);
+    path[length] = 0;
+  }
+  
+  f_closedir(&dir);
+  return result;
+}
+
+// make files contiguous on the whole disk, one at a time
+void fatDefragCommand()
+{
+  if (!fatMount())
+  {
+    return;
+  }
+  
+  BYTE path[MAX_PATH+1] = {0};
+  WORD seeksBefore = 0;
+  WORD seeksAfter = 0;
+  
+  if (fatDefragDirectory(path, seeksBefore, seeksAfter))
+  {
+    ui->print(Progmem::getString(Progmem::defragSeeks), seeksAfter, seeksBefore);
+  }
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+}
+
 // create FAT filesystem (disk must be formatted)
 void fatQuickFormat()
 {
+  fatMountedDrive = 0xFF;
+  
   // verify reading of track 0, inform "try formatting" if it fails
   if (!fdc->verifyTrack0(true))
   {
@@ -294,6 +822,14 @@ void fatQuickFormat()
           
   FAT_EXECUTE(f_mkfs(Progmem::getString(Progmem::fsCurrentDrive), &param, getFat()->win, fdc->getParams()->SectorSizeBytes));
   
+  // with no clock, every volume created here would have the same serial number, and the same boot sector
+  BYTE* boot = getFat()->win;
+  const DWORD serial = micros();
+  FAT_EXECUTE((disk_read(0, boot, 0, 1) == RES_OK) ? FR_OK : FR_DISK_ERR);
+  memcpy(&boot[39], &serial, sizeof(DWORD)); // BS_VolID
+  FAT_EXECUTE((disk_write(0, boot, 0, 1) == RES_OK) ? FR_OK : FR_DISK_ERR);
+  FAT_EXECUTE((disk_ioctl(0, CTRL_SYNC, NULL) == RES_OK) ? FR_OK : FR_DISK_ERR);
+  
   ui->print(Progmem::getString(Progmem::uiOK));
   ui->print(Progmem::getString(Progmem::uiNewLine));
 }
@@ -305,6 +841,37 @@ bool fatMount()
   //const bool diskChangeInquired = fdc->wasDiskChangeInquired();
   const bool diskErrorWP = fdc->wasErrorDiskProtected();
   const bool diskChanged = fdc->isDiskChanged();
+  const bool changeLine = fdc->getParams()->DiskChangeLineSupport;
+  const bool mounted = (fatMountedDrive == fdc->getParams()->DriveNumber) && !diskErrorWP;
+  
+  // same disk, keep going; without the change line, only if nothing else used the drive meanwhile
+  if (mounted && changeLine && !diskChanged)
+  {
+    return true;
+  }
+  else if (mounted && !changeLine && disk_untouched())
+  {
+    WORD checksum;
+    if (disk_boot_checksum(&checksum) != RES_OK)
+    {
+      fatMountedDrive = 0xFF;
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      return false;
+    }
+    if (checksum == fatBootChecksum)
+    {
+      return true;
+    }
+  }
+  fatMountedDrive = 0xFF;
+  
+  // sectors a failed command left unwritten in the cache: the disk they belong to may be gone, or another command took the buffer
+  if (disk_cache_dirty())
+  {
+    disk_discard_cache();
+    ui->print(Progmem::getString(Progmem::fsWritesLost));
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+  }
    
   // verify track 0 can be read
   if (!fdc->verifyTrack0())
@@ -313,9 +880,10 @@ bool fatMount()
     return false;
   }
     
-  // (re)mount volume if disk changed
-  if (diskChanged || diskErrorWP)
+  // (re)mount volume if disk changed or was not ours, what was read ahead is gone with it
+  if (diskChanged || diskErrorWP || !mounted)
   {    
+    disk_invalidate_cache();
     FAT_EXECUTE(f_mount(NULL, Progmem::getString(Progmem::fsCurrentDrive), 0));
     FAT_EXECUTE(f_mount(getFat(), Progmem::getString(Progmem::fsCurrentDrive), 0));
     
@@ -336,13 +904,21 @@ bool fatMount()
     }
   }
   
+  // recognize the disk next time
+  if (!changeLine && (disk_boot_checksum(&fatBootChecksum) != RES_OK))
+  {
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+    return false;
+  }
+  fatMountedDrive = fdc->getParams()->DriveNumber;
+  
   return true;
 }
 
 FRESULT fatResult(FRESULT result)
 {
   // certain error messages are handled by FDC already
-  BYTE errorMessage = 0;
+  WORD errorMessage = 0;
   
   switch (result)
   {
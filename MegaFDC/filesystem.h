@@ -23,3 +23,5 @@ void fatRmdir(const BYTE* dirName);
 void fatDeleteFile(const BYTE* fileName);
 void fatDumpFile(const BYTE* fileName);
 void fatWriteTextFile(const BYTE* fileName);
+void fatPrepareContiguous(FIL* file);
+void fatDefragCommand();
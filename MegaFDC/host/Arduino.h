@@ -0,0 +1,218 @@
+// MegaFDC (c) 2023-2025 J. Bogin, http://boginjr.com
+// Host build: minimal Arduino/AVR runtime on a virtual 16MHz clock
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <math.h>
+#include <deque>
+#include <utility>
+
+// AVR clock the virtual time base counts in
+#define F_CPU 16000000UL
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH         1
+#define LOW          0
+#define INPUT        0
+#define OUTPUT       1
+#define INPUT_PULLUP 2
+#define CHANGE       1
+#define FALLING      2
+#define RISING       3
+
+#ifndef min
+#define min(a,b) ((a)<(b)?(a):(b))
+#endif
+#ifndef max
+#define max(a,b) ((a)>(b)?(a):(b))
+#endif
+
+// program memory is ordinary memory here
+#define PROGMEM
+#define PGM_P              const char*
+#define pgm_read_byte(p)   (*(const uint8_t*)(p))
+#define pgm_read_word(p)   (*(const uint16_t*)(p))
+#define pgm_read_dword(p)  (*(const uint32_t*)(p))
+#define pgm_read_ptr(p)    (*(const void* const*)(p))
+inline char* strncpy_P(void* dest, const void* src, size_t n) { return strncpy((char*)dest, (const char*)src, n); }
+inline size_t strlen_P(const void* src) { return strlen((const char*)src); }
+inline void* memcpy_P(void* dest, const void* src, size_t n) { return memcpy(dest, src, n); }
+
+// avr-libc's string functions take BYTE* through implicit conversions, C++ overloads here do not
+inline unsigned char* strchr(unsigned char* s, int c) { return (unsigned char*)strchr((char*)s, c); }
+inline const unsigned char* strchr(const unsigned char* s, int c) { return (const unsigned char*)strchr((const char*)s, c); }
+inline unsigned char* strrchr(unsigned char* s, int c) { return (unsigned char*)strrchr((char*)s, c); }
+inline const unsigned char* strrchr(const unsigned char* s, int c) { return (const unsigned char*)strrchr((const char*)s, c); }
+inline const unsigned char* strpbrk(const unsigned char* s, const void* accept) { return (const unsigned char*)strpbrk((const char*)s, (const char*)accept); }
+inline unsigned char* strstr(unsigned char* s, const void* needle) { return (unsigned char*)strstr((char*)s, (const char*)needle); }
+inline const unsigned char* strstr(const unsigned char* s, const void* needle) { return (const unsigned char*)strstr((const char*)s, (const char*)needle); }
+
+// virtual clock: every modelled bus access, delay and poll advances it by its AVR cycle cost
+uint64_t hostGetCycles();
+void hostDelayCycles(uint32_t cycles);
+void hostResetBoard();
+
+#define __builtin_avr_delay_cycles(n) hostDelayCycles(n)
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// pins: the switches read as open, everything else is discarded
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+// external interrupts: INT0..INT5; the FDC INT line on pin 2 is raised by the controller model
+#define digitalPinToInterrupt(p) (((p) == 2) ? 0 : ((p) == 3) ? 1 : -1)
+void attachInterrupt(int8_t interrupt, void (*isr)(), int mode);
+void detachInterrupt(int8_t interrupt);
+void hostRaiseInterrupt(int8_t interrupt);
+void cli();
+void sei();
+inline void interrupts() { sei(); }
+inline void noInterrupts() { cli(); }
+
+// timer vectors dispatched from the virtual clock
+#define ISR(vector) void vector()
+#define TIMER3_OVF_vect   hostTimer3Overflow
+#define TIMER4_COMPA_vect hostTimer4CompareA
+#define TIMER5_COMPA_vect hostTimer5CompareA
+void TIMER3_OVF_vect();
+void TIMER4_COMPA_vect();
+void TIMER5_COMPA_vect();
+
+// status register: only the I flag, writes go through cli()/sei()
+class HostStatusRegister
+{
+public:
+  operator uint8_t() const;
+  HostStatusRegister& operator=(uint8_t value);
+};
+
+extern HostStatusRegister SREG;
+
+// timer 3 count and overflow flag follow the virtual clock (free running, normal mode)
+class HostTimer3Register
+{
+public:
+  explicit HostTimer3Register(uint8_t address) : m_address(address) {}
+  operator uint16_t() const;
+  HostTimer3Register& operator=(uint16_t value);
+
+private:
+  uint8_t m_address;
+};
+
+extern HostTimer3Register TCNT3, TIFR3;
+
+// I/O registers touched by the firmware; bus traffic goes through hostRead/WriteRegister instead
+extern volatile uint8_t PORTA, DDRA, PINA;
+extern volatile uint8_t PORTC, DDRC, PINC;
+extern volatile uint8_t PORTD, DDRD, PIND;
+extern volatile uint8_t PINE; // bit 4: FDC INT line on pin 2, driven by the controller model
+extern volatile uint8_t TCCR3A, TCCR3B, TIMSK3;
+extern volatile uint8_t TCCR4A, TCCR4B, TIMSK4;
+extern volatile uint16_t TCNT4, OCR4A;
+extern volatile uint8_t TCCR5A, TCCR5B, TIMSK5;
+extern volatile uint16_t TCNT5, OCR5A;
+
+#define CS32   2
+#define CS31   1
+#define CS30   0
+#define TOIE3  0
+#define TOV3   0
+#define WGM42  3
+#define CS42   2
+#define CS41   1
+#define CS40   0
+#define OCIE4A 1
+#define WGM52  3
+#define CS52   2
+#define CS51   1
+#define CS50   0
+#define OCIE5A 1
+
+// USART0 registers: accesses act on the modelled line (data register, FIFO, status flags)
+class HostUSARTRegister
+{
+public:
+  explicit HostUSARTRegister(uint8_t address) : m_address(address) {}
+  operator uint8_t() const;
+  HostUSARTRegister& operator=(uint8_t value);
+  HostUSARTRegister& operator|=(uint8_t value) { return *this = (uint8_t)(*this | value); }
+  HostUSARTRegister& operator&=(int value) { return *this = (uint8_t)(*this & value); }
+
+private:
+  uint8_t m_address;
+};
+
+extern HostUSARTRegister UDR0, UCSR0A, UCSR0B;
+extern volatile uint16_t UBRR0;
+
+#define RXC0   7
+#define TXC0   6
+#define UDRE0  5
+#define DOR0   3
+#define U2X0   1
+#define RXCIE0 7
+#define UDRIE0 5
+#define RXEN0  4
+#define TXEN0  3
+
+// the Arduino core's Serial on USART0: 64 byte rings filled and drained by its RX and UDRE interrupts
+#define SERIAL_BUFFER_SIZE 64
+class HostSerialPeer;
+class HardwareSerial
+{
+public:
+  void begin(unsigned long baud);
+  int available();
+  int read();
+  int peek();
+  size_t write(uint8_t data);
+  size_t write(const uint8_t* data, size_t size);
+  size_t print(const char* str);
+  void flush();
+
+  // interrupt handlers
+  void rxCompleteInterrupt();
+  void udrEmptyInterrupt();
+
+  // host side of the line: console (stdin/stdout) unless a peer is attached
+  void setPeer(HostSerialPeer* peer);
+  void receive(const uint8_t* data, size_t size, uint64_t arrivalCycles);
+  uint32_t getByteCycles();
+
+private:
+  bool fetchConsole();
+
+  uint8_t m_rxBuffer[SERIAL_BUFFER_SIZE];
+  uint8_t m_txBuffer[SERIAL_BUFFER_SIZE];
+  volatile uint8_t m_rxHead = 0;
+  volatile uint8_t m_rxTail = 0;
+  volatile uint8_t m_txHead = 0;
+  volatile uint8_t m_txTail = 0;
+};
+
+// something at the other end of the serial cable, e.g. an XMODEM terminal
+class HostSerialPeer
+{
+public:
+  virtual ~HostSerialPeer() {}
+
+  // byte fully shifted out of the Mega's UART at the given time
+  virtual void onByte(uint8_t data, uint64_t cycles) = 0;
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,25 @@
+// MegaFDC (c) 2023-2025 J. Bogin, http://boginjr.com
+// Host build: Mega2560 4K EEPROM, kept in memory and optionally in a file (--eeprom)
+
+#pragma once
+
+#include <stdint.h>
+
+#define EEPROM_SIZE 4096
+
+class EEPROMClass
+{
+public:
+  uint8_t read(int address);
+  void write(int address, uint8_t value);
+  void update(int address, uint8_t value);
+  uint16_t length() { return EEPROM_SIZE; }
+
+private:
+  void load();
+
+  bool m_loaded = false;
+  uint8_t m_data[EEPROM_SIZE];
+};
+
+extern EEPROMClass EEPROM;
@@ -0,0 +1,8 @@
+// MegaFDC (c) 2023-2025 J. Bogin, http://boginjr.com
+// Host build: AVR special function register helpers
+
+#pragma once
+
+#ifndef _BV
+#define _BV(bit) (1 << (bit))
+#endif
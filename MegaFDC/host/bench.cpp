@@ -0,0 +1,520 @@
+// MegaFDC (c) 2023-2025 J. Bogin, http://boginjr.com
+// Host build: disk image transfer benchmark
+//
+// Runs the firmware's XMODEM image read or write against the controller model with a terminal
+// program simulated at the other end of the serial line, then reports the virtual time taken,
+// the controller statistics, and whether the data that arrived matches.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "host.h"
+#include "fdcmodel.h"
+#include "../config.h"
+
+// main.cpp is not linked in here
+Ui* ui = NULL;
+FDC* fdc = NULL;
+
+#define XM_SOH 0x01
+#define XM_STX 0x02
+#define XM_EOT 0x04
+#define XM_ACK 0x06
+#define XM_NAK 0x15
+
+static unsigned short crc16(const uint8_t* data, size_t size)
+{
+  unsigned short crc = 0;
+  while (size--)
+  {
+    crc ^= (unsigned short)*data++ << 8;
+    for (int bit = 0; bit < 8; bit++)
+    {
+      crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+// firmware messages after the transfer, e.g. bad sector counts
+static void echo(uint8_t data)
+{
+  if ((data >= ' ') || (data == '\n'))
+  {
+    putchar(data);
+  }
+}
+
+// terminal receiving a disk image (MegaFDC transmits)
+class XmodemReceiver : public HostSerialPeer
+{
+public:
+  XmodemReceiver(uint64_t latency) : m_latency(latency) {}
+
+  void start()
+  {
+    const uint8_t crcRequest = 'C';
+    Serial.receive(&crcRequest, 1, hostGetCycles() + m_latency);
+  }
+
+  void onByte(uint8_t data, uint64_t cycles) override
+  {
+    if (m_done)
+    {
+      echo(data);
+      return;
+    }
+
+    if (m_packet.empty())
+    {
+      if (data == XM_EOT)
+      {
+        m_done = true;
+        m_endCycles = cycles;
+        respond(XM_ACK, cycles);
+      }
+      else if ((data == XM_SOH) || (data == XM_STX))
+      {
+        m_packet.push_back(data);
+        m_expected = 3 + ((data == XM_STX) ? 1024 : 128) + 2;
+      }
+      return;
+    }
+
+    m_packet.push_back(data);
+    if (m_packet.size() < m_expected)
+    {
+      return;
+    }
+
+    const size_t size = m_expected - 5;
+    const unsigned short crc = crc16(&m_packet[3], size);
+    const bool valid = ((uint8_t)(m_packet[1] + m_packet[2]) == 0xFF) &&
+                       (m_packet[3 + size] == (uint8_t)(crc >> 8)) && (m_packet[4 + size] == (uint8_t)crc);
+    if (valid)
+    {
+      if (!m_packets++)
+      {
+        m_startCycles = cycles;
+      }
+      Data.insert(Data.end(), m_packet.begin() + 3, m_packet.begin() + 3 + size);
+    }
+    m_packet.clear();
+    respond(valid ? XM_ACK : XM_NAK, cycles);
+  }
+
+  bool isDone() { return m_done; }
+  uint64_t getStartCycles() { return m_startCycles; }
+  uint64_t getEndCycles() { return m_endCycles; }
+
+  std::vector<uint8_t> Data;
+
+private:
+  void respond(uint8_t data, uint64_t cycles)
+  {
+    Serial.receive(&data, 1, cycles + m_latency);
+  }
+
+  uint64_t m_latency;
+  std::vector<uint8_t> m_packet;
+  size_t m_expected = 0;
+  uint32_t m_packets = 0;
+  bool m_done = false;
+  uint64_t m_startCycles = 0;
+  uint64_t m_endCycles = 0;
+};
+
+// terminal sending a disk image (MegaFDC receives)
+class XmodemSender : public HostSerialPeer
+{
+public:
+  XmodemSender(const std::vector<uint8_t>& data, bool use1K, uint64_t latency) : m_data(data), m_blockSize(use1K ? 1024 : 128), m_latency(latency) {}
+
+  void onByte(uint8_t data, uint64_t cycles) override
+  {
+    if (m_done)
+    {
+      echo(data);
+      return;
+    }
+
+    if (!m_started)
+    {
+      if (data == 'C')
+      {
+        m_started = true;
+        m_startCycles = cycles;
+        sendBlock(cycles);
+      }
+      return;
+    }
+
+    if (data == XM_ACK)
+    {
+      if (m_eotSent)
+      {
+        m_done = true;
+        m_endCycles = cycles;
+        return;
+      }
+      m_position += m_blockSize;
+      m_block++;
+      sendBlock(cycles);
+    }
+    else if (data == XM_NAK)
+    {
+      sendBlock(cycles);
+    }
+  }
+
+  bool isDone() { return m_done; }
+  uint64_t getStartCycles() { return m_startCycles; }
+  uint64_t getEndCycles() { return m_endCycles; }
+
+private:
+  void sendBlock(uint64_t cycles)
+  {
+    std::vector<uint8_t> packet;
+    if (m_position >= m_data.size())
+    {
+      m_eotSent = true;
+      packet.push_back(XM_EOT);
+    }
+    else
+    {
+      packet.push_back((m_blockSize == 1024) ? XM_STX : XM_SOH);
+      packet.push_back(m_block);
+      packet.push_back(0xFF - m_block);
+      for (size_t index = 0; index < m_blockSize; index++)
+      {
+        packet.push_back((m_position + index < m_data.size()) ? m_data[m_position + index] : 0x1A);
+      }
+      const unsigned short crc = crc16(&packet[3], m_blockSize);
+      packet.push_back((uint8_t)(crc >> 8));
+      packet.push_back((uint8_t)crc);
+    }
+
+    Serial.receive(packet.data(), packet.size(), cycles + m_latency);
+  }
+
+  const std::vector<uint8_t>& m_data;
+  size_t m_blockSize;
+  uint64_t m_latency;
+  size_t m_position = 0;
+  uint8_t m_block = 1;
+  bool m_started = false;
+  bool m_eotSent = false;
+  bool m_done = false;
+  uint64_t m_startCycles = 0;
+  uint64_t m_endCycles = 0;
+};
+
+// drive parameters the firmware would have from SetDriveParameters()
+// CP/M on 8" SSSD, FAT12 otherwise, as the drive setup presets have it for the geometry
+static void setupFilesystemParameters(FDC::DiskDriveMediaParams& params)
+{
+  if (params.FM && (params.SectorsPerTrack == 26) && (params.SectorSizeBytes == 128))
+  {
+    params.UseCPMFS = true;
+    return;
+  }
+  
+  const uint32_t size = (uint32_t)params.Cylinders * params.Heads * params.SectorsPerTrack * params.SectorSizeBytes;
+  params.UseFAT12 = true;
+  params.FATClusterSizeBytes = (size > 1000000UL) ? 512 : 1024;
+  params.FATRootDirEntries = (size > 1000000UL) ? 224 : 112;
+  params.FATMediaDescriptor = (params.SectorsPerTrack >= 18) ? 0xF0 : (size > 400000UL) ? 0xF9 : 0xFD;
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>& data)
+{
+  FILE* file = fopen(path, "rb");
+  if (!file)
+  {
+    fprintf(stderr, "cannot open %s\n", path);
+    return false;
+  }
+  int value;
+  while ((value = fgetc(file)) != EOF)
+  {
+    data.push_back((uint8_t)value);
+  }
+  fclose(file);
+  return true;
+}
+
+static void writeFile(const char* path, const std::vector<uint8_t>& data)
+{
+  FILE* file = path ? fopen(path, "wb") : NULL;
+  if (file)
+  {
+    fwrite(data.data(), 1, data.size(), file);
+    fclose(file);
+  }
+}
+
+static void setupDriveParameters(FDC::DiskDriveMediaParams& params, HostDiskImage& image, HostOptions& options)
+{
+  memset(&params, 0, sizeof(params));
+  params.DriveNumber = 0;
+  params.DriveInches = hostFDC.getDrive(0).Inches;
+  params.Cylinders = image.getCylinders();
+  params.Heads = image.getHeads();
+  params.SectorSizeBytes = 128 << image.getSizeN();
+  params.SectorsPerTrack = image.getSectors();
+  params.CommRate = image.getRate();
+  params.FM = image.isFM();
+  params.DoubleStepping = options.DoubleStep;
+  params.DiskChangeLineSupport = (params.DriveInches == 3) || ((params.DriveInches == 5) && (params.SectorsPerTrack == 15));
+  params.PerpendicularRecording = (params.CommRate == 1000);
+  params.LowLevelFormatFiller = params.FM ? 0xE5 : 0xF6;
+  params.GapLength = params.FM ? 7 : 0x1B;
+  params.Gap3Length = 0x54;
+
+  // gap lengths of the presets
+  if ((params.DriveInches == 5) && (params.CommRate != 500))
+  {
+    params.GapLength = 0x2A;
+    params.Gap3Length = 0x50;
+  }
+  else if (params.SectorsPerTrack == 9)
+  {
+    params.Gap3Length = (params.DriveInches == 8) ? 0x54 : 0x50;
+  }
+  else if (params.SectorsPerTrack == 16)
+  {
+    params.GapLength = 0x18;
+    params.Gap3Length = 0x50;
+  }
+  else if (params.SectorsPerTrack == 18)
+  {
+    params.Gap3Length = 0x6C;
+  }
+  else if (params.SectorsPerTrack == 36)
+  {
+    params.Gap3Length = 0x53;
+  }
+  else if (params.FM)
+  {
+    params.Gap3Length = 0x1B;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  std::string operation = "read";
+  const char* inputPath = NULL;
+  const char* outputPath = NULL;
+  const char* fileName = NULL;
+  bool use1K = false;
+  bool makeFilesystem = false;
+  double latencyMs = 0;
+
+  for (int index = 1; index < argc; )
+  {
+    const int consumed = hostParseOption(argc, argv, index, g_hostOptions);
+    if (consumed > 0)
+    {
+      index += consumed;
+      continue;
+    }
+
+    const std::string option = argv[index];
+    const char* value = (index + 1 < argc) ? argv[index + 1] : NULL;
+    if ((consumed == 0) && (option == "--1k"))
+    {
+      use1K = true;
+      index++;
+    }
+    else if ((consumed == 0) && (option == "--mkfs"))
+    {
+      makeFilesystem = true;
+      index++;
+    }
+    else if ((consumed == 0) && value && ((option == "--op") || (option == "--in") || (option == "--out") || (option == "--latency-ms") ||
+             (option == "--file")))
+    {
+      if (option == "--op") operation = value;
+      else if (option == "--in") inputPath = value;
+      else if (option == "--out") outputPath = value;
+      else if (option == "--file") fileName = value;
+      else latencyMs = atof(value);
+      index += 2;
+    }
+    else
+    {
+      hostUsage(argv[0], "\n  --op read|write      disk to terminal (default) or terminal to disk\n"
+                         "  --op get|put         a FAT12 file from or to the disk (get for CP/M too), see --file\n"
+                         "  --file <name>        the file for get and put\n"
+                         "  --mkfs               create the FAT12 filesystem before put\n"
+                         "  --in <file>          data to write (default: a test pattern)\n"
+                         "  --out <file>         store the data read\n"
+                         "  --1k                 XMODEM-1K\n"
+                         "  --latency-ms <n>     terminal turnaround per packet");
+      return 1;
+    }
+  }
+
+  const bool fileOperation = (operation == "get") || (operation == "put");
+  if (!g_hostOptions.ImagePath || ((operation != "read") && (operation != "write") && !fileOperation) || (fileOperation && !fileName))
+  {
+    hostUsage(argv[0]);
+    return 1;
+  }
+  if (!hostSetup(g_hostOptions))
+  {
+    return 1;
+  }
+
+  HostDiskImage& image = *g_hostOptions.Image;
+  static FDC::DiskDriveMediaParams params;
+  setupDriveParameters(params, image, g_hostOptions);
+  if (fileOperation)
+  {
+    setupFilesystemParameters(params);
+  }
+  g_diskDrives = &params;
+  g_numberOfDrives = 1;
+
+  // firmware side, as in setup() without the interactive drive configuration
+  ui = Ui::get();
+  fdc = FDC::get();
+  fdc->setActiveDrive(&params);
+
+  const uint64_t latency = (uint64_t)(latencyMs * (F_CPU / 1000));
+  const std::vector<uint8_t> original = image.flatten();
+  std::vector<uint8_t> payload;
+  hostFDC.resetStats();
+
+  bool result;
+  uint64_t startCycles;
+  uint64_t endCycles;
+  const uint64_t benchStart = hostGetCycles();
+  if (operation == "get")
+  {
+    // what was put before can be given with --in, the received file is padded up to the packet size
+    if (inputPath && !readFile(inputPath, payload))
+    {
+      return 1;
+    }
+    
+    XmodemReceiver receiver(latency);
+    Serial.setPeer(&receiver);
+    receiver.start();
+    result = xmodemSendFile((const BYTE*)fileName, use1K) && receiver.isDone();
+    Serial.setPeer(NULL);
+
+    startCycles = receiver.getStartCycles();
+    endCycles = receiver.getEndCycles();
+    if (inputPath)
+    {
+      result = result && (receiver.Data.size() >= payload.size()) && std::equal(payload.begin(), payload.end(), receiver.Data.begin());
+    }
+    else
+    {
+      payload = receiver.Data;
+    }
+    writeFile(outputPath, receiver.Data);
+  }
+  else if (operation == "put")
+  {
+    if (inputPath ? !readFile(inputPath, payload) : false)
+    {
+      return 1;
+    }
+    if (!inputPath)
+    {
+      for (size_t index = 0; index < 100 * 1024UL; index++)
+      {
+        payload.push_back((uint8_t)((index * 7) ^ (index >> 9)));
+      }
+    }
+    if (makeFilesystem)
+    {
+      fatQuickFormat();
+    }
+    hostFDC.resetStats();
+
+    XmodemSender sender(payload, use1K, latency);
+    Serial.setPeer(&sender);
+    result = xmodemReceiveFile((const BYTE*)fileName, use1K) && sender.isDone();
+    Serial.setPeer(NULL);
+
+    startCycles = sender.getStartCycles();
+    endCycles = sender.getEndCycles();
+  }
+  else if (operation == "read")
+  {
+    XmodemReceiver receiver(latency);
+    Serial.setPeer(&receiver);
+    receiver.start();
+    result = xmodemReadDiskIntoImageFile(use1K) && receiver.isDone();
+    Serial.setPeer(NULL);
+
+    startCycles = receiver.getStartCycles();
+    endCycles = receiver.getEndCycles();
+    payload = receiver.Data;
+    payload.resize(original.size() < payload.size() ? original.size() : payload.size());
+    result = result && (payload == original);
+
+    if (outputPath)
+    {
+      FILE* file = fopen(outputPath, "wb");
+      if (file)
+      {
+        fwrite(payload.data(), 1, payload.size(), file);
+        fclose(file);
+      }
+    }
+  }
+  else
+  {
+    if (inputPath)
+    {
+      FILE* file = fopen(inputPath, "rb");
+      if (!file)
+      {
+        fprintf(stderr, "cannot open %s\n", inputPath);
+        return 1;
+      }
+      int data;
+      while ((data = fgetc(file)) != EOF)
+      {
+        payload.push_back((uint8_t)data);
+      }
+      fclose(file);
+    }
+    else
+    {
+      for (size_t index = 0; index < original.size(); index++)
+      {
+        payload.push_back((uint8_t)((index * 7) ^ (index >> 9)));
+      }
+    }
+
+    XmodemSender sender(payload, use1K, latency);
+    Serial.setPeer(&sender);
+    result = xmodemWriteDiskFromImageFile(use1K) && sender.isDone();
+    Serial.setPeer(NULL);
+
+    startCycles = sender.getStartCycles();
+    endCycles = sender.getEndCycles();
+    std::vector<uint8_t> written = image.flatten();
+    payload.resize(written.size() < payload.size() ? written.size() : payload.size());
+    written.resize(payload.size());
+    result = result && (written == payload);
+  }
+
+  const double seconds = (endCycles > startCycles) ? (endCycles - startCycles) / (double)F_CPU : 0;
+  fprintf(stdout, "\n%s %u bytes in %.3f s virtual (%.1f KiB/s), total %.3f s, %s\n", operation.c_str(), (unsigned)payload.size(), seconds,
+          seconds ? payload.size() / 1024.0 / seconds : 0, (hostGetCycles() - benchStart) / (double)F_CPU, result ? "data OK" : "FAILED");
+  fprintf(stdout, "serial receive overruns %u\n", g_hostOptions.SerialOverruns);
+  hostFDC.printStats(stdout);
+
+  if (g_hostOptions.SaveImage)
+  {
+    image.save();
+  }
+
+  return result ? 0 : 2;
+}
@@ -0,0 +1,536 @@
+// MegaFDC (c) 2023-2025 J. Bogin, http://boginjr.com
+// Host build: raw (.img) and ImageDisk (.imd) floppy images with a physical track layout
+
+#include "diskimage.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+// common raw image sizes, same geometries as offered by SetDriveParameters()
+static const struct
+{
+  long Size;
+  uint8_t Cylinders;
+  uint8_t Heads;
+  uint8_t Sectors;
+  uint8_t SizeN;
+  uint16_t Rate;
+  bool FM;
+  uint8_t Gap3;
+} rawGeometries[] =
+{
+  { 163840,  40, 1, 8,  2, 250,  false, 0x50 },
+  { 184320,  40, 1, 9,  2, 250,  false, 0x50 },
+  { 327680,  40, 2, 8,  2, 250,  false, 0x50 },
+  { 368640,  40, 2, 9,  2, 250,  false, 0x50 },
+  { 737280,  80, 2, 9,  2, 250,  false, 0x50 },
+  { 1228800, 80, 2, 15, 2, 500,  false, 0x54 },
+  { 1474560, 80, 2, 18, 2, 500,  false, 0x6C },
+  { 2949120, 80, 2, 36, 2, 1000, false, 0x53 },
+  { 256256,  77, 1, 26, 0, 500,  true,  0x1B },
+  { 354816,  77, 1, 9,  2, 500,  false, 0x54 },
+  { 630784,  77, 1, 16, 2, 500,  false, 0x50 },
+  { 1261568, 77, 2, 16, 2, 500,  false, 0x50 }
+};
+
+// IMD modes 0-5: 500, 300, 250 kbps FM, then the same in MFM
+static const uint16_t imdRates[] = { 500, 300, 250 };
+
+void HostTrack::layout()
+{
+  uint32_t offset = HostTrackFormat::indexGap(FM);
+  for (HostSector& sector : Sectors)
+  {
+    sector.IDOffset = offset;
+    offset += HostTrackFormat::idField(FM) + HostTrackFormat::gap2(FM) + HostTrackFormat::dataSync(FM);
+    offset += (128 << sector.SizeN) + HostTrackFormat::crc() + Gap3;
+  }
+}
+
+// track capacity in bytes at the drive speed this kind of media is spun at
+static uint32_t trackCapacity(uint16_t rate, bool fm, bool eightInch)
+{
+  const uint32_t rpm = ((rate == 300) || eightInch) ? 360 : 300;
+  return (uint32_t)rate * 1000 / 8 * 60 / rpm / (fm ? 2 : 1);
+}
+
+uint8_t HostDiskImage::fitGap3(const HostTrack& track, uint32_t trackBytes)
+{
+  uint32_t used = HostTrackFormat::indexGap(track.FM);
+  for (const HostSector& sector : track.Sectors)
+  {
+    used += HostTrackFormat::idField(track.FM) + HostTrackFormat::gap2(track.FM) + HostTrackFormat::dataSync(track.FM);
+    used += (128 << sector.SizeN) + HostTrackFormat::crc();
+  }
+
+  // keep some gap4b at the end of the track
+  if (track.Sectors.empty() || (used + 32 >= trackBytes))
+  {
+    return 4;
+  }
+
+  uint32_t gap = (trackBytes - used - 32) / track.Sectors.size();
+  return (gap > 0x6C) ? 0x6C : (gap < 4) ? 4 : (uint8_t)gap;
+}
+
+bool HostDiskImage::guessGeometry(long size, uint8_t& cylinders, uint8_t& heads, uint8_t& sectors, uint8_t& sizeN, uint16_t& rate, bool& fm, uint8_t& gap3)
+{
+  for (const auto& geometry : rawGeometries)
+  {
+    if (geometry.Size != size)
+    {
+      continue;
+    }
+
+    cylinders = geometry.Cylinders;
+    heads = geometry.Heads;
+    sectors = geometry.Sectors;
+    sizeN = geometry.SizeN;
+    rate = geometry.Rate;
+    fm = geometry.FM;
+    gap3 = geometry.Gap3;
+    return true;
+  }
+
+  return false;
+}
+
+bool HostDiskImage::load(const char* path, uint8_t cylinders, uint8_t heads, uint8_t sectors, uint8_t sizeN, uint16_t rate, bool fm, uint8_t gap3)
+{
+  const size_t length = strlen(path);
+  if ((length > 4) && !strcasecmp(&path[length - 4], ".imd"))
+  {
+    return loadIMD(path);
+  }
+
+  return loadRaw(path, cylinders, heads, sectors, sizeN, rate, fm, gap3);
+}
+
+bool HostDiskImage::loadRaw(const char* path, uint8_t cylinders, uint8_t heads, uint8_t sectors, uint8_t sizeN, uint16_t rate, bool fm, uint8_t gap3)
+{
+  FILE* file = fopen(path, "rb");
+  if (!file)
+  {
+    fprintf(stderr, "megafdc: cannot open %s\n", path);
+    return false;
+  }
+
+  fseek(file, 0, SEEK_END);
+  const long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  // missing geometry: from the file size
+  if (!cylinders || !heads || !sectors)
+  {
+    uint8_t guessedSizeN;
+    uint8_t guessedGap3;
+    uint16_t guessedRate;
+    bool guessedFM;
+    if (!guessGeometry(size, cylinders, heads, sectors, guessedSizeN, guessedRate, guessedFM, guessedGap3))
+    {
+      fprintf(stderr, "megafdc: unknown geometry of %s (%ld bytes), use --geometry\n", path, size);
+      fclose(file);
+      return false;
+    }
+
+    sizeN = guessedSizeN;
+    rate = rate ? rate : guessedRate;
+    fm = fm || guessedFM;
+    gap3 = gap3 ? gap3 : guessedGap3;
+  }
+
+  m_path = path;
+  m_imd = false;
+  m_cylinders = cylinders;
+  m_heads = heads;
+  m_sectors = sectors;
+  m_sizeN = sizeN;
+  m_rate = rate ? rate : 500;
+  m_fm = fm;
+  m_tracks.assign(cylinders * 2, HostTrack());
+
+  const uint32_t sectorSize = 128 << sizeN;
+  for (uint8_t cyl = 0; cyl < cylinders; cyl++)
+  {
+    for (uint8_t head = 0; head < heads; head++)
+    {
+      HostTrack& track = m_tracks[cyl * 2 + head];
+      track.Formatted = true;
+      track.FM = m_fm;
+      track.Rate = m_rate;
+
+      for (uint8_t index = 1; index <= sectors; index++)
+      {
+        HostSector sector = {};
+        sector.Cylinder = cyl;
+        sector.Head = head;
+        sector.Sector = index;
+        sector.SizeN = sizeN;
+        sector.FaultsLeft = 0;
+        sector.Data.assign(sectorSize, 0);
+
+        // short images read as zeroes
+        if (fread(sector.Data.data(), 1, sectorSize, file) != sectorSize)
+        {
+          memset(sector.Data.data(), 0, sectorSize);
+        }
+        track.Sectors.push_back(sector);
+      }
+
+      track.Gap3 = gap3 ? gap3 : fitGap3(track, trackCapacity(m_rate, m_fm, cylinders == 77));
+      track.layout();
+    }
+  }
+
+  fclose(file);
+  return true;
+}
+
+bool HostDiskImage::loadIMD(const char* path)
+{
+  FILE* file = fopen(path, "rb");
+  if (!file)
+  {
+    fprintf(stderr, "megafdc: cannot open %s\n", path);
+    return false;
+  }
+
+  // ASCII header and comment, terminated by 0x1A
+  m_comment.clear();
+  int chr;
+  while (((chr = fgetc(file)) != EOF) && (chr != 0x1A))
+  {
+    m_comment.push_back((char)chr);
+  }
+  if ((chr == EOF) || (m_comment.compare(0, 4, "IMD ") != 0))
+  {
+    fprintf(stderr, "megafdc: %s is not an IMD image\n", path);
+    fclose(file);
+    return false;
+  }
+
+  m_path = path;
+  m_imd = true;
+  m_tracks.clear();
+  m_cylinders = m_heads = m_sectors = 0;
+
+  while (true)
+  {
+    uint8_t header[5];
+    if (fread(header, 1, 5, file) != 5)
+    {
+      break;
+    }
+
+    const uint8_t mode = header[0];
+    const uint8_t cyl = header[1];
+    const uint8_t head = header[2] & 1;
+    const uint8_t count = header[3];
+    const uint8_t sizeN = header[4];
+
+    std::vector<uint8_t> numbering(count), cylinderMap(count, cyl), headMap(count, head);
+    std::vector<uint16_t> sizes(count, 128 << (sizeN & 7));
+    bool valid = (mode <= 5) && (fread(numbering.data(), 1, count, file) == count);
+    if (valid && (header[2] & 0x80))
+    {
+      valid = (fread(cylinderMap.data(), 1, count, file) == count);
+    }
+    if (valid && (header[2] & 0x40))
+    {
+      valid = (fread(headMap.data(), 1, count, file) == count);
+    }
+    if (valid && (sizeN == 0xFF))
+    {
+      for (uint8_t index = 0; valid && (index < count); index++)
+      {
+        uint8_t word[2];
+        valid = (fread(word, 1, 2, file) == 2);
+        sizes[index] = word[0] | (word[1] << 8);
+      }
+    }
+    if (!valid)
+    {
+      fprintf(stderr, "megafdc: %s is truncated at cylinder %u head %u\n", path, cyl, head);
+      fclose(file);
+      return false;
+    }
+
+    HostTrack* track = getTrack(cyl, head, true);
+    track->Formatted = count > 0;
+    track->FM = mode < 3;
+    track->Rate = imdRates[mode % 3];
+    track->Sectors.clear();
+
+    for (uint8_t index = 0; index < count; index++)
+    {
+      HostSector sector = {};
+      sector.Cylinder = cylinderMap[index];
+      sector.Head = headMap[index];
+      sector.Sector = numbering[index];
+      sector.SizeN = 0;
+      while ((128 << sector.SizeN) < sizes[index])
+      {
+        sector.SizeN++;
+      }
+      sector.Data.assign(sizes[index], 0);
+
+      // sector data record: 0 unavailable; odd: data follows; even: compressed to one byte
+      // 3-4 deleted mark, 5-6 data error, 7-8 deleted with data error
+      const int type = fgetc(file);
+      if ((type == EOF) || (type > 8))
+      {
+        fprintf(stderr, "megafdc: %s has an invalid sector record\n", path);
+        fclose(file);
+        return false;
+      }
+
+      sector.NoData = (type == 0);
+      sector.Deleted = (type == 3) || (type == 4) || (type == 7) || (type == 8);
+      sector.DataError = (type >= 5);
+      if (type && (type & 1))
+      {
+        valid = (fread(sector.Data.data(), 1, sector.Data.size(), file) == sector.Data.size());
+      }
+      else if (type)
+      {
+        const int filler = fgetc(file);
+        valid = (filler != EOF);
+        memset(sector.Data.data(), filler, sector.Data.size());
+      }
+      if (!valid)
+      {
+        fprintf(stderr, "megafdc: %s is truncated at cylinder %u head %u\n", path, cyl, head);
+        fclose(file);
+        return false;
+      }
+
+      track->Sectors.push_back(sector);
+    }
+
+    if (cyl >= m_cylinders)
+    {
+      m_cylinders = cyl + 1;
+    }
+    if (head >= m_heads)
+    {
+      m_heads = head + 1;
+    }
+    if ((cyl == 0) && (head == 0))
+    {
+      m_sectors = count;
+      m_sizeN = count ? track->Sectors[0].SizeN : 2;
+      m_rate = track->Rate;
+      m_fm = track->FM;
+    }
+  }
+
+  // lay out the tracks now that the geometry is known
+  for (HostTrack& track : m_tracks)
+  {
+    track.Gap3 = fitGap3(track, trackCapacity(track.Rate, track.FM, m_cylinders == 77));
+    track.layout();
+  }
+
+  fclose(file);
+  return m_cylinders > 0;
+}
+
+bool HostDiskImage::save(const char* path)
+{
+  if (!path)
+  {
+    path = m_path.c_str();
+  }
+
+  FILE* file = fopen(path, "wb");
+  if (!file)
+  {
+    fprintf(stderr, "megafdc: cannot write %s\n", path);
+    return false;
+  }
+
+  const size_t length = strlen(path);
+  if ((length <= 4) || strcasecmp(&path[length - 4], ".imd"))
+  {
+    const std::vector<uint8_t> flat = flatten();
+    const bool result = fwrite(flat.data(), 1, flat.size(), file) == flat.size();
+    fclose(file);
+    return result;
+  }
+
+  // ImageDisk, keeping the original comment
+  if (m_comment.empty())
+  {
+    char stamp[32];
+    const time_t now = time(NULL);
+    strftime(stamp, sizeof(stamp), "%d/%m/%Y %H:%M:%S", localtime(&now));
+    m_comment = std::string("IMD 1.18: ") + stamp + "\r\nMegaFDC host model\r\n";
+  }
+  fwrite(m_comment.data(), 1, m_comment.size(), file);
+  fputc(0x1A, file);
+
+  for (uint8_t cyl = 0; cyl < m_cylinders; cyl++)
+  {
+    for (uint8_t head = 0; head < m_heads; head++)
+    {
+      HostTrack* track = getTrack(cyl, head);
+      if (!track || !track->Formatted || (track->Rate == 1000))
+      {
+        if (track && (track->Rate == 1000))
+        {
+          fprintf(stderr, "megafdc: 1 Mbps tracks cannot be stored in IMD, skipped\n");
+        }
+        continue;
+      }
+
+      const uint8_t count = (uint8_t)track->Sectors.size();
+      bool cylinderMap = false;
+      bool headMap = false;
+      for (const HostSector& sector : track->Sectors)
+      {
+        cylinderMap |= (sector.Cylinder != cyl);
+        headMap |= (sector.Head != head);
+      }
+
+      uint8_t mode = 0;
+      while (imdRates[mode] != track->Rate)
+      {
+        mode++;
+      }
+      const uint8_t header[5] = { (uint8_t)(mode + (track->FM ? 0 : 3)), cyl,
+                                  (uint8_t)(head | (cylinderMap ? 0x80 : 0) | (headMap ? 0x40 : 0)),
+                                  count, track->Sectors[0].SizeN };
+      fwrite(header, 1, 5, file);
+      for (const HostSector& sector : track->Sectors)
+      {
+        fputc(sector.Sector, file);
+      }
+      if (cylinderMap)
+      {
+        for (const HostSector& sector : track->Sectors)
+        {
+          fputc(sector.Cylinder, file);
+        }
+      }
+      if (headMap)
+      {
+        for (const HostSector& sector : track->Sectors)
+        {
+          fputc(sector.Head, file);
+        }
+      }
+
+      for (const HostSector& sector : track->Sectors)
+      {
+        if (sector.NoData)
+        {
+          fputc(0, file);
+          continue;
+        }
+
+        const uint8_t type = (sector.DataError ? 5 : 1) + (sector.Deleted ? 2 : 0);
+        bool uniform = true;
+        for (uint8_t value : sector.Data)
+        {
+          uniform &= (value == sector.Data[0]);
+        }
+
+        if (uniform)
+        {
+          fputc(type + 1, file);
+          fputc(sector.Data[0], file);
+        }
+        else
+        {
+          fputc(type, file);
+          fwrite(sector.Data.data(), 1, sector.Data.size(), file);
+        }
+      }
+    }
+  }
+
+  fclose(file);
+  return true;
+}
+
+HostTrack* HostDiskImage::getTrack(uint8_t cylinder, uint8_t head, bool create)
+{
+  const size_t index = cylinder * 2 + (head & 1);
+  if (index >= m_tracks.size())
+  {
+    if (!create)
+    {
+      return NULL;
+    }
+    m_tracks.resize(index + 2);
+  }
+
+  // formatting past the loaded geometry extends the image
+  if (create)
+  {
+    m_cylinders = (cylinder >= m_cylinders) ? cylinder + 1 : m_cylinders;
+    m_heads = ((head & 1) >= m_heads) ? (head & 1) + 1 : m_heads;
+  }
+
+  return &m_tracks[index];
+}
+
+bool HostDiskImage::injectFault(uint8_t cylinder, uint8_t head, uint8_t sector, int count)
+{
+  HostTrack* track = getTrack(cylinder, head);
+  if (!track)
+  {
+    return false;
+  }
+
+  for (HostSector& current : track->Sectors)
+  {
+    if (current.Sector == sector)
+    {
+      current.FaultsLeft = count;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+std::vector<uint8_t> HostDiskImage::flatten()
+{
+  std::vector<uint8_t> result;
+  const uint32_t sectorSize = 128 << m_sizeN;
+
+  for (uint8_t cyl = 0; cyl < m_cylinders; cyl++)
+  {
+    for (uint8_t head = 0; head < m_heads; head++)
+    {
+      HostTrack* track = getTrack(cyl, head);
+      for (uint8_t index = 1; index <= m_sectors; index++)
+      {
+        const HostSector* found = NULL;
+        for (size_t position = 0; track && (position < track->Sectors.size()); position++)
+        {
+          const HostSector& sector = track->Sectors[position];
+          if ((sector.Sector == index) && (sector.SizeN == m_sizeN) && !sector.NoData)
+          {
+            found = &sector;
+            break;
+          }
+        }
+
+        if (found)
+        {
+          result.insert(result.end(), found->Data.begin(), found->Data.end());
+        }
+        else
+        {
+          result.insert(result.end(), sectorSize, 0);
+        }
+      }
+    }
+  }
+
+  return result;
+}
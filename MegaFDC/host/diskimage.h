@@ -0,0 +1,88 @@
+// MegaFDC (c) 2023-2025 J. Bogin, http://boginjr.com
+// Host build: raw (.img) and ImageDisk (.imd) floppy images with a physical track layout
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct HostSector
+{
+  uint8_t Cylinder;
+  uint8_t Head;
+  uint8_t Sector;
+  uint8_t SizeN;
+  bool Deleted;       // deleted data address mark
+  bool DataError;     // data field CRC error (IMD "bad" sectors)
+  bool NoData;        // ID present, data address mark missing (IMD "unavailable")
+  int FaultsLeft;     // injected CRC errors still to be reported, -1 persistent
+  uint32_t IDOffset;  // bytes from the index pulse to the start of the ID field
+  std::vector<uint8_t> Data;
+};
+
+struct HostTrack
+{
+  bool Formatted = false;
+  bool FM = false;
+  uint16_t Rate = 500; // kbit/s as set in the controller's CCR for this track
+  uint8_t Gap3 = 0x54;
+  std::vector<HostSector> Sectors;
+
+  // place sectors evenly from the index in their current order
+  void layout();
+};
+
+// field sizes in bytes used by the layout and by the model's timing
+struct HostTrackFormat
+{
+  static uint32_t indexGap(bool fm)   { return fm ? 73 : 146; } // gap4a, sync, IAM, gap1
+  static uint32_t idField(bool fm)    { return fm ? 13 : 22; }  // sync, IDAM, CHRN, CRC
+  static uint32_t gap2(bool fm)       { return fm ? 11 : 22; }
+  static uint32_t dataSync(bool fm)   { return fm ? 7 : 16; }   // sync and DAM before data
+  static uint32_t crc()               { return 2; }
+};
+
+class HostDiskImage
+{
+public:
+  // raw images need geometry; zero values are guessed from the file size
+  bool loadRaw(const char* path, uint8_t cylinders, uint8_t heads, uint8_t sectors, uint8_t sizeN, uint16_t rate, bool fm, uint8_t gap3);
+  bool loadIMD(const char* path);
+  bool load(const char* path, uint8_t cylinders, uint8_t heads, uint8_t sectors, uint8_t sizeN, uint16_t rate, bool fm, uint8_t gap3);
+  bool save(const char* path = NULL);
+
+  // image track for the given cylinder, NULL if outside of the image
+  HostTrack* getTrack(uint8_t cylinder, uint8_t head, bool create = false);
+  bool injectFault(uint8_t cylinder, uint8_t head, uint8_t sector, int count);
+
+  // flat contents in logical order (cylinder, head, sector 1..n), as an XMODEM image transfer sees them
+  std::vector<uint8_t> flatten();
+
+  uint8_t getCylinders() { return m_cylinders; }
+  uint8_t getHeads() { return m_heads; }
+  uint8_t getSectors() { return m_sectors; }
+  uint8_t getSizeN() { return m_sizeN; }
+  uint16_t getRate() { return m_rate; }
+  bool isFM() { return m_fm; }
+  bool isIMD() { return m_imd; }
+  const char* getPath() { return m_path.c_str(); }
+
+  bool WriteProtected = false;
+  bool DoubleStep = false; // 40 track media in an 80 track drive: image track n lives under physical 2n
+
+private:
+  static bool guessGeometry(long size, uint8_t& cylinders, uint8_t& heads, uint8_t& sectors, uint8_t& sizeN, uint16_t& rate, bool& fm, uint8_t& gap3);
+  static uint8_t fitGap3(const HostTrack& track, uint32_t trackBytes);
+
+  std::vector<HostTrack> m_tracks; // cylinder * 2 + head
+  std::string m_path;
+  std::string m_comment;
+  bool m_imd = false;
+  uint8_t m_cylinders = 0;
+  uint8_t m_heads = 0;
+  uint8_t m_sectors = 0;
+  uint8_t m_sizeN = 2;
+  uint16_t m_rate = 500;
+  bool m_fm = false;
+};
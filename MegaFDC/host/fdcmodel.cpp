@@ -0,0 +1,1151 @@
+// MegaFDC (c) 2023-2025 J. Bogin, http://boginjr.com
+// Host build: behavioural uPD765 / 82077AA controller and floppy drive model
+
+#include <algorithm>
+#include <deque>
+#include <utility>
+#include <vector>
+#include "fdcmodel.h"
+#include "Arduino.h"
+
+HostFDC hostFDC;
+
+// firmware side: readRegister()/writeRegister() in fdc.h end up here in the host build
+uint8_t hostReadRegister(uint8_t reg)
+{
+  return hostFDC.readRegister(reg);
+}
+
+void hostWriteRegister(uint8_t reg, uint8_t value)
+{
+  hostFDC.writeRegister(reg, value);
+}
+
+// register addresses, same as in fdc.h
+#define REG_DOR 2
+#define REG_MSR 4
+#define REG_DTR 5
+#define REG_DIR 7
+
+uint8_t HostFDC::readRegister(uint8_t reg)
+{
+  hostDelayCycles(HOST_CYCLES_REGISTER_READ);
+  pump();
+
+  uint8_t value = 0xFF;
+  switch (reg & 7)
+  {
+  case REG_MSR:
+    m_stats.MSRReads++;
+    value = getMSR();
+    break;
+
+  case REG_DTR:
+    if (m_phase == PhaseResult)
+    {
+      value = m_result[m_resultPosition++];
+      m_resultInterrupt = false;
+      if (m_resultPosition >= m_result.size())
+      {
+        m_phase = PhaseCommand;
+        m_command.clear();
+      }
+    }
+    else if ((m_phase == PhaseExecution) && (m_exec == ExecRead) && m_request && !m_fifo.empty())
+    {
+      value = m_fifo.front();
+      m_fifo.pop_front();
+      m_stats.DataBytes++;
+      hostDelayCycles(HOST_CYCLES_DATA_BYTE);
+    }
+    break;
+
+  // DIR: disk change line of the selected drive, valid with its motor on
+  case REG_DIR:
+    {
+      HostDrive& drive = m_drives[m_dor & 3];
+      value = (drive.Motor && drive.DiskChanged) ? 0x80 : 0;
+    }
+    break;
+  }
+
+  pump();
+  updateRequest();
+  updateInterrupt();
+  return value;
+}
+
+void HostFDC::writeRegister(uint8_t reg, uint8_t value)
+{
+  hostDelayCycles(HOST_CYCLES_REGISTER_WRITE);
+  pump();
+
+  switch (reg & 7)
+  {
+  case REG_DOR:
+    {
+      const uint8_t previous = m_dor;
+      m_dor = value;
+
+      for (uint8_t index = 0; index < 4; index++)
+      {
+        HostDrive& drive = m_drives[index];
+        const bool motor = value & (0x10 << index);
+        if (motor && !drive.Motor)
+        {
+          drive.MotorOnCycles = hostGetCycles();
+        }
+        drive.Motor = motor;
+      }
+
+      // bit 2 low holds the controller in reset, releasing it completes the reset
+      if (!(value & 0x04))
+      {
+        m_resetHeld = true;
+        m_phase = PhaseCommand;
+        m_exec = ExecNone;
+        m_seekEnd = 0;
+        m_command.clear();
+        m_fifo.clear();
+      }
+      else if (m_resetHeld || !(previous & 0x04))
+      {
+        reset();
+      }
+    }
+    break;
+
+  // DSR: software reset and data rate
+  case REG_MSR:
+    m_rateCode = value & 3;
+    if (value & 0x80)
+    {
+      reset();
+    }
+    break;
+
+  case REG_DTR:
+    if (m_phase == PhaseCommand)
+    {
+      if (m_command.empty())
+      {
+        m_commandLength = 0;
+        const bool extended = (m_chip == Chip82077);
+        switch (value & 0x1F)
+        {
+        case 0x05: case 0x06: case 0x09: case 0x0C: m_commandLength = 9; break;
+        case 0x0A: m_commandLength = ((value & 0xBF) == 0x0A) ? 2 : 0; break;
+        case 0x0D: m_commandLength = ((value & 0xBF) == 0x0D) ? 6 : 0; break;
+        case 0x03: m_commandLength = (value == 0x03) ? 3 : 0; break;
+        case 0x04: m_commandLength = (value == 0x04) ? 2 : 0; break;
+        case 0x07: m_commandLength = (value == 0x07) ? 2 : 0; break;
+        case 0x08: m_commandLength = (value == 0x08) ? 1 : 0; break;
+        case 0x0F: m_commandLength = (value == 0x0F) ? 3 : 0; break;
+        case 0x0E: m_commandLength = (extended && (value == 0x0E)) ? 1 : 0; break;
+        case 0x10: m_commandLength = (extended && (value == 0x10)) ? 1 : 0; break;
+        case 0x12: m_commandLength = (extended && (value == 0x12)) ? 2 : 0; break;
+        case 0x13: m_commandLength = (extended && (value == 0x13)) ? 4 : 0; break;
+        case 0x14: m_commandLength = (extended && ((value & 0x7F) == 0x14)) ? 1 : 0; break;
+        }
+      }
+
+      m_command.push_back(value);
+
+      // invalid command: single byte result phase 0x80, no interrupt
+      if (!m_commandLength)
+      {
+        m_stats.Commands++;
+        m_stats.InvalidCommands++;
+        enterResult({ 0x80 }, false);
+      }
+      else if (m_command.size() == m_commandLength)
+      {
+        executeCommand();
+      }
+    }
+    else if ((m_phase == PhaseExecution) && ((m_exec == ExecWrite) || (m_exec == ExecFormat)) && m_request)
+    {
+      m_fifo.push_back(value);
+      m_hostBytes++;
+      m_stats.DataBytes++;
+      hostDelayCycles(HOST_CYCLES_DATA_BYTE);
+    }
+    break;
+
+  // CCR: data rate
+  case REG_DIR:
+    m_rateCode = value & 3;
+    break;
+  }
+
+  pump();
+  updateRequest();
+  updateInterrupt();
+}
+
+uint8_t HostFDC::getMSR()
+{
+  if (m_resetHeld)
+  {
+    return 0;
+  }
+
+  switch (m_phase)
+  {
+  case PhaseCommand:
+    return 0x80 | (m_command.empty() ? 0 : 0x10);
+  case PhaseExecution:
+    return 0x10 | (m_nonDMA ? 0x20 : 0) | (m_request ? 0x80 : 0) | ((m_exec == ExecRead) ? 0x40 : 0);
+  default:
+    return 0xD0;
+  }
+}
+
+void HostFDC::reset()
+{
+  m_resetHeld = false;
+  m_phase = PhaseCommand;
+  m_exec = ExecNone;
+  m_seekEnd = 0;
+  m_command.clear();
+  m_fifo.clear();
+  m_request = false;
+  m_threshold = false;
+  m_resultInterrupt = false;
+  m_stats.Resets++;
+
+  // LOCK keeps the CONFIGURE parameters across software resets
+  if (!m_lock)
+  {
+    m_impliedSeek = false;
+    m_fifoEnabled = false;
+    m_polling = true;
+    m_fifoThreshold = 0;
+    m_precompensation = 0;
+  }
+
+  // drive polling: one ready change status per drive
+  for (uint8_t drive = 0; drive < 4; drive++)
+  {
+    m_pending[drive] = false;
+    if (m_polling || (m_chip == Chip765))
+    {
+      setPending(drive, 0xC0 | drive, m_pcn[drive]);
+    }
+  }
+}
+
+void HostFDC::setPending(uint8_t drive, uint8_t st0, uint8_t pcn)
+{
+  m_pending[drive] = true;
+  m_pendingST0[drive] = st0;
+  m_pcn[drive] = pcn;
+  m_seekInterrupt = true;
+}
+
+void HostFDC::executeCommand()
+{
+  m_stats.Commands++;
+
+  const std::vector<uint8_t> command = m_command;
+  const uint8_t opcode = command[0];
+  m_command.clear();
+
+  switch (opcode & 0x1F)
+  {
+  // Specify
+  case 0x03:
+    m_srt = command[1] >> 4;
+    m_hut = command[1] & 0x0F;
+    m_hlt = command[2] >> 1;
+    m_nonDMA = command[2] & 1;
+    break;
+
+  // Sense drive status
+  case 0x04:
+    {
+      const uint8_t index = command[1] & 3;
+      HostDrive& drive = m_drives[index];
+      uint8_t st3 = (command[1] & 7) | 0x20 | 0x08;
+      st3 |= (drive.PhysicalCylinder == 0) ? 0x10 : 0;
+      st3 |= (drive.Disk && drive.Disk->WriteProtected) ? 0x40 : 0;
+      enterResult({ st3 }, false);
+    }
+    break;
+
+  // Recalibrate, Seek
+  case 0x07:
+    commandSeek(command[1] & 3, 0, true);
+    break;
+  case 0x0F:
+    m_head = (command[1] >> 2) & 1;
+    commandSeek(command[1] & 3, command[2], false);
+    break;
+
+  // Sense interrupt status: lowest drive with a pending status first
+  case 0x08:
+    m_stats.SenseCommands++;
+    m_seekInterrupt = false;
+    for (uint8_t drive = 0; drive < 4; drive++)
+    {
+      if (m_pending[drive])
+      {
+        m_pending[drive] = false;
+        enterResult({ m_pendingST0[drive], m_pcn[drive] }, false);
+        return;
+      }
+    }
+    m_stats.InvalidCommands++;
+    enterResult({ 0x80 }, false);
+    break;
+
+  case 0x0A:
+    m_command = command;
+    commandReadID();
+    break;
+
+  case 0x05:
+  case 0x06:
+  case 0x09:
+  case 0x0C:
+    m_command = command;
+    commandReadWrite();
+    break;
+
+  case 0x0D:
+    m_command = command;
+    commandFormat();
+    break;
+
+  // Dumpreg
+  case 0x0E:
+    enterResult({ m_pcn[0], m_pcn[1], m_pcn[2], m_pcn[3],
+                  (uint8_t)((m_srt << 4) | m_hut), (uint8_t)((m_hlt << 1) | (m_nonDMA ? 1 : 0)), m_eot,
+                  (uint8_t)((m_lock ? 0x80 : 0) | (m_perpendicular & 0x3F)),
+                  (uint8_t)((m_impliedSeek ? 0x40 : 0) | (m_fifoEnabled ? 0 : 0x20) | (m_polling ? 0 : 0x10) | m_fifoThreshold),
+                  m_precompensation }, false);
+    break;
+
+  // Version: enhanced controller
+  case 0x10:
+    enterResult({ 0x90 }, false);
+    break;
+
+  // Perpendicular mode: OW bit set updates the per-drive bits
+  case 0x12:
+    m_perpendicular = (command[1] & 0x80) ? (command[1] & 0x3F) : ((m_perpendicular & 0x3C) | (command[1] & 3));
+    break;
+
+  // Configure
+  case 0x13:
+    m_impliedSeek = command[2] & 0x40;
+    m_fifoEnabled = !(command[2] & 0x20);
+    m_polling = !(command[2] & 0x10);
+    m_fifoThreshold = command[2] & 0x0F;
+    m_precompensation = command[3];
+    break;
+
+  // Lock
+  case 0x14:
+    m_lock = opcode & 0x80;
+    enterResult({ (uint8_t)(m_lock ? 0x10 : 0) }, false);
+    break;
+  }
+}
+
+uint16_t HostFDC::getRate()
+{
+  static const uint16_t rates[] = { 500, 300, 250, 1000 };
+  return rates[m_rateCode & 3];
+}
+
+uint32_t HostFDC::getByteCycles(uint16_t rate, bool fm)
+{
+  return (uint32_t)(F_CPU * 8 / ((uint32_t)rate * 1000)) * (fm ? 2 : 1);
+}
+
+// SPECIFY timings are given in milliseconds at 500 kbps and scale with the data rate
+uint32_t HostFDC::getUnitCycles(uint32_t ms500)
+{
+  return ms500 * (F_CPU / 1000) * 500 / getRate();
+}
+
+uint64_t HostFDC::getRevolutionCycles(uint8_t drive)
+{
+  return (uint64_t)F_CPU * 60 / m_drives[drive & 3].RPM;
+}
+
+// first time at or after "after" when the given offset from the index passes under the head
+uint64_t HostFDC::getNextOccurrence(HostDrive& drive, uint64_t offsetCycles, uint64_t after)
+{
+  const uint64_t revolution = (uint64_t)F_CPU * 60 / drive.RPM;
+  offsetCycles %= revolution;
+
+  uint64_t base = drive.MotorOnCycles;
+  if (after > base)
+  {
+    base += ((after - base) / revolution) * revolution;
+  }
+
+  uint64_t cycles = base + offsetCycles;
+  if (cycles < after)
+  {
+    cycles += revolution;
+  }
+  return cycles;
+}
+
+bool HostFDC::isDriveReady(uint8_t drive)
+{
+  // without a disk or a spinning motor there are no index pulses: the command never ends
+  return m_drives[drive].Disk && m_drives[drive].Motor;
+}
+
+HostTrack* HostFDC::getReadableTrack(uint8_t drive, uint8_t head, bool mfm)
+{
+  HostDrive& current = m_drives[drive];
+  if (!current.Disk)
+  {
+    return nullptr;
+  }
+
+  // 40 track media in an 80 track drive: odd physical cylinders are blank
+  uint8_t cylinder = current.PhysicalCylinder;
+  if (current.Disk->DoubleStep)
+  {
+    if (cylinder & 1)
+    {
+      return nullptr;
+    }
+    cylinder /= 2;
+  }
+
+  HostTrack* track = current.Disk->getTrack(cylinder, head);
+  if (!track || !track->Formatted || (track->FM == mfm) || (track->Rate != getRate()))
+  {
+    return nullptr;
+  }
+  if ((track->Rate == 1000) && (m_chip == Chip765))
+  {
+    return nullptr;
+  }
+
+  return track;
+}
+
+void HostFDC::commandSeek(uint8_t drive, uint8_t cylinder, bool recalibrate)
+{
+  HostDrive& current = m_drives[drive];
+  const uint64_t start = hostGetCycles();
+  uint8_t st0 = 0x20 | (m_head << 2) | drive;
+
+  // step pulses are issued regardless of the drive's state
+  uint64_t end = start;
+  if (recalibrate)
+  {
+    m_stats.RecalibrateCommands++;
+    m_head = 0;
+    st0 = 0x20 | drive;
+
+    const int maximumPulses = (m_chip == Chip765) ? 77 : 80;
+    int pulses = 0;
+    while ((current.PhysicalCylinder != 0) && (pulses < maximumPulses))
+    {
+      end = stepDrive(drive, -1, end);
+      pulses++;
+    }
+
+    // track 0 not reached: equipment check
+    if (current.PhysicalCylinder != 0)
+    {
+      st0 |= 0x50;
+    }
+    m_pcn[drive] = 0;
+  }
+  else
+  {
+    m_stats.SeekCommands++;
+    const int difference = (int)cylinder - m_pcn[drive];
+    for (int pulse = 0; pulse < abs(difference); pulse++)
+    {
+      end = stepDrive(drive, (difference > 0) ? 1 : -1, end);
+    }
+    m_pcn[drive] = cylinder;
+  }
+
+  // seek end interrupt after the last step pulse
+  m_stats.SeekCycles += end - start;
+  m_phase = PhaseCommand;
+  m_seekEnd = end;
+  m_seekDrive = drive;
+  m_seekST0 = st0;
+  update();
+}
+
+uint64_t HostFDC::stepDrive(uint8_t drive, int direction, uint64_t start)
+{
+  HostDrive& current = m_drives[drive];
+  m_stats.Steps++;
+
+  // a mechanism stepped faster than it can follow misses pulses
+  if (!current.LastStepCycles || (start - current.LastStepCycles >= (uint64_t)current.MinStepUs * (F_CPU / 1000000)))
+  {
+    int cylinder = (int)current.PhysicalCylinder + direction;
+    cylinder = (cylinder < 0) ? 0 : (cylinder >= current.Cylinders) ? current.Cylinders - 1 : cylinder;
+    current.PhysicalCylinder = (uint8_t)cylinder;
+    current.LastStepCycles = start ? start : 1;
+  }
+  else
+  {
+    m_stats.MissedSteps++;
+  }
+
+  // a step with a disk inserted clears the change line
+  if (current.Disk)
+  {
+    current.DiskChanged = false;
+  }
+
+  current.SettledCycles = start + (uint64_t)current.SettleMs * (F_CPU / 1000);
+  return start + getUnitCycles(16 - m_srt);
+}
+
+uint64_t HostFDC::loadHead(uint8_t drive, uint64_t start)
+{
+  HostDrive& current = m_drives[drive];
+  if (start >= current.HeadUnloadCycles)
+  {
+    m_stats.HeadLoads++;
+    start += getUnitCycles(2 * (m_hlt ? m_hlt : 128));
+  }
+
+  return start;
+}
+
+HostFDC::Search HostFDC::searchSector(uint64_t start, bool anyID)
+{
+  Search result = {};
+  HostDrive& drive = m_drives[m_drive];
+  HostTrack* track = getReadableTrack(m_drive, m_head, m_mfm);
+
+  // the controller gives up on the second index pulse
+  const uint64_t revolution = getRevolutionCycles(m_drive);
+  const uint64_t deadline = getNextOccurrence(drive, 0, start) + revolution;
+  if (!track || track->Sectors.empty())
+  {
+    m_stats.NotFound++;
+    result.Cycles = deadline;
+    result.ST1 = 0x01; // missing address mark
+    return result;
+  }
+
+  // IDs in the order they pass under the head from now on
+  const uint32_t byteCycles = getByteCycles(track->Rate, track->FM);
+  std::vector<std::pair<uint64_t, HostSector*>> ids;
+  for (HostSector& sector : track->Sectors)
+  {
+    ids.push_back(std::make_pair(getNextOccurrence(drive, (uint64_t)sector.IDOffset * byteCycles, start), &sector));
+  }
+  std::sort(ids.begin(), ids.end(), [](const std::pair<uint64_t, HostSector*>& a, const std::pair<uint64_t, HostSector*>& b) { return a.first < b.first; });
+
+  const uint64_t ready = drive.MotorOnCycles + (uint64_t)drive.SpinUpMs * (F_CPU / 1000);
+  bool wrongCylinder = false;
+  bool badCylinder = false;
+  for (uint64_t pass = 0; ; pass++)
+  {
+    for (const auto& id : ids)
+    {
+      const uint64_t idStart = id.first + pass * revolution;
+      if (idStart > deadline)
+      {
+        m_stats.NotFound++;
+        result.Cycles = deadline;
+        result.ST1 = 0x04; // no data
+        result.ST2 = badCylinder ? 0x02 : wrongCylinder ? 0x10 : 0;
+        return result;
+      }
+
+      const uint64_t idEnd = idStart + (uint64_t)HostTrackFormat::idField(track->FM) * byteCycles;
+      HostSector* sector = id.second;
+
+      // spindle not up to speed yet, or the head still ringing after a step: the data separator does not lock
+      if ((idStart < ready) || (idStart < drive.SettledCycles))
+      {
+        m_stats.UnsettledIDs++;
+        continue;
+      }
+
+      if (!anyID)
+      {
+        if (sector->Cylinder != m_c)
+        {
+          wrongCylinder = true;
+          badCylinder |= (sector->Cylinder == 0xFF);
+          continue;
+        }
+        if ((sector->Head != m_h) || (sector->Sector != m_r) || (sector->SizeN != m_n))
+        {
+          continue;
+        }
+      }
+
+      m_stats.RotationalWaitCycles += idEnd - start;
+      result.Found = true;
+      result.Cycles = idEnd;
+      result.Sector = sector;
+      return result;
+    }
+  }
+}
+
+void HostFDC::commandReadID()
+{
+  m_stats.ReadIDCommands++;
+  m_drive = m_command[1] & 3;
+  m_head = (m_command[1] >> 2) & 1;
+  m_mfm = m_command[0] & 0x40;
+  m_command.clear();
+  m_phase = PhaseExecution;
+  m_exec = ExecHung;
+  if (!isDriveReady(m_drive))
+  {
+    return;
+  }
+
+  const uint64_t start = loadHead(m_drive, hostGetCycles());
+  const Search search = searchSector(start, true);
+  m_drives[m_drive].HeadUnloadCycles = search.Cycles + getUnitCycles(16 * (m_hut ? m_hut : 16));
+
+  // result phase once the ID has passed
+  const uint8_t st0 = (m_head << 2) | m_drive;
+  m_exec = ExecReadID;
+  m_transferDone = true;
+  m_doneCycles = search.Cycles;
+  if (search.Found)
+  {
+    const HostSector* sector = search.Sector;
+    m_doneResult = { st0, 0, 0, sector->Cylinder, sector->Head, sector->Sector, sector->SizeN };
+  }
+  else
+  {
+    m_doneResult = { (uint8_t)(st0 | 0x40), search.ST1, search.ST2, m_pcn[m_drive], m_head, 0, 0 };
+  }
+  update();
+}
+
+void HostFDC::commandReadWrite()
+{
+  const std::vector<uint8_t> command = m_command;
+  m_command.clear();
+
+  const uint8_t type = command[0] & 0x1F;
+  const bool write = (type == 0x05) || (type == 0x09);
+  m_drive = command[1] & 3;
+  m_head = (command[1] >> 2) & 1;
+  m_c = command[2];
+  m_h = command[3];
+  m_r = command[4];
+  m_n = command[5];
+  m_eot = command[6];
+  m_dtl = command[8];
+  m_mt = command[0] & 0x80;
+  m_mfm = command[0] & 0x40;
+  m_sk = command[0] & 0x20;
+  m_deletedCommand = (type == 0x09) || (type == 0x0C);
+  m_controlMark = false;
+
+  write ? m_stats.WriteCommands++ : m_stats.ReadCommands++;
+  m_phase = PhaseExecution;
+  m_exec = write ? ExecWrite : ExecRead;
+  m_execStart = hostGetCycles();
+  m_fifo.clear();
+  m_request = false;
+  m_threshold = false;
+  m_transferDone = false;
+  m_hostBytes = 0;
+  m_segmentLength = m_segmentPosition = 0;
+
+  if (!isDriveReady(m_drive))
+  {
+    m_exec = ExecHung;
+    return;
+  }
+
+  uint64_t start = m_execStart;
+
+  // implied seek to the cylinder of the command
+  if (m_impliedSeek && (m_chip == Chip82077) && (m_pcn[m_drive] != m_c))
+  {
+    const int difference = (int)m_c - m_pcn[m_drive];
+    const uint64_t seekStart = start;
+    for (int pulse = 0; pulse < abs(difference); pulse++)
+    {
+      start = stepDrive(m_drive, (difference > 0) ? 1 : -1, start);
+    }
+    m_pcn[m_drive] = m_c;
+    m_stats.SeekCycles += start - seekStart;
+  }
+
+  start = loadHead(m_drive, start);
+
+  // data length per sector, N=0 uses DTL
+  const uint32_t length = m_n ? (128 << m_n) : ((m_dtl && (m_dtl < 128)) ? m_dtl : 128);
+  uint32_t sectors = (m_eot >= m_r) ? (m_eot - m_r + 1) : 1;
+  if (m_mt && !m_head)
+  {
+    sectors += m_eot;
+  }
+  m_totalBytes = sectors * length;
+
+  if (write && m_drives[m_drive].Disk->WriteProtected)
+  {
+    finishTransfer(start, 0x40, 0x02, 0, false);
+  }
+  else
+  {
+    const Search search = searchSector(start, false);
+    if (!search.Found)
+    {
+      finishTransfer(search.Cycles, 0x40, search.ST1, search.ST2, false);
+    }
+    else
+    {
+      beginSector(search.Sector, search.Cycles);
+    }
+  }
+
+  update();
+}
+
+void HostFDC::beginSector(HostSector* sector, uint64_t idEnd)
+{
+  HostTrack* track = getReadableTrack(m_drive, m_head, m_mfm);
+  const uint32_t byteCycles = getByteCycles(track->Rate, track->FM);
+  const uint64_t dataStart = idEnd + (uint64_t)(HostTrackFormat::gap2(track->FM) + HostTrackFormat::dataSync(track->FM)) * byteCycles;
+  const uint32_t length = m_n ? (128 << m_n) : ((m_dtl && (m_dtl < 128)) ? m_dtl : 128);
+
+  m_sector = sector;
+  m_byteCycles = byteCycles;
+
+  // ID found, data address mark missing
+  if (sector->NoData)
+  {
+    finishTransfer(dataStart, 0x40, 0x01, 0x01, false);
+    return;
+  }
+
+  // data vs. deleted data mark: skip with SK, otherwise transfer and stop with control mark
+  if ((m_exec == ExecRead) && (sector->Deleted != m_deletedCommand))
+  {
+    if (m_sk)
+    {
+      m_segmentStart = dataStart;
+      m_segmentLength = m_segmentPosition = 0;
+      endOfSector(dataStart + (uint64_t)(length + HostTrackFormat::crc()) * byteCycles);
+      return;
+    }
+    m_controlMark = true;
+  }
+
+  m_segmentStart = dataStart;
+  m_segmentLength = length;
+  m_segmentPosition = 0;
+  m_segmentData = sector->Data.data();
+}
+
+void HostFDC::endOfSector(uint64_t cycles)
+{
+  HostSector* sector = m_sector;
+  m_stats.TransferCycles += (uint64_t)m_segmentLength * m_byteCycles;
+
+  if (m_exec == ExecRead)
+  {
+    if (m_segmentLength)
+    {
+      const bool crcError = sector->DataError || (sector->FaultsLeft != 0);
+      if (sector->FaultsLeft > 0)
+      {
+        sector->FaultsLeft--;
+      }
+      if (crcError)
+      {
+        m_stats.DataCRCErrors++;
+        finishTransfer(cycles, 0x40, 0x20, 0x20, false);
+        return;
+      }
+
+      m_stats.SectorsRead++;
+      if (m_controlMark)
+      {
+        finishTransfer(cycles, 0, 0, 0, false);
+        return;
+      }
+    }
+  }
+  else
+  {
+    sector->Deleted = m_deletedCommand;
+    sector->DataError = false;
+    m_stats.SectorsWritten++;
+  }
+
+  // continue with the next sector, or the other side with MT
+  if (m_r == m_eot)
+  {
+    if (!m_mt || m_head)
+    {
+      finishTransfer(cycles, 0x40, 0x80, 0, true);
+      return;
+    }
+
+    m_head = 1;
+    m_h ^= 1;
+    m_r = 1;
+  }
+  else
+  {
+    m_r++;
+  }
+
+  const Search search = searchSector(cycles, false);
+  if (!search.Found)
+  {
+    finishTransfer(search.Cycles, 0x40, search.ST1, search.ST2, false);
+  }
+  else
+  {
+    beginSector(search.Sector, search.Cycles);
+  }
+}
+
+void HostFDC::finishTransfer(uint64_t cycles, uint8_t st0, uint8_t st1, uint8_t st2, bool endOfCylinder)
+{
+  m_transferDone = true;
+  m_doneCycles = cycles;
+  m_drives[m_drive].HeadUnloadCycles = cycles + getUnitCycles(16 * (m_hut ? m_hut : 16));
+
+  // end of cylinder without TC: next cylinder, sector 1
+  uint8_t c = m_c;
+  uint8_t h = m_h;
+  uint8_t r = m_r;
+  if (endOfCylinder)
+  {
+    c++;
+    r = 1;
+    h = m_mt ? (h ^ 1) : h;
+  }
+
+  m_doneResult = { (uint8_t)(st0 | (m_head << 2) | m_drive), st1, (uint8_t)(st2 | (m_controlMark ? 0x40 : 0)), c, h, r, m_n };
+}
+
+void HostFDC::commandFormat()
+{
+  const std::vector<uint8_t> command = m_command;
+  m_command.clear();
+
+  m_stats.FormatCommands++;
+  m_drive = command[1] & 3;
+  m_head = (command[1] >> 2) & 1;
+  m_n = command[2];
+  m_formatSectors = command[3];
+  m_formatGap = command[4];
+  m_formatFiller = command[5];
+  m_mfm = command[0] & 0x40;
+  m_mt = false;
+  m_controlMark = false;
+
+  m_phase = PhaseExecution;
+  m_exec = ExecFormat;
+  m_execStart = hostGetCycles();
+  m_fifo.clear();
+  m_request = false;
+  m_threshold = false;
+  m_transferDone = false;
+  m_hostBytes = 0;
+  m_totalBytes = m_formatSectors * 4;
+  m_segmentLength = m_segmentPosition = 0;
+  m_c = m_pcn[m_drive];
+  m_h = m_head;
+  m_r = 0;
+
+  if (!isDriveReady(m_drive))
+  {
+    m_exec = ExecHung;
+    return;
+  }
+
+  HostDrive& drive = m_drives[m_drive];
+  const uint64_t start = loadHead(m_drive, m_execStart);
+  if (drive.Disk->WriteProtected)
+  {
+    finishTransfer(start, 0x40, 0x02, 0, false);
+    update();
+    return;
+  }
+
+  // the track is written from one index pulse to the next
+  const bool fm = !m_mfm;
+  m_byteCycles = getByteCycles(getRate(), fm);
+  m_formatIndex = getNextOccurrence(drive, 0, start);
+  m_formatSlot = HostTrackFormat::idField(fm) + HostTrackFormat::gap2(fm) + HostTrackFormat::dataSync(fm) +
+                 (128 << m_n) + HostTrackFormat::crc() + m_formatGap;
+  m_formatIDs.assign(m_formatSectors * 4, 0);
+
+  if (!m_formatSectors)
+  {
+    finishTransfer(m_formatIndex + getRevolutionCycles(m_drive), 0, 0, 0, false);
+  }
+  else
+  {
+    m_segmentStart = m_formatIndex + (uint64_t)HostTrackFormat::indexGap(fm) * m_byteCycles;
+    m_segmentLength = 4;
+    m_segmentData = m_formatIDs.data();
+  }
+
+  update();
+}
+
+void HostFDC::enterResult(std::vector<uint8_t> result, bool interrupt)
+{
+  m_phase = PhaseResult;
+  m_exec = ExecNone;
+  m_result = result;
+  m_resultPosition = 0;
+  m_resultInterrupt = interrupt;
+  m_request = false;
+  m_threshold = false;
+  m_fifo.clear();
+}
+
+// move media bytes between the disk and the FIFO up to the current time
+void HostFDC::pump()
+{
+  const uint64_t now = hostGetCycles();
+  if ((m_phase == PhaseExecution) && (m_exec == ExecReadID) && (now >= m_doneCycles))
+  {
+    enterResult(m_doneResult, true);
+    return;
+  }
+
+  if ((m_phase != PhaseExecution) || ((m_exec != ExecRead) && (m_exec != ExecWrite) && (m_exec != ExecFormat)))
+  {
+    return;
+  }
+
+  const size_t depth = m_fifoEnabled ? 16 : 1;
+
+  while (!m_transferDone)
+  {
+    // end of the current segment: CRC, then the next sector or format ID
+    if (m_segmentPosition == m_segmentLength)
+    {
+      const uint64_t end = m_segmentStart + (uint64_t)m_segmentLength * m_byteCycles;
+      if (m_exec == ExecFormat)
+      {
+        if (end > now)
+        {
+          break;
+        }
+
+        m_r++;
+        if (m_r < m_formatSectors)
+        {
+          m_segmentStart = m_formatIndex + (uint64_t)(HostTrackFormat::indexGap(!m_mfm) + m_r * m_formatSlot) * m_byteCycles;
+          m_segmentPosition = 0;
+          m_segmentData = &m_formatIDs[m_r * 4];
+          continue;
+        }
+
+        // whole track written: rebuild it from the supplied IDs
+        HostDrive& drive = m_drives[m_drive];
+        uint8_t cylinder = drive.PhysicalCylinder;
+        HostTrack* track = nullptr;
+        if (!drive.Disk->DoubleStep || !(cylinder & 1))
+        {
+          track = drive.Disk->getTrack(drive.Disk->DoubleStep ? cylinder / 2 : cylinder, m_head, true);
+        }
+        if (track)
+        {
+          track->Formatted = true;
+          track->FM = !m_mfm;
+          track->Rate = getRate();
+          track->Gap3 = m_formatGap;
+          track->Sectors.clear();
+          for (uint8_t index = 0; index < m_formatSectors; index++)
+          {
+            HostSector sector = {};
+            sector.Cylinder = m_formatIDs[index * 4];
+            sector.Head = m_formatIDs[index * 4 + 1];
+            sector.Sector = m_formatIDs[index * 4 + 2];
+            sector.SizeN = m_formatIDs[index * 4 + 3];
+            sector.Data.assign(128 << (sector.SizeN & 7), m_formatFiller);
+            track->Sectors.push_back(sector);
+          }
+          track->layout();
+        }
+
+        const uint8_t last = (m_formatSectors - 1) * 4;
+        m_c = m_formatIDs[last];
+        m_h = m_formatIDs[last + 1];
+        m_r = m_formatIDs[last + 2];
+        m_n = m_formatIDs[last + 3];
+        m_stats.TransferCycles += getRevolutionCycles(m_drive);
+        finishTransfer(m_formatIndex + getRevolutionCycles(m_drive), 0, 0, 0, false);
+        break;
+      }
+
+      const uint64_t crcEnd = end + (uint64_t)HostTrackFormat::crc() * m_byteCycles;
+      if (crcEnd > now)
+      {
+        break;
+      }
+      endOfSector(crcEnd);
+      continue;
+    }
+
+    const uint64_t at = m_segmentStart + (uint64_t)m_segmentPosition * m_byteCycles;
+    if (at > now)
+    {
+      break;
+    }
+
+    // host too slow: FIFO full on read or empty on write
+    if ((m_exec == ExecRead) ? (m_fifo.size() >= depth) : m_fifo.empty())
+    {
+      m_stats.Overruns++;
+      m_fifo.clear();
+      finishTransfer(at, 0x40, 0x10, 0, false);
+      break;
+    }
+
+    if (m_exec == ExecRead)
+    {
+      m_fifo.push_back(m_segmentData[m_segmentPosition]);
+    }
+    else
+    {
+      m_segmentData[m_segmentPosition] = m_fifo.front();
+      m_fifo.pop_front();
+    }
+    m_segmentPosition++;
+  }
+
+  // result phase once the media part is over and the FIFO has been emptied by the host
+  if (m_transferDone && (now >= m_doneCycles) && ((m_exec != ExecRead) || m_fifo.empty()))
+  {
+    enterResult(m_doneResult, true);
+  }
+}
+
+// service request: non-DMA RQM per byte, INT with the FIFO enabled only once the threshold (bytes of margin before
+// an overrun or underrun) is reached: reads with at least 16 - threshold bytes in, writes with as many free
+// the host can then move that many without looking at the MSR; without the FIFO both are per byte
+void HostFDC::updateRequest()
+{
+  if ((m_phase != PhaseExecution) || ((m_exec != ExecRead) && (m_exec != ExecWrite) && (m_exec != ExecFormat)))
+  {
+    m_request = false;
+    m_threshold = false;
+    return;
+  }
+
+  const size_t depth = m_fifoEnabled ? 16 : 1;
+  const size_t threshold = m_fifoEnabled ? m_fifoThreshold + 1 : 1;
+
+  if (m_exec == ExecRead)
+  {
+    const bool flush = m_transferDone || (m_segmentPosition == m_segmentLength);
+    m_request = !m_fifo.empty();
+    m_threshold = m_request && (flush || (m_fifo.size() >= depth - threshold));
+  }
+  else
+  {
+    m_request = !m_transferDone && (m_hostBytes < m_totalBytes) && (m_fifo.size() < depth);
+    m_threshold = m_request && (m_fifo.size() <= threshold);
+  }
+}
+
+void HostFDC::updateInterrupt()
+{
+  bool level = (m_dor & 0x08) && !m_resetHeld;
+  level = level && (m_seekInterrupt || ((m_phase == PhaseResult) && m_resultInterrupt) ||
+                    ((m_phase == PhaseExecution) && m_threshold));
+
+  PINE = level ? (PINE | 0x10) : (PINE & ~0x10);
+  if (level && !m_intLine)
+  {
+    m_intLine = true;
+    hostRaiseInterrupt(0);
+  }
+  else if (!level)
+  {
+    m_intLine = false;
+  }
+}
+
+// the state at the current time: media bytes, seek end, result phase, request and INT
+void HostFDC::update()
+{
+  pump();
+  if (m_seekEnd && (hostGetCycles() >= m_seekEnd))
+  {
+    m_seekEnd = 0;
+    setPending(m_seekDrive, m_seekST0, m_pcn[m_seekDrive]);
+  }
+
+  updateRequest();
+  updateInterrupt();
+}
+
+// when the controller changes its state on its own next, for the virtual clock to stop there
+uint64_t HostFDC::getNextEvent()
+{
+  uint64_t next = m_seekEnd ? m_seekEnd : UINT64_MAX;
+  if ((m_phase != PhaseExecution) || (m_exec == ExecNone) || (m_exec == ExecHung))
+  {
+    return next;
+  }
+
+  // pending request: nothing new until the host services it; an overrun is found on its next access
+  if (m_exec == ExecReadID)
+  {
+    return (std::min)(next, m_doneCycles);
+  }
+  if (m_threshold)
+  {
+    return next;
+  }
+
+  uint64_t own;
+  if (m_transferDone)
+  {
+    own = m_doneCycles;
+  }
+  else if (m_segmentPosition < m_segmentLength)
+  {
+    own = m_segmentStart + (uint64_t)m_segmentPosition * m_byteCycles;
+  }
+  else
+  {
+    own = m_segmentStart + (uint64_t)(m_segmentLength + ((m_exec == ExecFormat) ? 0 : HostTrackFormat::crc())) * m_byteCycles;
+  }
+
+  return (std::min)(next, own);
+}
+
+void HostFDC::printStats(FILE* output)
+{
+  const double cyclesPerMs = F_CPU / 1000.0;
+  const double revolution = (double)getRevolutionCycles(m_dor & 3);
+
+  fprintf(output, "commands %u: read %u, write %u, format %u, read ID %u, seek %u, recalibrate %u, sense %u, invalid %u, resets %u\n",
+          m_stats.Commands, m_stats.ReadCommands, m_stats.WriteCommands, m_stats.FormatCommands, m_stats.ReadIDCommands,
+          m_stats.SeekCommands, m_stats.RecalibrateCommands, m_stats.SenseCommands, m_stats.InvalidCommands, m_stats.Resets);
+  fprintf(output, "sectors read %u, written %u; data CRC %u, IDs missed unsettled %u, not found %u, overruns %u\n",
+          m_stats.SectorsRead, m_stats.SectorsWritten, m_stats.DataCRCErrors, m_stats.UnsettledIDs, m_stats.NotFound, m_stats.Overruns);
+  fprintf(output, "steps %u (missed %u), seeking %.1f ms, head loads %u\n",
+          m_stats.Steps, m_stats.MissedSteps, m_stats.SeekCycles / cyclesPerMs, m_stats.HeadLoads);
+  fprintf(output, "rotational wait %.1f ms (%.2f revolutions), media transfer %.1f ms\n",
+          m_stats.RotationalWaitCycles / cyclesPerMs, m_stats.RotationalWaitCycles / revolution, m_stats.TransferCycles / cyclesPerMs);
+  fprintf(output, "MSR reads %u, data bytes %u\n", m_stats.MSRReads, m_stats.DataBytes);
+}
@@ -0,0 +1,220 @@
+// MegaFDC (c) 2023-2025 J. Bogin, http://boginjr.com
+// Host build: behavioural uPD765 / 82077AA controller and floppy drive model
+//
+// The model sits behind readRegister()/writeRegister() and raises the INT line (Arduino pin 2)
+// through the host runtime. Time is the virtual 16MHz clock: bus accesses cost their AVR cycles,
+// mechanical waits (steps, settle, head load, rotation) are events the clock stops at, and data
+// bytes arrive or are consumed at the media data rate, so a slow ISR overruns the FIFO just like
+// on a real board. Commands run in the background while the firmware does something else.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <deque>
+#include <vector>
+#include "diskimage.h"
+
+// AVR cycles of the firmware's register accessors in fdc.h (port setup, strobes, DELAY_CYCLES(2))
+#define HOST_CYCLES_REGISTER_READ   14
+#define HOST_CYCLES_REGISTER_WRITE  14
+
+// additional per data byte work of the C ISRs in isr.cpp (volatile 16-bit dataPos, buffer indexing, loop)
+#define HOST_CYCLES_DATA_BYTE       18
+
+struct HostDrive
+{
+  HostDiskImage* Disk = nullptr;
+  uint8_t Inches = 3;
+  uint8_t Cylinders = 80;     // physical tracks the carriage can reach
+  uint16_t RPM = 300;
+  uint32_t SpinUpMs = 300;    // motor on until the spindle speed is stable
+  uint32_t SettleMs = 15;     // head settle after the last step pulse
+  uint32_t MinStepUs = 3000;  // fastest step rate the mechanism follows; faster pulses are missed
+
+  // state
+  uint8_t PhysicalCylinder = 0;
+  bool Motor = false;
+  bool DiskChanged = true;
+  uint64_t MotorOnCycles = 0;
+  uint64_t SettledCycles = 0;
+  uint64_t LastStepCycles = 0;
+  uint64_t HeadUnloadCycles = 0;
+};
+
+struct HostFDCStats
+{
+  uint32_t Commands;
+  uint32_t ReadCommands;
+  uint32_t WriteCommands;
+  uint32_t FormatCommands;
+  uint32_t ReadIDCommands;
+  uint32_t SeekCommands;
+  uint32_t RecalibrateCommands;
+  uint32_t SenseCommands;
+  uint32_t InvalidCommands;
+  uint32_t Resets;
+  uint32_t Steps;
+  uint32_t MissedSteps;
+  uint32_t SectorsRead;
+  uint32_t SectorsWritten;
+  uint32_t Overruns;
+  uint32_t DataCRCErrors;
+  uint32_t UnsettledIDs;      // IDs passing before spin-up or head settle
+  uint32_t NotFound;
+  uint32_t HeadLoads;
+  uint32_t MSRReads;
+  uint32_t DataBytes;
+  uint64_t RotationalWaitCycles;  // from start of a sector search until its ID passed
+  uint64_t SeekCycles;
+  uint64_t TransferCycles;        // execution phases of read/write/format
+};
+
+class HostFDC
+{
+public:
+  enum Chip
+  {
+    Chip765,    // NEC uPD765: no CONFIGURE, PERPENDICULAR, LOCK, 1 Mbps, FIFO
+    Chip82077   // 82077AA / PC8477 / DP8473 class
+  };
+
+  void setChip(Chip chip) { m_chip = chip; }
+  Chip getChip() { return m_chip; }
+  HostDrive& getDrive(uint8_t drive) { return m_drives[drive & 3]; }
+
+  uint8_t readRegister(uint8_t reg);
+  void writeRegister(uint8_t reg, uint8_t value);
+
+  // virtual clock: next own state change, and catching up with the current time
+  uint64_t getNextEvent();
+  void update();
+
+  HostFDCStats& getStats() { return m_stats; }
+  void resetStats() { m_stats = HostFDCStats(); }
+  void printStats(FILE* output);
+  uint64_t getRevolutionCycles(uint8_t drive);
+
+private:
+  enum Phase { PhaseCommand, PhaseExecution, PhaseResult };
+  enum Exec { ExecNone, ExecRead, ExecWrite, ExecFormat, ExecReadID, ExecHung };
+
+  struct Search
+  {
+    bool Found;
+    uint64_t Cycles;    // ID end when found, or when the search gave up
+    HostSector* Sector;
+    uint8_t ST1;
+    uint8_t ST2;
+  };
+
+  uint8_t getMSR();
+  uint16_t getRate();
+  uint32_t getByteCycles(uint16_t rate, bool fm);
+  uint32_t getUnitCycles(uint32_t ms500);
+  uint64_t getNextOccurrence(HostDrive& drive, uint64_t offsetCycles, uint64_t after);
+  HostTrack* getReadableTrack(uint8_t drive, uint8_t head, bool mfm);
+  bool isDriveReady(uint8_t drive);
+
+  void reset();
+  void executeCommand();
+  void commandSeek(uint8_t drive, uint8_t cylinder, bool recalibrate);
+  uint64_t stepDrive(uint8_t drive, int pulses, uint64_t start);
+  void commandReadID();
+  void commandReadWrite();
+  void commandFormat();
+  uint64_t loadHead(uint8_t drive, uint64_t start);
+  Search searchSector(uint64_t start, bool anyID);
+  void beginSector(HostSector* sector, uint64_t idEnd);
+  void endOfSector(uint64_t cycles);
+  void finishTransfer(uint64_t cycles, uint8_t st0, uint8_t st1, uint8_t st2, bool endOfCylinder);
+  void enterResult(std::vector<uint8_t> result, bool interrupt);
+  void pump();
+  void updateRequest();
+  void updateInterrupt();
+  void setPending(uint8_t drive, uint8_t st0, uint8_t pcn);
+
+  Chip m_chip = Chip82077;
+  HostDrive m_drives[4];
+  HostFDCStats m_stats = HostFDCStats();
+
+  // registers
+  uint8_t m_dor = 0;
+  uint8_t m_rateCode = 2;
+  bool m_resetHeld = true;   // DOR reads 0 after power-on
+  bool m_intLine = false;
+
+  // command/result phases
+  Phase m_phase = PhaseCommand;
+  std::vector<uint8_t> m_command;
+  size_t m_commandLength = 0;
+  std::vector<uint8_t> m_result;
+  size_t m_resultPosition = 0;
+  bool m_resultInterrupt = false;
+
+  // seek/recalibrate/reset completion status per drive, reported by Sense interrupt status
+  bool m_pending[4] = {};
+  uint8_t m_pendingST0[4] = {};
+  bool m_seekInterrupt = false;
+  uint8_t m_pcn[4] = {};
+  uint64_t m_seekEnd = 0;     // seek or recalibrate in progress until then
+  uint8_t m_seekDrive = 0;
+  uint8_t m_seekST0 = 0;
+
+  // SPECIFY, CONFIGURE, LOCK, PERPENDICULAR
+  uint8_t m_srt = 0;
+  uint8_t m_hut = 0;
+  uint8_t m_hlt = 0;
+  bool m_nonDMA = true;
+  bool m_impliedSeek = false;
+  bool m_fifoEnabled = false;
+  bool m_polling = true;
+  uint8_t m_fifoThreshold = 0;
+  uint8_t m_precompensation = 0;
+  bool m_lock = false;
+  uint8_t m_perpendicular = 0;
+
+  // execution phase
+  Exec m_exec = ExecNone;
+  uint64_t m_execStart = 0;
+  uint8_t m_drive = 0;
+  uint8_t m_head = 0;
+  uint8_t m_c = 0;
+  uint8_t m_h = 0;
+  uint8_t m_r = 0;
+  uint8_t m_n = 0;
+  uint8_t m_eot = 0;
+  uint8_t m_dtl = 0;
+  bool m_mt = false;
+  bool m_mfm = true;
+  bool m_sk = false;
+  bool m_deletedCommand = false;
+  bool m_controlMark = false;
+  HostTrack* m_track = nullptr;
+  HostSector* m_sector = nullptr;
+
+  // transfer engine: one segment (sector data or format ID) at a time
+  uint64_t m_segmentStart = 0;
+  uint32_t m_segmentLength = 0;
+  uint32_t m_segmentPosition = 0;
+  uint32_t m_byteCycles = 256;
+  uint8_t* m_segmentData = nullptr;
+  std::deque<uint8_t> m_fifo;
+  bool m_request = false;     // RQM: a byte can be moved
+  bool m_threshold = false;   // INT: the FIFO threshold is reached, a whole burst can be moved
+  bool m_transferDone = false;
+  uint64_t m_doneCycles = 0;
+  uint32_t m_hostBytes = 0;
+  uint32_t m_totalBytes = 0;
+  std::vector<uint8_t> m_doneResult;
+
+  // format
+  std::vector<uint8_t> m_formatIDs;
+  uint8_t m_formatSectors = 0;
+  uint8_t m_formatGap = 0;
+  uint8_t m_formatFiller = 0;
+  uint64_t m_formatIndex = 0;
+  uint32_t m_formatSlot = 0;
+};
+
+extern HostFDC hostFDC;
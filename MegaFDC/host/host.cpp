@@ -0,0 +1,1082 @@
+// MegaFDC (c) 2023-2025 J. Bogin, http://boginjr.com
+// Host build: virtual clock, interrupt dispatch, USART0, timers, EEPROM and command line options
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <utility>
+#include <poll.h>
+#include <unistd.h>
+#include "host.h"
+#include "fdcmodel.h"
+#include "Arduino.h"
+#include "EEPROM.h"
+
+// virtual 16MHz clock
+static uint64_t g_cycles = 0;
+
+// AVR cycles spent by the polled library calls the firmware spins on
+#define HOST_CYCLES_MILLIS         40
+#define HOST_CYCLES_SERIAL_POLL    10
+#define HOST_CYCLES_SERIAL_READ    20
+#define HOST_CYCLES_SERIAL_WRITE   12
+#define HOST_CYCLES_USART_REGISTER 2  // lds/sts of an extended I/O register
+#define HOST_CYCLES_TIMER_READ     40 // fdcMicros() around its read of the timer 3 count
+#define HOST_CYCLES_ISR_OVERHEAD   90 // vector, register save/restore, RETI
+
+// interrupt sources in AVR vector priority order: INT0..INT5, TIMER0_OVF (the core's millis() and micros()), USART0 RX and UDRE,
+// TIMER3_OVF, TIMER4_COMPA, TIMER5_COMPA
+#define HOST_EXTERNAL_INTERRUPTS   6
+#define HOST_TIMER0_INTERRUPT      6
+#define HOST_USART_RX_INTERRUPT    7
+#define HOST_USART_UDRE_INTERRUPT  8
+#define HOST_TIMER3_INTERRUPT      9
+#define HOST_TIMER4_INTERRUPT      10
+#define HOST_TIMER5_INTERRUPT      11
+#define HOST_INTERRUPTS            12
+
+static void (*g_isr[HOST_EXTERNAL_INTERRUPTS])() = {};
+static bool g_pending[HOST_INTERRUPTS] = {};
+static bool g_interruptsEnabled = true;
+static bool g_inISR = false;
+
+volatile uint8_t PORTA, DDRA, PINA;
+volatile uint8_t PORTC, DDRC, PINC;
+volatile uint8_t PORTD, DDRD, PIND;
+volatile uint8_t PINE;
+volatile uint8_t TCCR3A, TCCR3B, TIMSK3;
+volatile uint8_t TCCR4A, TCCR4B, TIMSK4;
+volatile uint16_t TCNT4, OCR4A;
+volatile uint8_t TCCR5A, TCCR5B, TIMSK5;
+volatile uint16_t TCNT5, OCR5A;
+
+HostStatusRegister SREG;
+HostTimer3Register TCNT3(0x94);
+HostTimer3Register TIFR3(0x38);
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+HostOptions g_hostOptions;
+
+static void usartUpdate();
+static uint64_t usartNextEvent();
+static bool usartInterrupt(uint8_t source);
+
+// timers 4 and 5 in CTC mode with the compare match A interrupt; compare matches since the last look
+struct HostTimer
+{
+  volatile uint8_t& TCCRB;
+  volatile uint8_t& TIMSK;
+  volatile uint16_t& OCRA;
+  uint8_t Interrupt;
+  uint64_t Period;
+  uint64_t Tick;
+
+  // 0 if not running
+  uint64_t getPeriod()
+  {
+    static const uint32_t prescalers[] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+    const uint32_t prescaler = prescalers[TCCRB & 7];
+    if (!prescaler || !(TIMSK & 2))
+    {
+      return 0;
+    }
+
+    return (uint64_t)(OCRA + 1) * prescaler;
+  }
+
+  uint64_t getNextEvent()
+  {
+    const uint64_t period = getPeriod();
+    if (!period)
+    {
+      return UINT64_MAX;
+    }
+
+    // (re)started: counting from now
+    if (period != Period)
+    {
+      Period = period;
+      Tick = g_cycles / period;
+    }
+    return (Tick + 1) * period;
+  }
+
+  // with interrupts blocked the flag stays set and further matches merge into it
+  void update()
+  {
+    if (getNextEvent() <= g_cycles)
+    {
+      Tick = g_cycles / Period;
+      g_pending[Interrupt] = true;
+    }
+  }
+};
+
+static HostTimer g_timers[] =
+{
+  { TCCR4B, TIMSK4, OCR4A, HOST_TIMER4_INTERRUPT, 0, 0 },
+  { TCCR5B, TIMSK5, OCR5A, HOST_TIMER5_INTERRUPT, 0, 0 }
+};
+
+// timers 0 and 3 free running with the overflow interrupt: the count follows the virtual clock, and with interrupts
+// blocked the overflow flag stays set and further overflows are lost, as on the AVR
+struct HostOverflowTimer
+{
+  uint32_t Prescaler;  // 0 if stopped
+  uint64_t Start;      // cycle when the count was 0, counting 2^Bits
+  uint8_t Bits;
+  uint64_t Overflows;  // since Start, flagged
+  bool Flag;
+  uint16_t Held;       // the count while stopped
+
+  uint64_t getPeriod()
+  {
+    return (uint64_t)Prescaler << Bits;
+  }
+
+  uint16_t getCount()
+  {
+    return Prescaler ? (uint16_t)(((g_cycles - Start) / Prescaler) & ((1UL << Bits) - 1)) : Held;
+  }
+
+  // counting from value from now on with a new prescaler (0: stopped, the count kept)
+  void restart(uint32_t prescaler, uint16_t value)
+  {
+    Prescaler = prescaler;
+    Start = g_cycles - ((uint64_t)value * prescaler);
+    Overflows = 0;
+    Held = value;
+  }
+
+  uint64_t getNextEvent()
+  {
+    return Prescaler ? Start + ((Overflows + 1) * getPeriod()) : UINT64_MAX;
+  }
+
+  void update()
+  {
+    if (Prescaler && (g_cycles >= getNextEvent()))
+    {
+      Overflows = (g_cycles - Start) / getPeriod();
+      Flag = true;
+    }
+  }
+};
+
+static HostOverflowTimer g_timer0 = { 64, 0, 8, 0, false, 0 };
+static HostOverflowTimer g_timer3 = { 0, 0, 16, 0, false, 0 };
+static uint64_t g_timer0Counted = 0; // timer0_overflow_count of the core
+static uint8_t g_timer3Control = 0;  // TCCR3B as last seen
+
+static void timer3Update()
+{
+  if ((TCCR3B & 7) != (g_timer3Control & 7))
+  {
+    static const uint32_t prescalers[] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+    g_timer3.restart(prescalers[TCCR3B & 7], g_timer3.getCount());
+  }
+  g_timer3Control = TCCR3B;
+  g_timer3.update();
+}
+
+HostTimer3Register::operator uint16_t() const
+{
+  // the firmware spins on the count, time has to pass
+  if (m_address != 0x38)
+  {
+    hostDelayCycles(HOST_CYCLES_TIMER_READ);
+  }
+  timer3Update();
+  return (m_address == 0x38) ? (g_timer3.Flag ? (1 << TOV3) : 0) : g_timer3.getCount();
+}
+
+// TIFR3: a 1 clears the flag
+HostTimer3Register& HostTimer3Register::operator=(uint16_t value)
+{
+  timer3Update();
+  if (m_address == 0x38)
+  {
+    g_timer3.Flag = g_timer3.Flag && !(value & (1 << TOV3));
+  }
+  else
+  {
+    g_timer3.restart(g_timer3.Prescaler, value);
+  }
+  return *this;
+}
+
+// highest priority source ready to interrupt, -1 if none
+static int getInterrupt()
+{
+  for (uint8_t source = 0; source < HOST_INTERRUPTS; source++)
+  {
+    if ((source == HOST_USART_RX_INTERRUPT) || (source == HOST_USART_UDRE_INTERRUPT))
+    {
+      if (usartInterrupt(source))
+      {
+        return source;
+      }
+    }
+    else if (source == HOST_TIMER0_INTERRUPT)
+    {
+      if (g_timer0.Flag)
+      {
+        return source;
+      }
+    }
+    else if (source == HOST_TIMER3_INTERRUPT)
+    {
+      if (g_timer3.Flag && (TIMSK3 & (1 << TOIE3)))
+      {
+        return source;
+      }
+    }
+    else if (g_pending[source])
+    {
+      return source;
+    }
+  }
+  return -1;
+}
+
+static void dispatchInterrupts()
+{
+  while (g_interruptsEnabled && !g_inISR)
+  {
+    const int source = getInterrupt();
+    if (source < 0)
+    {
+      break;
+    }
+
+    // like on the AVR, the I flag is cleared for the duration of the ISR and set again by RETI
+    g_pending[source] = false;
+    g_inISR = true;
+    g_interruptsEnabled = false;
+    g_cycles += HOST_CYCLES_ISR_OVERHEAD;
+    switch (source)
+    {
+    case HOST_TIMER0_INTERRUPT:
+      g_timer0.Flag = false;
+      g_timer0Counted++;
+      break;
+    case HOST_USART_RX_INTERRUPT:
+      Serial.rxCompleteInterrupt();
+      break;
+    case HOST_TIMER3_INTERRUPT:
+      g_timer3.Flag = false;
+      TIMER3_OVF_vect();
+      break;
+    case HOST_USART_UDRE_INTERRUPT:
+      Serial.udrEmptyInterrupt();
+      break;
+    case HOST_TIMER4_INTERRUPT:
+      TIMER4_COMPA_vect();
+      break;
+    case HOST_TIMER5_INTERRUPT:
+      TIMER5_COMPA_vect();
+      break;
+    default:
+      if (g_isr[source])
+      {
+        g_isr[source]();
+      }
+    }
+    g_inISR = false;
+    g_interruptsEnabled = true;
+  }
+}
+
+// whatever is due at the current time: line, controller, timers, then the interrupts that follow
+static void processEvents()
+{
+  usartUpdate();
+  hostFDC.update();
+  for (HostTimer& timer : g_timers)
+  {
+    timer.update();
+  }
+  g_timer0.update();
+  timer3Update();
+  dispatchInterrupts();
+}
+
+static uint64_t getNextEvent()
+{
+  uint64_t next = (std::min)(usartNextEvent(), hostFDC.getNextEvent());
+  for (HostTimer& timer : g_timers)
+  {
+    next = (std::min)(next, timer.getNextEvent());
+  }
+  next = (std::min)(next, g_timer0.getNextEvent());
+  next = (std::min)(next, g_timer3.getNextEvent());
+  return next;
+}
+
+uint64_t hostGetCycles()
+{
+  return g_cycles;
+}
+
+// let time pass, stopping at every event on the way (which may run ISRs and advance the clock further)
+void hostDelayCycles(uint32_t cycles)
+{
+  const uint64_t target = g_cycles + cycles;
+  while (true)
+  {
+    const uint64_t next = getNextEvent();
+    if (next > target)
+    {
+      break;
+    }
+
+    // an event left behind is retried one cycle later instead of spinning at the same time
+    g_cycles = (next > g_cycles) ? next : g_cycles + 1;
+    processEvents();
+  }
+
+  if (g_cycles < target)
+  {
+    g_cycles = target;
+  }
+}
+
+void hostResetBoard()
+{
+  Serial.flush();
+  fflush(stdout);
+  if (g_hostOptions.Statistics)
+  {
+    hostFDC.printStats(stderr);
+  }
+  if (g_hostOptions.SaveImage && g_hostOptions.Image)
+  {
+    g_hostOptions.Image->save();
+  }
+  fprintf(stderr, "board reset at %.3f s, exiting\n", g_cycles / (double)F_CPU);
+  exit(0);
+}
+
+// the core counts Timer0 overflows (1.024 ms) in its ISR: with interrupts off for longer, time goes missing as on the AVR
+unsigned long millis()
+{
+  hostDelayCycles(HOST_CYCLES_MILLIS);
+  return (unsigned long)((g_timer0Counted * 1024) / 1000);
+}
+
+unsigned long micros()
+{
+  hostDelayCycles(HOST_CYCLES_MILLIS);
+  
+  // one overflow still flagged is counted in
+  const uint8_t count = (uint8_t)g_timer0.getCount();
+  uint64_t overflows = g_timer0Counted;
+  if (g_timer0.Flag && (count < 255))
+  {
+    overflows++;
+  }
+  return (unsigned long)(((overflows << 8) + count) * (64 / (F_CPU / 1000000)));
+}
+
+void delay(unsigned long ms)
+{
+  while (ms--)
+  {
+    hostDelayCycles(F_CPU / 1000);
+  }
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  hostDelayCycles(us * (F_CPU / 1000000));
+}
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+
+// switches and jumpers open
+int digitalRead(uint8_t)
+{
+  return HIGH;
+}
+
+void attachInterrupt(int8_t interrupt, void (*isr)(), int)
+{
+  if ((interrupt >= 0) && (interrupt < HOST_EXTERNAL_INTERRUPTS))
+  {
+    g_isr[interrupt] = isr;
+    g_pending[interrupt] = false;
+  }
+}
+
+void detachInterrupt(int8_t interrupt)
+{
+  if ((interrupt >= 0) && (interrupt < HOST_EXTERNAL_INTERRUPTS))
+  {
+    g_isr[interrupt] = NULL;
+    g_pending[interrupt] = false;
+  }
+}
+
+// rising edge: the flag latches even with interrupts disabled or while another ISR runs
+void hostRaiseInterrupt(int8_t interrupt)
+{
+  if ((interrupt >= 0) && (interrupt < HOST_EXTERNAL_INTERRUPTS) && g_isr[interrupt])
+  {
+    g_pending[interrupt] = true;
+    dispatchInterrupts();
+  }
+}
+
+HostStatusRegister::operator uint8_t() const
+{
+  return g_interruptsEnabled ? 0x80 : 0;
+}
+
+HostStatusRegister& HostStatusRegister::operator=(uint8_t value)
+{
+  if (value & 0x80)
+  {
+    sei();
+  }
+  else
+  {
+    cli();
+  }
+  return *this;
+}
+
+void cli()
+{
+  g_interruptsEnabled = false;
+}
+
+void sei()
+{
+  g_interruptsEnabled = true;
+  dispatchInterrupts();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// USART0: transmit holding and shift registers, 2-level receive FIFO, and what is on the other end of the line
+
+static struct
+{
+  uint8_t Control = 0;        // UCSR0B
+  bool DoubleSpeed = false;   // U2X0
+  uint32_t ByteCycles = F_CPU / 11520;
+  HostSerialPeer* Peer = nullptr;
+
+  bool Shifting = false;
+  uint8_t ShiftData = 0;
+  uint64_t ShiftEnd = 0;
+  bool Holding = false;
+  uint8_t HoldingData = 0;
+
+  uint8_t ReceiveFIFO[2];
+  uint8_t ReceiveCount = 0;
+  bool DataOverrun = false;
+  std::deque<std::pair<uint64_t, uint8_t>> Arrivals;
+} g_usart;
+
+HostUSARTRegister UDR0(0xC6);
+HostUSARTRegister UCSR0A(0xC0);
+HostUSARTRegister UCSR0B(0xC1);
+volatile uint16_t UBRR0;
+
+// bytes shifted out and bytes come in up to now, in the order they happened
+static void usartUpdate()
+{
+  while (true)
+  {
+    const uint64_t transmitted = g_usart.Shifting ? g_usart.ShiftEnd : UINT64_MAX;
+    const uint64_t received = g_usart.Arrivals.empty() ? UINT64_MAX : g_usart.Arrivals.front().first;
+    if ((transmitted > g_cycles) && (received > g_cycles))
+    {
+      break;
+    }
+
+    if (transmitted <= received)
+    {
+      g_usart.Shifting = g_usart.Holding;
+      g_usart.Holding = false;
+      const uint8_t data = g_usart.ShiftData;
+      g_usart.ShiftData = g_usart.HoldingData;
+      g_usart.ShiftEnd = transmitted + g_usart.ByteCycles;
+      if (g_usart.Peer)
+      {
+        g_usart.Peer->onByte(data, transmitted);
+      }
+      else
+      {
+        putchar(data);
+      }
+    }
+    else
+    {
+      // a third byte completed while the FIFO is full is lost
+      if (g_usart.ReceiveCount < 2)
+      {
+        g_usart.ReceiveFIFO[g_usart.ReceiveCount++] = g_usart.Arrivals.front().second;
+      }
+      else
+      {
+        g_usart.DataOverrun = true;
+        g_hostOptions.SerialOverruns++;
+      }
+      g_usart.Arrivals.pop_front();
+    }
+  }
+}
+
+// the clock stops where an enabled interrupt comes up, and where a byte is out so the other end can answer in time
+static uint64_t usartNextEvent()
+{
+  uint64_t next = UINT64_MAX;
+  if ((g_usart.Control & (1 << RXCIE0)) && !g_usart.Arrivals.empty())
+  {
+    next = g_usart.Arrivals.front().first;
+  }
+  if (g_usart.Shifting)
+  {
+    next = (std::min)(next, g_usart.ShiftEnd);
+  }
+  return next;
+}
+
+static bool usartInterrupt(uint8_t source)
+{
+  usartUpdate();
+  if (source == HOST_USART_RX_INTERRUPT)
+  {
+    return (g_usart.Control & (1 << RXCIE0)) && g_usart.ReceiveCount;
+  }
+  return (g_usart.Control & (1 << UDRIE0)) && !g_usart.Holding;
+}
+
+static uint8_t usartRead(uint8_t address)
+{
+  usartUpdate();
+  switch (address)
+  {
+  case 0xC0:
+    return (g_usart.ReceiveCount ? (1 << RXC0) : 0) | ((!g_usart.Shifting && !g_usart.Holding) ? (1 << TXC0) : 0) |
+           (!g_usart.Holding ? (1 << UDRE0) : 0) | (g_usart.DataOverrun ? (1 << DOR0) : 0) | (g_usart.DoubleSpeed ? (1 << U2X0) : 0);
+  case 0xC1:
+    return g_usart.Control;
+  default:
+    {
+      const uint8_t data = g_usart.ReceiveFIFO[0];
+      if (g_usart.ReceiveCount)
+      {
+        g_usart.ReceiveFIFO[0] = g_usart.ReceiveFIFO[1];
+        g_usart.ReceiveCount--;
+        g_usart.DataOverrun = false;
+      }
+      return data;
+    }
+  }
+}
+
+static void usartWrite(uint8_t address, uint8_t value)
+{
+  usartUpdate();
+  switch (address)
+  {
+  case 0xC0:
+    g_usart.DoubleSpeed = value & (1 << U2X0);
+    break;
+  case 0xC1:
+    g_usart.Control = value;
+    break;
+  default:
+    // into the shift register right away if idle, a write with UDRE0 clear is lost
+    if (!g_usart.Shifting)
+    {
+      g_usart.Shifting = true;
+      g_usart.ShiftData = value;
+      g_usart.ShiftEnd = g_cycles + g_usart.ByteCycles;
+    }
+    else if (!g_usart.Holding)
+    {
+      g_usart.Holding = true;
+      g_usart.HoldingData = value;
+    }
+    break;
+  }
+}
+
+HostUSARTRegister::operator uint8_t() const
+{
+  hostDelayCycles(HOST_CYCLES_USART_REGISTER);
+  return usartRead(m_address);
+}
+
+HostUSARTRegister& HostUSARTRegister::operator=(uint8_t value)
+{
+  hostDelayCycles(HOST_CYCLES_USART_REGISTER);
+  usartWrite(m_address, value);
+  dispatchInterrupts();
+  return *this;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Serial: the Arduino core's interrupt driven HardwareSerial on USART0
+
+void HardwareSerial::begin(unsigned long baud)
+{
+  if (g_hostOptions.Baud)
+  {
+    baud = g_hostOptions.Baud;
+  }
+
+  // same divisor as the core picks: double speed mode except for 57600 at 16MHz
+  const bool doubleSpeed = (baud != 57600);
+  UBRR0 = doubleSpeed ? ((F_CPU / 4 / baud - 1) / 2) : ((F_CPU / 8 / baud - 1) / 2);
+  usartWrite(0xC0, doubleSpeed ? (1 << U2X0) : 0);
+  usartWrite(0xC1, (1 << RXEN0) | (1 << TXEN0) | (1 << RXCIE0));
+
+  // 8N1: 10 bit times per byte
+  g_usart.ByteCycles = 10 * (doubleSpeed ? 8 : 16) * (UBRR0 + 1);
+}
+
+void HardwareSerial::setPeer(HostSerialPeer* peer)
+{
+  usartUpdate();
+  g_usart.Peer = peer;
+}
+
+uint32_t HardwareSerial::getByteCycles()
+{
+  return g_usart.ByteCycles;
+}
+
+// bytes from the other end, first one completely received at arrivalCycles
+void HardwareSerial::receive(const uint8_t* data, size_t size, uint64_t arrivalCycles)
+{
+  uint64_t arrival = arrivalCycles;
+  if (!g_usart.Arrivals.empty() && (arrival < g_usart.Arrivals.back().first + g_usart.ByteCycles))
+  {
+    arrival = g_usart.Arrivals.back().first + g_usart.ByteCycles;
+  }
+
+  for (size_t index = 0; index < size; index++)
+  {
+    g_usart.Arrivals.push_back(std::make_pair(arrival, data[index]));
+    arrival += g_usart.ByteCycles;
+  }
+}
+
+// USART0_RX_vect: into the 64 byte ring, dropped when full
+void HardwareSerial::rxCompleteInterrupt()
+{
+  const uint8_t data = usartRead(0xC6);
+  const uint8_t next = (m_rxHead + 1) % SERIAL_BUFFER_SIZE;
+  if (next != m_rxTail)
+  {
+    m_rxBuffer[m_rxHead] = data;
+    m_rxHead = next;
+  }
+  else
+  {
+    g_hostOptions.SerialOverruns++;
+  }
+}
+
+// USART0_UDRE_vect: next byte of the transmit ring, interrupt off once it is empty
+void HardwareSerial::udrEmptyInterrupt()
+{
+  usartWrite(0xC6, m_txBuffer[m_txTail]);
+  m_txTail = (m_txTail + 1) % SERIAL_BUFFER_SIZE;
+  if (m_txHead == m_txTail)
+  {
+    usartWrite(0xC1, g_usart.Control & ~(1 << UDRIE0));
+  }
+}
+
+// console: stdin typed in one byte at a time whenever the receive ring has room
+bool HardwareSerial::fetchConsole()
+{
+  static uint32_t idlePolls = 0;
+  if (g_usart.Peer || !g_usart.Arrivals.empty() || ((m_rxHead + 1) % SERIAL_BUFFER_SIZE == m_rxTail))
+  {
+    return false;
+  }
+
+  fflush(stdout);
+  struct pollfd descriptor = { STDIN_FILENO, POLLIN, 0 };
+
+  // do not burn the host CPU while the firmware waits for a key
+  const int timeout = (idlePolls > 100000) ? 10 : 0;
+  if (poll(&descriptor, 1, timeout) <= 0)
+  {
+    idlePolls++;
+    return false;
+  }
+  idlePolls = 0;
+
+  uint8_t data;
+  if (::read(STDIN_FILENO, &data, 1) != 1)
+  {
+    // end of input: same as pulling the plug
+    Serial.flush();
+    fflush(stdout);
+    if (g_hostOptions.Statistics)
+    {
+      hostFDC.printStats(stderr);
+    }
+    if (g_hostOptions.SaveImage && g_hostOptions.Image)
+    {
+      g_hostOptions.Image->save();
+    }
+    exit(0);
+  }
+
+  data = (data == '\n') ? '\r' : data;
+  receive(&data, 1, g_cycles);
+  processEvents();
+  return true;
+}
+
+int HardwareSerial::available()
+{
+  hostDelayCycles(HOST_CYCLES_SERIAL_POLL);
+  fetchConsole();
+  return (SERIAL_BUFFER_SIZE + m_rxHead - m_rxTail) % SERIAL_BUFFER_SIZE;
+}
+
+int HardwareSerial::peek()
+{
+  fetchConsole();
+  return (m_rxHead == m_rxTail) ? -1 : m_rxBuffer[m_rxTail];
+}
+
+int HardwareSerial::read()
+{
+  hostDelayCycles(HOST_CYCLES_SERIAL_READ);
+  fetchConsole();
+  if (m_rxHead == m_rxTail)
+  {
+    return -1;
+  }
+
+  const uint8_t data = m_rxBuffer[m_rxTail];
+  m_rxTail = (m_rxTail + 1) % SERIAL_BUFFER_SIZE;
+  return data;
+}
+
+size_t HardwareSerial::write(uint8_t data)
+{
+  hostDelayCycles(HOST_CYCLES_SERIAL_WRITE);
+
+  // ring empty and the data register free: straight to the USART
+  usartUpdate();
+  if ((m_txHead == m_txTail) && !g_usart.Holding)
+  {
+    usartWrite(0xC6, data);
+    return 1;
+  }
+
+  // ring full: wait for the UDRE interrupt, or run its handler here if interrupts are off
+  const uint8_t next = (m_txHead + 1) % SERIAL_BUFFER_SIZE;
+  while (next == m_txTail)
+  {
+    hostDelayCycles(HOST_CYCLES_SERIAL_POLL);
+    if (!g_interruptsEnabled || g_inISR)
+    {
+      usartUpdate();
+      if (!g_usart.Holding)
+      {
+        udrEmptyInterrupt();
+      }
+    }
+  }
+
+  m_txBuffer[m_txHead] = data;
+  m_txHead = next;
+  usartWrite(0xC1, g_usart.Control | (1 << UDRIE0));
+  dispatchInterrupts();
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* data, size_t size)
+{
+  for (size_t index = 0; index < size; index++)
+  {
+    write(data[index]);
+  }
+  return size;
+}
+
+size_t HardwareSerial::print(const char* str)
+{
+  return write((const uint8_t*)str, strlen(str));
+}
+
+// until the ring is empty and the last stop bit is out
+void HardwareSerial::flush()
+{
+  while (true)
+  {
+    usartUpdate();
+    if ((m_txHead == m_txTail) && !g_usart.Shifting)
+    {
+      break;
+    }
+
+    if (m_txHead == m_txTail)
+    {
+      hostDelayCycles((uint32_t)(g_usart.ShiftEnd + (g_usart.Holding ? g_usart.ByteCycles : 0) - g_cycles));
+    }
+    else
+    {
+      hostDelayCycles(HOST_CYCLES_SERIAL_POLL);
+      if ((!g_interruptsEnabled || g_inISR) && !g_usart.Holding)
+      {
+        udrEmptyInterrupt();
+      }
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// EEPROM, optionally backed by a file
+
+uint8_t EEPROMClass::read(int address)
+{
+  load();
+  return m_data[address % EEPROM_SIZE];
+}
+
+void EEPROMClass::write(int address, uint8_t value)
+{
+  load();
+  m_data[address % EEPROM_SIZE] = value;
+  if (g_hostOptions.EEPROMPath)
+  {
+    FILE* file = fopen(g_hostOptions.EEPROMPath, "wb");
+    if (file)
+    {
+      fwrite(m_data, 1, EEPROM_SIZE, file);
+      fclose(file);
+    }
+  }
+
+  // 3.3ms per byte programming time
+  hostDelayCycles(F_CPU / 300);
+}
+
+void EEPROMClass::update(int address, uint8_t value)
+{
+  if (read(address) != value)
+  {
+    write(address, value);
+  }
+}
+
+void EEPROMClass::load()
+{
+  if (m_loaded)
+  {
+    return;
+  }
+
+  m_loaded = true;
+  memset(m_data, 0xFF, EEPROM_SIZE);
+  if (g_hostOptions.EEPROMPath)
+  {
+    FILE* file = fopen(g_hostOptions.EEPROMPath, "rb");
+    if (file)
+    {
+      fread(m_data, 1, EEPROM_SIZE, file);
+      fclose(file);
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// command line options shared by the firmware runner and the benchmark
+
+static bool parseGeometry(const char* value, HostOptions& options)
+{
+  unsigned cylinders, heads, sectors, sizeN;
+  if (sscanf(value, "%u,%u,%u,%u", &cylinders, &heads, &sectors, &sizeN) != 4)
+  {
+    return false;
+  }
+
+  options.Cylinders = cylinders;
+  options.Heads = heads;
+  options.Sectors = sectors;
+  options.SizeN = sizeN;
+  return true;
+}
+
+static bool parseFault(const char* value, HostOptions& options)
+{
+  unsigned cylinder, head, sector;
+  int count = -1;
+  if (sscanf(value, "%u/%u/%u:%d", &cylinder, &head, &sector, &count) < 3)
+  {
+    return false;
+  }
+
+  HostOptions::Fault fault = { (uint8_t)cylinder, (uint8_t)head, (uint8_t)sector, count };
+  options.Faults.push_back(fault);
+  return true;
+}
+
+void hostUsage(const char* program, const char* extra)
+{
+  fprintf(stderr,
+          "usage: %s --image <file.img|file.imd> [options]%s\n"
+          "  --geometry C,H,S,N   raw image geometry (guessed from the file size otherwise)\n"
+          "  --rate 250|300|500|1000, --fm   raw image data rate and encoding\n"
+          "  --double-step        40 track media in an 80 track drive\n"
+          "  --write-protect      disk is write protected\n"
+          "  --drive 3|5|8        drive mechanics (guessed from the geometry otherwise)\n"
+          "  --rpm <n>            spindle speed override\n"
+          "  --spin-up <ms>, --settle <ms>   drive motor spin-up and head settle overrides\n"
+          "  --min-step <ms>      fastest step rate the drive follows\n"
+          "  --fdc 765|82077      controller model (default 82077)\n"
+          "  --fault C/H/R[:n]    data CRC error on a sector, n times or persistent\n"
+          "  --eeprom <file>      EEPROM contents backing file\n"
+          "  --baud <n>           serial rate override\n"
+          "  --save               write the image back on exit\n"
+          "  --stats              print controller statistics on exit\n",
+          program, extra ? extra : "");
+}
+
+// returns the number of arguments consumed, 0 if not a common option, -1 on error
+int hostParseOption(int argc, char** argv, int index, HostOptions& options)
+{
+  const std::string option = argv[index];
+  const char* value = (index + 1 < argc) ? argv[index + 1] : NULL;
+
+  if (option == "--fm") { options.FM = true; return 1; }
+  if (option == "--double-step") { options.DoubleStep = true; return 1; }
+  if (option == "--write-protect") { options.WriteProtect = true; return 1; }
+  if (option == "--save") { options.SaveImage = true; return 1; }
+  if (option == "--stats") { options.Statistics = true; return 1; }
+
+  if ((option != "--image") && (option != "--geometry") && (option != "--rate") && (option != "--drive") &&
+      (option != "--rpm") && (option != "--spin-up") && (option != "--settle") && (option != "--min-step") && (option != "--fdc") && (option != "--fault") && (option != "--eeprom") && (option != "--baud"))
+  {
+    return 0;
+  }
+  if (!value)
+  {
+    return -1;
+  }
+
+  if (option == "--image") options.ImagePath = value;
+  else if (option == "--geometry") { if (!parseGeometry(value, options)) return -1; }
+  else if (option == "--rate") options.Rate = (uint16_t)atoi(value);
+  else if (option == "--drive") options.DriveInches = (uint8_t)atoi(value);
+  else if (option == "--rpm") options.RPM = (uint16_t)atoi(value);
+  else if (option == "--spin-up") options.SpinUpMs = (uint16_t)atoi(value);
+  else if (option == "--settle") options.SettleMs = (uint16_t)atoi(value);
+  else if (option == "--min-step") options.MinStepUs = (uint32_t)(atof(value) * 1000);
+  else if (option == "--fdc") options.Chip765 = (atoi(value) == 765);
+  else if (option == "--fault") { if (!parseFault(value, options)) return -1; }
+  else if (option == "--eeprom") options.EEPROMPath = value;
+  else if (option == "--baud") options.Baud = (uint32_t)atol(value);
+
+  return 2;
+}
+
+// load the image and put it into drive 0 with mechanics matching the media
+bool hostSetup(HostOptions& options)
+{
+  hostFDC.setChip(options.Chip765 ? HostFDC::Chip765 : HostFDC::Chip82077);
+  if (!options.ImagePath)
+  {
+    return true;
+  }
+
+  static HostDiskImage image;
+  if (!image.load(options.ImagePath, options.Cylinders, options.Heads, options.Sectors, options.SizeN, options.Rate, options.FM, 0))
+  {
+    fprintf(stderr, "cannot load image %s\n", options.ImagePath);
+    return false;
+  }
+
+  image.WriteProtected = options.WriteProtect;
+  image.DoubleStep = options.DoubleStep;
+  for (const HostOptions::Fault& fault : options.Faults)
+  {
+    if (!image.injectFault(fault.Cylinder, fault.Head, fault.Sector, fault.Count))
+    {
+      fprintf(stderr, "no sector %u/%u/%u in image\n", fault.Cylinder, fault.Head, fault.Sector);
+      return false;
+    }
+  }
+  options.Image = &image;
+
+  // guess the drive: 77 cylinders or FM 128 byte sectors are 8", 300 kbps and 40 track media 5.25"
+  uint8_t inches = options.DriveInches;
+  if (!inches)
+  {
+    if ((image.getCylinders() <= 77) && (image.getCylinders() > 42))
+    {
+      inches = 8;
+    }
+    else if ((image.getCylinders() <= 42) || (image.getRate() == 300) ||
+             ((image.getRate() == 500) && (image.getSectors() == 15)))
+    {
+      inches = 5;
+    }
+    else
+    {
+      inches = 3;
+    }
+  }
+
+  HostDrive& drive = hostFDC.getDrive(0);
+  drive.Disk = &image;
+  drive.Inches = inches;
+  if (inches == 8)
+  {
+    drive.Cylinders = 77;
+    drive.RPM = 360;
+    drive.SpinUpMs = 400;
+    drive.SettleMs = 20;
+    drive.MinStepUs = 10000;
+  }
+  else if (inches == 5)
+  {
+    const bool highDensity = (image.getRate() == 500) || (image.getRate() == 300);
+    drive.Cylinders = (!highDensity && (image.getCylinders() <= 42) && !options.DoubleStep) ? 42 : 82;
+    drive.RPM = highDensity ? 360 : 300;
+    drive.SpinUpMs = 400;
+    drive.SettleMs = 15;
+    drive.MinStepUs = 6000;
+  }
+  else
+  {
+    drive.Cylinders = 82;
+    drive.RPM = 300;
+    drive.SpinUpMs = 300;
+    drive.SettleMs = 15;
+    drive.MinStepUs = 3000;
+  }
+
+  if (options.RPM)
+  {
+    drive.RPM = options.RPM;
+  }
+  if (options.SpinUpMs)
+  {
+    drive.SpinUpMs = options.SpinUpMs;
+  }
+  if (options.SettleMs)
+  {
+    drive.SettleMs = options.SettleMs;
+  }
+  if (options.MinStepUs)
+  {
+    drive.MinStepUs = options.MinStepUs;
+  }
+
+  return true;
+}
@@ -0,0 +1,50 @@
+// MegaFDC (c) 2023-2025 J. Bogin, http://boginjr.com
+// Host build: runtime options shared by the firmware runner and the benchmark
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "diskimage.h"
+
+struct HostOptions
+{
+  struct Fault
+  {
+    uint8_t Cylinder;
+    uint8_t Head;
+    uint8_t Sector;
+    int Count;
+  };
+
+  const char* ImagePath = NULL;
+  const char* EEPROMPath = NULL;
+  uint8_t Cylinders = 0;
+  uint8_t Heads = 0;
+  uint8_t Sectors = 0;
+  uint8_t SizeN = 0;
+  uint16_t Rate = 0;
+  bool FM = false;
+  bool DoubleStep = false;
+  bool WriteProtect = false;
+  uint8_t DriveInches = 0;
+  uint16_t RPM = 0;
+  uint16_t SpinUpMs = 0;
+  uint16_t SettleMs = 0;
+  uint32_t MinStepUs = 0;
+  bool Chip765 = false;
+  uint32_t Baud = 0;
+  bool SaveImage = false;
+  bool Statistics = false;
+  std::vector<Fault> Faults;
+
+  // runtime
+  HostDiskImage* Image = NULL;
+  uint32_t SerialOverruns = 0;
+};
+
+extern HostOptions g_hostOptions;
+
+void hostUsage(const char* program, const char* extra = NULL);
+int hostParseOption(int argc, char** argv, int index, HostOptions& options);
+bool hostSetup(HostOptions& options);
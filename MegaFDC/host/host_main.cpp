@@ -0,0 +1,36 @@
+// MegaFDC (c) 2023-2025 J. Bogin, http://boginjr.com
+// Host build: runs the firmware against the controller model, serial console on stdin/stdout
+
+#include <vector>
+#include "host.h"
+#include "fdcmodel.h"
+#include "../config.h"
+
+// main.cpp
+void setup();
+void loop();
+
+int main(int argc, char** argv)
+{
+  for (int index = 1; index < argc; )
+  {
+    const int consumed = hostParseOption(argc, argv, index, g_hostOptions);
+    if (consumed <= 0)
+    {
+      hostUsage(argv[0]);
+      return 1;
+    }
+    index += consumed;
+  }
+
+  if (!hostSetup(g_hostOptions))
+  {
+    return 1;
+  }
+
+  setup();
+  while (true)
+  {
+    loop();
+  }
+}
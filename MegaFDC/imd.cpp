@@ -120,9 +120,10 @@ void ProcessCommands()
     ui->print(Progmem::getString(Progmem::imdOptionErase));
     ui->print(Progmem::getString(Progmem::imdOptionTests));
     ui->print(Progmem::getString(Progmem::imdOptionXlat));
+    ui->print(Progmem::getString(Progmem::imdOptionStats));
     ui->print(Progmem::getString(Progmem::imdOptionReset));
     ui->print(Progmem::getString(Progmem::uiChooseOption));
-    BYTE mainmenu = toupper(ui->readKey("RWFETDQ"));
+    BYTE mainmenu = toupper(ui->readKey("RWFETDSQ"));
     ui->print(Progmem::getString(Progmem::uiEchoKey), mainmenu);
     
     if (mainmenu == 'R')
@@ -186,6 +187,14 @@ void ProcessCommands()
       ui->print(Progmem::getString(Progmem::uiEchoKey), key);      
     }
     
+    else if (mainmenu == 'S')
+    {
+      fdc->printStatistics();
+      fdc->resetStatistics();
+      ui->print(Progmem::getString(Progmem::uiContinue));
+      ui->readKey("\r");
+    }
+    
     else if (mainmenu == 'Q')
     {
       ui->reset();
@@ -213,6 +222,8 @@ IMD::IMD()
   // format interleave sequential by default, start sector at 1
   m_formatInterleave = 1;
   m_formatStartSector = 1;
+  m_formatHeadSkew = 0;
+  m_formatCylinderSkew = 0;
   
   // IMD file transfer
   m_cbSuccess = false;
@@ -1395,6 +1406,22 @@ void IMD::formatDisk()
     
     ui->print(Progmem::getString(Progmem::uiDeleteLine));
   }
+  
+  // track skew, ENTER to derive it on the drive
+  m_formatHeadSkew = 0;
+  if (fdc->getParams()->Heads > 1)
+  {
+    ui->print(Progmem::getString(Progmem::formatHeadSkew));
+    const BYTE* prompt = ui->prompt(2, Progmem::getString(Progmem::uiDecimalInput));
+    m_formatHeadSkew = strlen(prompt) ? (BYTE)atoi(prompt) : 0xFF;
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+  }
+  {
+    ui->print(Progmem::getString(Progmem::formatCylinderSkew));
+    const BYTE* prompt = ui->prompt(2, Progmem::getString(Progmem::uiDecimalInput));
+    m_formatCylinderSkew = strlen(prompt) ? (BYTE)atoi(prompt) : 0xFF;
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+  }
     
   // all questions answered
   previousFormatParams = m_params;  
@@ -1417,6 +1444,18 @@ beginFormat:
   fdc->setCommunicationRate();  
   printGeometryInfo(0, 0, m_formatInterleave);
   
+  BYTE headSkew = m_formatHeadSkew;
+  BYTE cylinderSkew = m_formatCylinderSkew;
+  if ((headSkew == 0xFF) || (cylinderSkew == 0xFF))
+  {
+    BYTE derivedHeadSkew;
+    BYTE derivedCylinderSkew;
+    fdc->deriveSkew(derivedHeadSkew, derivedCylinderSkew);
+    headSkew = (headSkew == 0xFF) ? derivedHeadSkew : headSkew;
+    cylinderSkew = (cylinderSkew == 0xFF) ? derivedCylinderSkew : cylinderSkew;
+  }
+  ui->print(Progmem::getString(Progmem::formatSkew), headSkew, cylinderSkew);
+  
   WORD sector = m_formatStartSector;
   WORD endSector = fdc->getParams()->SectorsPerTrack;
   if (sector == 0)
@@ -1438,7 +1477,7 @@ beginFormat:
     ui->print(Progmem::getString(Progmem::imdProgress), cyl, head);      
     
     fdc->seekDrive(cyl, head);    
-    fdc->formatTrack(false, m_formatInterleave, m_formatStartSector);
+    fdc->formatTrack(false, m_formatInterleave, m_formatStartSector, headSkew, cylinderSkew);
 
     bool formatError = fdc->getLastError();
     breakError = formatError ? fdc->wasErrorNoDiskInDrive() || fdc->wasErrorDiskProtected() : false;    
@@ -55,6 +55,8 @@ private:
   
   BYTE m_formatInterleave;
   BYTE m_formatStartSector;
+  BYTE m_formatHeadSkew;     // 0xFF: derived on the drive
+  BYTE m_formatCylinderSkew;
   WORD m_lastGoodCommRate;
   BYTE m_lastGoodUseFM;
   
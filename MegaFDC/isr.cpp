@@ -7,6 +7,8 @@
 extern volatile BYTE g_rwBuffer[SECTOR_BUFFER_SIZE]; // shared by xmodem, fatfs, cpm
 extern volatile BYTE intFired;
 extern volatile WORD dataPos;
+extern volatile DWORD dataEndTime;
+extern volatile BYTE dataBurst;
 
 // FDC interrupt service routines: acknowledge, read, write, verify, determined by FDC::setInterrupt()
 // these are split into 4 separate, to decrease time spent in ISR
@@ -17,6 +19,10 @@ void FDCACK()
   intFired = 1;
 }
 
+#ifdef MEGAFDC_HOST
+
+// host build: the controller model has no bus timing, the C versions below describe what the assembly ones do
+
 // FDC data stream interrupt for read into global buffer
 void FDCREAD()
 {
@@ -24,18 +30,29 @@ void FDCREAD()
   {
     const BYTE msr = readRegister(MSR);
   
-    // handshaking - data ready, write into buffer and advance position
-    if ((msr & 0xA0) == 0xA0)
+    // handshaking - data ready and FIFO threshold reached (INT high), write a burst into buffer and advance position
+    if (((msr & 0xA0) == 0xA0) && (PINE & 0x10))
     {
-      g_rwBuffer[dataPos++] = readRegister(DTR);
+      for (BYTE count = dataBurst; count; count--)
+      {
+        g_rwBuffer[dataPos++] = readRegister(DTR);
+      }
     }
       
     // handshaking end of transfer - bits 7, 6 set, 5 cleared; return and read result phase
+    // the time the last sector ended under the head tells the rotational position
     else if ((msr & 0xE0) == 0xC0)
     {
+      dataEndTime = fdcMicros();
       intFired = 1;
       return;
     }
+    
+    // waiting for the next byte, keep the serial line going during image transfers
+    else
+    {
+      xmodemSerialPump();
+    }
   }
 }
 
@@ -45,10 +62,13 @@ void FDCVERIFY()
   while (true)
   {
     const BYTE msr = readRegister(MSR);
-    if ((msr & 0xA0) == 0xA0)
+    if (((msr & 0xA0) == 0xA0) && (PINE & 0x10))
     {
-      readRegister(DTR);
-      dataPos++;
+      for (BYTE count = dataBurst; count; count--)
+      {
+        readRegister(DTR);
+        dataPos++;
+      }
     }
 
     else if ((msr & 0xE0) == 0xC0)
@@ -56,6 +76,11 @@ void FDCVERIFY()
       intFired = 1;
       return;
     } 
+    
+    else
+    {
+      xmodemSerialPump();
+    }
   }
 }
 
@@ -65,15 +90,264 @@ void FDCWRITE()
   while (true)
   {
     const BYTE msr = readRegister(MSR);
-    if ((msr & 0xA0) == 0xA0)
+    if (((msr & 0xA0) == 0xA0) && (PINE & 0x10))
     {
-      writeRegister(DTR, g_rwBuffer[dataPos++]);
+      for (BYTE count = dataBurst; count; count--)
+      {
+        writeRegister(DTR, g_rwBuffer[dataPos++]);
+      }
     }
     
     else if ((msr & 0xE0) == 0xC0)
     {
+      dataEndTime = fdcMicros();
       intFired = 1;
       return;
     }  
+    
+    else
+    {
+      xmodemSerialPump();
+    }
   }  
 }
+
+#else
+
+// the data ISRs below are naked: called from the INT4 vector of the Arduino core (attachInterrupt), which has already
+// saved SREG, r0, r18-r27, r30, r31 and cleared r1, so these use only those and keep the buffer pointer in Z
+// the address lines stay on MSR and only A0 is flipped for DTR; reads and verifies keep the data lines input throughout,
+// writes drive them only for the /WR strobes, as the MSR has to be read between the bursts
+// a burst (dataBurst bytes) is moved once the FDC raises INT (pin 2, PE4) at its FIFO threshold, without the MSR
+//
+// cycles at 16 MHz, counted by hand from the instructions (call 5, ret 5 on the 2560); recount after changing them:
+// - byte to byte within a burst:                        12
+// - per burst, MSR and INT check included:              read, verify 20; write 22
+// - one pass waiting, no image transfer:                31
+// - one pass waiting, pump moving a byte each way:      95
+// - worst case from INT to the first byte moved:        read, verify 105; write 110 (INT missed just before a full pump)
+// the budget is a byte time at 1 Mbps, 128 cycles: the worst case has to stay below it, or the FIFO overruns at its threshold
+
+// xmodemSerialPump() for the data ISRs, 74 cycles at most without the call; uses r18-r27, keeps Z
+extern "C" void fdcSerialPump() __attribute__((naked, noinline, used));
+void fdcSerialPump()
+{
+  asm volatile
+  (
+    "lds  r18, %[active]           \n\t"
+    "tst  r18                      \n\t"
+    "breq 9f                       \n\t"
+    "lds  r18, %[ucsra]            \n\t"
+
+    // received byte into the ring, unless full
+    "sbrs r18, %[rxc]              \n\t"
+    "rjmp 5f                       \n\t"
+    "lds  r20, %[head]             \n\t"
+    "lds  r21, %[head]+1           \n\t"
+    "movw r22, r20                 \n\t"
+    "subi r22, 0xFF                \n\t" // next = (head+1) & mask
+    "sbci r23, 0xFF                \n\t"
+    "lds  r24, %[mask]             \n\t"
+    "and  r22, r24                 \n\t"
+    "lds  r24, %[mask]+1           \n\t"
+    "and  r23, r24                 \n\t"
+    "lds  r24, %[tail]             \n\t"
+    "lds  r25, %[tail]+1           \n\t"
+    "cp   r22, r24                 \n\t"
+    "cpc  r23, r25                 \n\t"
+    "breq 5f                       \n\t"
+    "lds  r26, %[rxbuf]            \n\t"
+    "lds  r27, %[rxbuf]+1          \n\t"
+    "add  r26, r20                 \n\t"
+    "adc  r27, r21                 \n\t"
+    "lds  r24, %[udr]              \n\t"
+    "st   X, r24                   \n\t"
+    "sts  %[head], r22             \n\t"
+    "sts  %[head]+1, r23           \n\t"
+
+    // next byte to send, if the transmit register is empty
+    "5:                            \n\t"
+    "lds  r24, %[count]            \n\t"
+    "lds  r25, %[count]+1          \n\t"
+    "sbiw r24, 0                   \n\t"
+    "breq 9f                       \n\t"
+    "sbrs r18, %[udre]             \n\t"
+    "rjmp 9f                       \n\t"
+    "lds  r26, %[txdata]           \n\t"
+    "lds  r27, %[txdata]+1         \n\t"
+    "ld   r19, X+                  \n\t"
+    "sts  %[udr], r19              \n\t"
+    "sts  %[txdata], r26           \n\t"
+    "sts  %[txdata]+1, r27         \n\t"
+    "sbiw r24, 1                   \n\t"
+    "sts  %[count], r24            \n\t"
+    "sts  %[count]+1, r25          \n\t"
+    "9:                            \n\t"
+    "ret                           \n\t"
+    :
+    : [active] "i" (&xmSerialActive), [head] "i" (&xmRxHead), [tail] "i" (&xmRxTail), [mask] "i" (&xmRxMask),
+      [rxbuf] "i" (&xmRxBuffer), [txdata] "i" (&xmTxData), [count] "i" (&xmTxCount),
+      [ucsra] "n" (_SFR_MEM_ADDR(UCSR0A)), [udr] "n" (_SFR_MEM_ADDR(UDR0)), [rxc] "I" (RXC0), [udre] "I" (UDRE0)
+  );
+}
+
+// shared by the data ISRs: address lines on MSR, Z = g_rwBuffer + dataPos
+#define FDC_ISR_ENTRY \
+    "in   r24, %[portc]            \n\t" \
+    "andi r24, 0xF8                \n\t" \
+    "ori  r24, %[msr]              \n\t" \
+    "out  %[portc], r24            \n\t" \
+    "out  %[ddra], r1              \n\t" \
+    "lds  r30, %[pos]              \n\t" \
+    "lds  r31, %[pos]+1            \n\t" \
+    "subi r30, lo8(-(%[buffer]))   \n\t" \
+    "sbci r31, hi8(-(%[buffer]))   \n\t"
+
+// read MSR into r24: waiting for data (RQM clear, or INT low below the FIFO threshold) to 3,
+// result phase or idle (NDM clear) to 4; else load the burst size into r25 and put A0 up for DTR
+#define FDC_ISR_POLL_MSR \
+    "1:                            \n\t" \
+    "cbi  %[portc], %[rd]          \n\t" \
+    "nop                           \n\t" \
+    "nop                           \n\t" \
+    "in   r24, %[pina]             \n\t" \
+    "sbi  %[portc], %[rd]          \n\t" \
+    "sbrs r24, 7                   \n\t" \
+    "rjmp 3f                       \n\t" \
+    "sbrs r24, 5                   \n\t" \
+    "rjmp 4f                       \n\t" \
+    "sbis %[pine], 4               \n\t" \
+    "rjmp 3f                       \n\t" \
+    "lds  r25, %[burst]            \n\t" \
+    "sbi  %[portc], 0              \n\t"
+
+// nothing to move yet: keep the serial line going during image transfers
+#define FDC_ISR_WAIT \
+    "3:                            \n\t" \
+    "%~call %x[pump]               \n\t" \
+    "rjmp 1b                       \n\t"
+
+// end of transfer - RQM, DIO set, NDM cleared: store position and flag, optionally when the last sector ended
+#define FDC_ISR_END \
+    "4:                            \n\t" \
+    "sbrs r24, 6                   \n\t" \
+    "rjmp 3b                       \n\t" \
+    "subi r30, lo8(%[buffer])      \n\t" \
+    "sbci r31, hi8(%[buffer])      \n\t" \
+    "sts  %[pos]+1, r31            \n\t" \
+    "sts  %[pos], r30              \n\t"
+
+#define FDC_ISR_END_TIME \
+    "%~call %x[time]             \n\t" \
+    "sts  %[endTime], r22          \n\t" \
+    "sts  %[endTime]+1, r23        \n\t" \
+    "sts  %[endTime]+2, r24        \n\t" \
+    "sts  %[endTime]+3, r25        \n\t"
+
+#define FDC_ISR_RETURN \
+    "ldi  r24, 1                   \n\t" \
+    "sts  %[flag], r24             \n\t" \
+    "ret                           \n\t"
+
+#define FDC_ISR_OPERANDS \
+    [portc] "I" (_SFR_IO_ADDR(PORTC)), [porta] "I" (_SFR_IO_ADDR(PORTA)), [pina] "I" (_SFR_IO_ADDR(PINA)), \
+    [ddra] "I" (_SFR_IO_ADDR(DDRA)), [pine] "I" (_SFR_IO_ADDR(PINE)), [rd] "I" (4), [wr] "I" (5), [msr] "M" (MSR), \
+    [pos] "i" (&dataPos), [burst] "i" (&dataBurst), [buffer] "i" (g_rwBuffer), [flag] "i" (&intFired), [endTime] "i" (&dataEndTime), \
+    [pump] "i" (fdcSerialPump), [time] "i" (fdcMicros)
+
+// FDC data stream interrupt for read into global buffer, both one-shot or with FIFO enabled
+void FDCREAD() __attribute__((naked));
+void FDCREAD()
+{
+  asm volatile
+  (
+    FDC_ISR_ENTRY
+    FDC_ISR_POLL_MSR
+
+    // burst ready: read, back to MSR
+    "2:                            \n\t"
+    "cbi  %[portc], %[rd]          \n\t"
+    "nop                           \n\t"
+    "nop                           \n\t"
+    "in   r24, %[pina]             \n\t"
+    "sbi  %[portc], %[rd]          \n\t"
+    "st   Z+, r24                  \n\t"
+    "dec  r25                      \n\t"
+    "brne 2b                       \n\t"
+    "cbi  %[portc], 0              \n\t"
+    "rjmp 1b                       \n\t"
+
+    FDC_ISR_WAIT
+    FDC_ISR_END
+    FDC_ISR_END_TIME
+    FDC_ISR_RETURN
+    :
+    : FDC_ISR_OPERANDS
+  );
+}
+
+// FDC verify - read register without writing, position counter incremented
+void FDCVERIFY() __attribute__((naked));
+void FDCVERIFY()
+{
+  asm volatile
+  (
+    FDC_ISR_ENTRY
+    FDC_ISR_POLL_MSR
+
+    "2:                            \n\t"
+    "cbi  %[portc], %[rd]          \n\t"
+    "nop                           \n\t"
+    "nop                           \n\t"
+    "in   r24, %[pina]             \n\t"
+    "sbi  %[portc], %[rd]          \n\t"
+    "adiw r30, 1                   \n\t"
+    "dec  r25                      \n\t"
+    "brne 2b                       \n\t"
+    "cbi  %[portc], 0              \n\t"
+    "rjmp 1b                       \n\t"
+
+    FDC_ISR_WAIT
+    FDC_ISR_END
+    FDC_ISR_RETURN
+    :
+    : FDC_ISR_OPERANDS
+  );
+}
+
+// FDC data stream interrupt for write from global buffer
+void FDCWRITE() __attribute__((naked));
+void FDCWRITE()
+{
+  asm volatile
+  (
+    FDC_ISR_ENTRY
+    "ldi  r24, 0xFF                \n\t"
+    "mov  r0, r24                  \n\t"
+    FDC_ISR_POLL_MSR
+
+    // burst wanted: drive the data lines for the strobes only, back to MSR
+    "out  %[ddra], r0              \n\t"
+    "2:                            \n\t"
+    "ld   r24, Z+                  \n\t"
+    "out  %[porta], r24            \n\t"
+    "cbi  %[portc], %[wr]          \n\t"
+    "nop                           \n\t"
+    "nop                           \n\t"
+    "sbi  %[portc], %[wr]          \n\t"
+    "dec  r25                      \n\t"
+    "brne 2b                       \n\t"
+    "out  %[ddra], r1              \n\t"
+    "cbi  %[portc], 0              \n\t"
+    "rjmp 1b                       \n\t"
+
+    FDC_ISR_WAIT
+    FDC_ISR_END
+    FDC_ISR_END_TIME
+    FDC_ISR_RETURN
+    :
+    : FDC_ISR_OPERANDS
+  );
+}
+
+#endif
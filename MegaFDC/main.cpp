@@ -9,8 +9,40 @@ Ui* ui = NULL;
 // floppy disk controller
 FDC* fdc = NULL;
 
+#ifndef MEGAFDC_HOST
+// RAM between the heap and the stack is filled with a pattern at start; what the stack or the heap has not overwritten since
+// is the least free RAM there was, STATS shows it
+#define FREE_RAM_PATTERN 0xA5
+extern BYTE  __heap_start;
+extern BYTE* __brkval;
+
+void paintFreeMemory()
+{
+  cli();
+  BYTE* end = (BYTE*)SP - 32; // this function and the interrupts stay above
+  for (BYTE* position = __brkval ? __brkval : &__heap_start; position < end; position++)
+  {
+    *position = FREE_RAM_PATTERN;
+  }
+  sei();
+}
+
+WORD getLowestFreeMemory()
+{
+  WORD count = 0;
+  for (const BYTE* position = __brkval ? __brkval : &__heap_start; (position < (BYTE*)SP) && (*position == FREE_RAM_PATTERN); position++)
+  {
+    count++;
+  }
+  return count;
+}
+#endif
+
 void setup()
 {
+#ifndef MEGAFDC_HOST
+  paintFreeMemory();
+#endif
   ui = Ui::get();
   fdc = FDC::get();
   
@@ -11,7 +11,7 @@ class Progmem
 {
 public:
   
-  // enum in sync with order of m_stringTable
+  // enum in sync with order of m_stringTable; over 256 strings in the regular build, so the indexes are 16-bit
   enum BYTE
   {
     // basic UI    
@@ -68,6 +68,29 @@ public:
     errChsFmtMultiSector,
     errTrack0Error,
     errTryFormat,
+    
+    // disk operation statistics
+    statsTimings,
+    statsNone,
+    statsRead,
+    statsWrite,
+    statsFormat,
+    statsReadID,
+    statsSeek,
+    statsRecalibrate,
+    statsTiming,
+    statsPhases,
+    statsPhase,
+    statsRetries,
+    statsInPlace,
+    statsSeekAway,
+    statsRecalibrated,
+    statsRetry,
+    statsFreeMemory,
+    traceSignature,
+    formatHeadSkew,
+    formatCylinderSkew,
+    formatSkew,
 	
     // MegaFDC command line
 #ifndef BUILD_IMD_IMAGER        
@@ -81,6 +104,10 @@ public:
     cmdFormat,
     cmdVerify,
     cmdImage,
+    cmdStats,
+    cmdTrace,
+    cmdCalibrate,
+    cmdInterleave,
     // filesystem user commands
     cmdFSIndex,
     cmdQuickFormat,
@@ -93,6 +120,7 @@ public:
     cmdTypeInto,
     cmdDel,    
     cmdXfer,
+    cmdDefrag,
     // end of user commands
     cmdEndIndex,
     
@@ -119,6 +147,27 @@ public:
     helpImage1,
     helpImage2,
     helpImage3,
+    helpStats1,
+    helpStats2,
+    helpStats3,
+    helpTrace1,
+    helpTrace2,
+    helpTrace3,
+    traceSending,
+    helpCalibrate1,
+    helpCalibrate2,
+    helpCalibrate3,
+    calibrateResult,
+    calibrateStepRate,
+    calibrateTimesKept,
+    calibrateSRTKept,
+    helpInterleave1,
+    helpInterleave2,
+    helpInterleave3,
+    interleaveScratch,
+    interleaveTimings,
+    interleaveTiming,
+    interleaveResult,
     helpQuickFormat1,
     helpQuickFormat2,
     helpPath1,
@@ -145,6 +194,9 @@ public:
     helpTypeInto3,
     helpXfer1,
     helpXfer2,
+    helpDefrag1,
+    helpDefrag2,
+    helpDefrag3,
     
     // startup command: initialize drives
     waitingForDrives,
@@ -214,6 +266,9 @@ public:
     drivParmSRT,
     drivParmHLT,
     drivParmHUT,
+    drivParmSpinUp,
+    drivParmSettle,
+    drivParmInterleave,
     drivParmCyls,
     drivParmHeads,
     drivParmHeadsOne,
@@ -268,6 +323,7 @@ public:
     xmodemWaitRecv,
     xmodemTransferEnd,
     xmodemTransferFail,
+    xmodemRevsPerTrack,
     
     // DIR
     dirDirectory,
@@ -283,11 +339,22 @@ public:
     // TYPEINTO
     typeIntoCaption,
     
+    // DEFRAG
+    defragTempName,
+    defragOldName,
+    defragNameFile,
+    defragFragments,
+    defragSystemFile,
+    defragNoRoom,
+    defragNamesTaken,
+    defragSeeks,
+    
     // Filesystem related
     fsCurrentDrive,
     fsForbiddenCharFAT,
     fsForbiddenCharCPM,
     fsDiskError,
+    fsWritesLost,
     fsInternalError,
     fsFileNotFound,
     fsPathNotFound,
@@ -301,7 +368,8 @@ public:
     fsInvalidParameter,
     fsCPMFileNotFound,
     fsCPMFileEmpty,
-    fsCPMNoFilesFound
+    fsCPMNoFilesFound,
+    fsCPMDiskFull
        
     // IMD imager
 #else
@@ -340,6 +408,7 @@ public:
     imdOptionErase, 
     imdOptionTests,
     imdOptionXlat,
+    imdOptionStats,
     imdOptionReset,
     
     imdTestFDC,
@@ -412,7 +481,7 @@ public:
   };
   
   // retrieve string from progmem, buffer valid until next call
-  static const unsigned char* getString(unsigned char stringIndex)
+  static const unsigned char* getString(unsigned short stringIndex)
   {   
     strncpy_P(m_strBuffer, pgm_read_ptr(&(m_stringTable[stringIndex])), MAX_PROGMEM_STRING_LEN);
     return (const unsigned char*)&m_strBuffer[0];
@@ -500,6 +569,28 @@ private:
 // verify track 0 command
   PROGMEM_STR m_errTrack0Error[]     PROGMEM = "Bad Track0 or wrong drive setup";
   PROGMEM_STR m_errTryFormat[]       PROGMEM = "Try low-level format first";
+// disk operation statistics, operation names in TIMING_ order
+  PROGMEM_STR m_statsTimings[]       PROGMEM = "Timings in ms, min/avg/max:\r\n";
+  PROGMEM_STR m_statsNone[]          PROGMEM = "none\r\n";
+  PROGMEM_STR m_statsRead[]          PROGMEM = "READ";
+  PROGMEM_STR m_statsWrite[]         PROGMEM = "WRITE";
+  PROGMEM_STR m_statsFormat[]        PROGMEM = "FORMAT";
+  PROGMEM_STR m_statsReadID[]        PROGMEM = "READID";
+  PROGMEM_STR m_statsSeek[]          PROGMEM = "SEEK";
+  PROGMEM_STR m_statsRecalibrate[]   PROGMEM = "RECAL";
+  PROGMEM_STR m_statsTiming[]        PROGMEM = " %ux %lu.%02lu/%lu.%02lu/%lu.%02lu\r\n";
+  PROGMEM_STR m_statsPhases[]        PROGMEM = "\r\nCommand/execution/result us:\r\n";
+  PROGMEM_STR m_statsPhase[]         PROGMEM = " %lu/%lu/%lu\r\n";
+  PROGMEM_STR m_statsRetries[]       PROGMEM = "\r\nRetries, recovered:\r\n";
+  PROGMEM_STR m_statsInPlace[]       PROGMEM = "in place";
+  PROGMEM_STR m_statsSeekAway[]      PROGMEM = "seek away";
+  PROGMEM_STR m_statsRecalibrated[]  PROGMEM = "recalibrate";
+  PROGMEM_STR m_statsRetry[]         PROGMEM = " %u, %u\r\n";
+  PROGMEM_STR m_statsFreeMemory[]    PROGMEM = "\r\nFree RAM, lowest: %u bytes\r\n";
+  PROGMEM_STR m_traceSignature[]     PROGMEM = "FDCTRACE";
+  PROGMEM_STR m_formatHeadSkew[]     PROGMEM = "Head skew (ENTER: auto): ";
+  PROGMEM_STR m_formatCylinderSkew[] PROGMEM = "Cylinder skew (ENTER: auto): ";
+  PROGMEM_STR m_formatSkew[]         PROGMEM = "Skew: head %u, cylinder %u\r\n";
   
 // MegaFDC command line
 #ifndef BUILD_IMD_IMAGER
@@ -513,6 +604,10 @@ private:
   PROGMEM_STR m_cmdFormat[]          PROGMEM = "FORMAT";
   PROGMEM_STR m_cmdVerify[]          PROGMEM = "VERIFY";
   PROGMEM_STR m_cmdImage[]           PROGMEM = "IMAGE";  
+  PROGMEM_STR m_cmdStats[]           PROGMEM = "STATS";
+  PROGMEM_STR m_cmdTrace[]           PROGMEM = "TRACE";
+  PROGMEM_STR m_cmdCalibrate[]       PROGMEM = "CALIBRATE";
+  PROGMEM_STR m_cmdInterleave[]      PROGMEM = "INTERLEAVE";
 // filesystem specific commands
   PROGMEM_STR m_cmdFSIndex[]         PROGMEM = "";
   PROGMEM_STR m_cmdQuickFormat[]     PROGMEM = "QFORMAT";
@@ -525,6 +620,7 @@ private:
   PROGMEM_STR m_cmdTypeInto[]        PROGMEM = "TYPEINTO";
   PROGMEM_STR m_cmdDel[]             PROGMEM = "DEL"; 
   PROGMEM_STR m_cmdXfer[]            PROGMEM = "XFER";
+  PROGMEM_STR m_cmdDefrag[]          PROGMEM = "DEFRAG";
 // user commands end
   PROGMEM_STR m_cmdEndIndex[]        PROGMEM = "";
   
@@ -551,6 +647,27 @@ private:
   PROGMEM_STR m_helpImage1[]         PROGMEM = "Usage: IMAGE [drive:]\r\n";
   PROGMEM_STR m_helpImage2[]         PROGMEM = "Creates disk image of [drive:]\r\n";
   PROGMEM_STR m_helpImage3[]         PROGMEM = "or writes it to [drive:]\r\n";
+  PROGMEM_STR m_helpStats1[]         PROGMEM = "Usage: STATS\r\n";
+  PROGMEM_STR m_helpStats2[]         PROGMEM = "Shows disk operation timings\r\n";
+  PROGMEM_STR m_helpStats3[]         PROGMEM = "and retries, then clears them.\r\n\r\n";
+  PROGMEM_STR m_helpTrace1[]         PROGMEM = "Usage: TRACE\r\n";
+  PROGMEM_STR m_helpTrace2[]         PROGMEM = "Sends recent disk commands over\r\n";
+  PROGMEM_STR m_helpTrace3[]         PROGMEM = "serial, see fdctrace.py\r\n\r\n";
+  PROGMEM_STR m_traceSending[]       PROGMEM = "Sending trace over serial...\r\n";
+  PROGMEM_STR m_helpCalibrate1[]     PROGMEM = "Usage: CALIBRATE [drive:]\r\n";
+  PROGMEM_STR m_helpCalibrate2[]     PROGMEM = "Tunes spin-up, settle, step rate\r\n";
+  PROGMEM_STR m_helpCalibrate3[]     PROGMEM = "with a formatted disk in [drive:]\r\n";
+  PROGMEM_STR m_calibrateResult[]    PROGMEM = "Spin-up %u ms, head settle %u ms\r\n";
+  PROGMEM_STR m_calibrateStepRate[]  PROGMEM = "Step rate %u ms\r\n\r\n";
+  PROGMEM_STR m_calibrateTimesKept[] PROGMEM = "Spin-up and head settle not measured, kept\r\n";
+  PROGMEM_STR m_calibrateSRTKept[]   PROGMEM = "Step rate not tuned, kept\r\n\r\n";
+  PROGMEM_STR m_helpInterleave1[]    PROGMEM = "Usage: INTERLEAVE [drive:]\r\n";
+  PROGMEM_STR m_helpInterleave2[]    PROGMEM = "Finds fastest FORMAT interleave\r\n";
+  PROGMEM_STR m_helpInterleave3[]    PROGMEM = "on the last track of [drive:]\r\n";
+  PROGMEM_STR m_interleaveScratch[]  PROGMEM = "Its last track will be erased\r\n";
+  PROGMEM_STR m_interleaveTimings[]  PROGMEM = "Interleave, bytes/s, ms/track:\r\n";
+  PROGMEM_STR m_interleaveTiming[]   PROGMEM = " %u:1 %lu %lu\r\n";
+  PROGMEM_STR m_interleaveResult[]   PROGMEM = "Interleave %u:1\r\n";
   PROGMEM_STR m_helpQuickFormat1[]   PROGMEM = "Usage: QFORMAT [drive:]\r\n";
   PROGMEM_STR m_helpQuickFormat2[]   PROGMEM = "Creates filesystem on [drive:]\r\n";
   PROGMEM_STR m_helpPath1[]          PROGMEM = "Usage: PATH\r\n";
@@ -577,6 +694,9 @@ private:
   PROGMEM_STR m_helpTypeInto3[]      PROGMEM = "keyboard input for contents.\r\n\r\n";
   PROGMEM_STR m_helpXfer1[]          PROGMEM = "Usage: XFER filename\r\n";
   PROGMEM_STR m_helpXfer2[]          PROGMEM = "File transfer over serial link.\r\n\r\n";
+  PROGMEM_STR m_helpDefrag1[]        PROGMEM = "Usage: DEFRAG\r\n";
+  PROGMEM_STR m_helpDefrag2[]        PROGMEM = "Makes fragmented files on disk\r\n";
+  PROGMEM_STR m_helpDefrag3[]        PROGMEM = "contiguous, except system files.\r\n\r\n";
   
 // init drives command directly at startup
   PROGMEM_STR m_waitingForDrives[]   PROGMEM = "Starting MS-BOSS...\r\n\r\n"; // :-)  
@@ -647,6 +767,9 @@ private:
   PROGMEM_STR m_drivParmSRT[]        PROGMEM = "Drive step rate time   %u ms";
   PROGMEM_STR m_drivParmHLT[]        PROGMEM = "Drive head load time   %u ms";
   PROGMEM_STR m_drivParmHUT[]        PROGMEM = "Drive head unload time %u ms";
+  PROGMEM_STR m_drivParmSpinUp[]     PROGMEM = "Drive spin-up time     %u ms";
+  PROGMEM_STR m_drivParmSettle[]     PROGMEM = "Drive head settle time %u ms";
+  PROGMEM_STR m_drivParmInterleave[] PROGMEM = "Sector interleave      %u:1";
   PROGMEM_STR m_drivParmCyls[]       PROGMEM = "Cylinders              %u";
   PROGMEM_STR m_drivParmHeads[]      PROGMEM = "Heads (sides)          ";
   PROGMEM_STR m_drivParmHeadsOne[]   PROGMEM = "one";
@@ -701,6 +824,7 @@ private:
   PROGMEM_STR m_xmodemWaitRecv[]     PROGMEM = "OK to launch Receive\r\nTimeout 4 minutes\r\n";
   PROGMEM_STR m_xmodemTransferEnd[]  PROGMEM = "\rEnd of transfer";
   PROGMEM_STR m_xmodemTransferFail[] PROGMEM = "\rTransfer aborted";
+  PROGMEM_STR m_xmodemRevsPerTrack[] PROGMEM = "\rRevs per track: %u.%02u avg, %u.%02u max\r\n";
   
 // DIR
   PROGMEM_STR m_dirDirectory[]       PROGMEM = " [DIRECTORY]  ";
@@ -716,11 +840,22 @@ private:
 // TYPEINTO
   PROGMEM_STR m_typeIntoCaption[]    PROGMEM = "Type two empty newlines to quit\r\n";
   
+// DEFRAG
+  PROGMEM_STR m_defragTempName[]     PROGMEM = "DEFRAG.$$$";
+  PROGMEM_STR m_defragOldName[]      PROGMEM = "DEFRAG.OLD";
+  PROGMEM_STR m_defragNameFile[]     PROGMEM = "DEFRAG.NAM";
+  PROGMEM_STR m_defragFragments[]    PROGMEM = "%s: %u fragments ";
+  PROGMEM_STR m_defragSystemFile[]   PROGMEM = "system file, kept\r\n";
+  PROGMEM_STR m_defragNoRoom[]       PROGMEM = "no room\r\n";
+  PROGMEM_STR m_defragNamesTaken[]   PROGMEM = "DEFRAG.* files in the way, kept\r\n";
+  PROGMEM_STR m_defragSeeks[]        PROGMEM = "Seeks to read all files: %u, was %u\r\n";
+  
 // Filesystem specific
   PROGMEM_STR m_fsCurrentDrive[]     PROGMEM = "0:";
   PROGMEM_STR m_fsForbiddenCharFAT[] PROGMEM = "*?\\/\":<>|";
   PROGMEM_STR m_fsForbiddenCharCPM[] PROGMEM = "=:;<>";
   PROGMEM_STR m_fsDiskError[]        PROGMEM = "\rAborted due to disk error";
+  PROGMEM_STR m_fsWritesLost[]       PROGMEM = "Unwritten data of the last disk lost";
   PROGMEM_STR m_fsInternalError[]    PROGMEM = "Internal filesystem error";
   PROGMEM_STR m_fsFileNotFound[]     PROGMEM = "Not found in current path";
   PROGMEM_STR m_fsPathNotFound[]     PROGMEM = "Path not found";
@@ -735,6 +870,7 @@ private:
   PROGMEM_STR m_fsCPMFileNotFound[]  PROGMEM = "File for user %02u not found";
   PROGMEM_STR m_fsCPMFileEmpty[]     PROGMEM = "The file is empty";
   PROGMEM_STR m_fsCPMNoFilesFound[]  PROGMEM = "File not found for all users";
+  PROGMEM_STR m_fsCPMDiskFull[]      PROGMEM = "\rAborted, disk or directory full";
   
   // IMD imager
 #else
@@ -773,6 +909,7 @@ private:
   PROGMEM_STR m_imdOptionErase[]     PROGMEM = "(E)rase disk\r\n";
   PROGMEM_STR m_imdOptionTests[]     PROGMEM = "(T)est FDC, drive seek and RPM\r\n";
   PROGMEM_STR m_imdOptionXlat[]      PROGMEM = "(D)ata rate translations\r\n";
+  PROGMEM_STR m_imdOptionStats[]     PROGMEM = "(S)tatistics of disk operations\r\n";
   PROGMEM_STR m_imdOptionReset[]     PROGMEM = "(Q)uit and re-enter settings\r\n\r\n";
   
   PROGMEM_STR m_imdTestFDC[]         PROGMEM = "(F)loppy controller write test\r\n";
@@ -863,14 +1000,21 @@ private:
                                                   m_errNoAddrMark, m_errBadTrack, m_chsFmtSTRegsSingle,
                                                   m_chsFmtSTRegsMulti, m_chsFmtSingleSector, m_chsFmtMultiSector,
                                                   m_errTrack0Error, m_errTryFormat,
+                                                  
+                                                  m_statsTimings, m_statsNone, m_statsRead, m_statsWrite, m_statsFormat,
+                                                  m_statsReadID, m_statsSeek, m_statsRecalibrate, m_statsTiming, m_statsPhases,
+                                                  m_statsPhase, m_statsRetries, m_statsInPlace, m_statsSeekAway,
+                                                  m_statsRecalibrated, m_statsRetry, m_statsFreeMemory, m_traceSignature,
+                                                  m_formatHeadSkew, m_formatCylinderSkew, m_formatSkew,
 
 #ifndef BUILD_IMD_IMAGER
                                                   m_cmdHelp,                                                              
                                                   m_cmdSupportedIndex,
-                                                  m_cmdReset, m_cmdDrivParm, m_cmdPersist, m_cmdFormat, m_cmdVerify, m_cmdImage,
+                                                  m_cmdReset, m_cmdDrivParm, m_cmdPersist, m_cmdFormat, m_cmdVerify, m_cmdImage, m_cmdStats, m_cmdTrace, m_cmdCalibrate,
+                                                  m_cmdInterleave,
                                                   m_cmdFSIndex,
                                                   m_cmdQuickFormat, m_cmdPath, m_cmdCd, m_cmdMd, m_cmdRd, m_cmdDir,
-                                                  m_cmdType, m_cmdTypeInto, m_cmdDel, m_cmdXfer,
+                                                  m_cmdType, m_cmdTypeInto, m_cmdDel, m_cmdXfer, m_cmdDefrag,
                                                   m_cmdEndIndex,
                                                   
                                                   m_varCd1, m_varCd2, m_varCd3,
@@ -879,13 +1023,20 @@ private:
                                                   m_helpDrivParm1, m_helpDrivParm2, m_helpCurrentDrive, 
                                                   m_helpPersist1, m_helpPersist2, m_helpPersist3, m_helpFormat1,
                                                   m_helpFormat2, m_helpVerify1, m_helpVerify2, m_helpImage1, 
-                                                  m_helpImage2, m_helpImage3, m_helpQuickFormat1, m_helpQuickFormat2,
+                                                  m_helpImage2, m_helpImage3, m_helpStats1, m_helpStats2, m_helpStats3,
+                                                  m_helpTrace1, m_helpTrace2, m_helpTrace3, m_traceSending,
+                                                  m_helpCalibrate1, m_helpCalibrate2, m_helpCalibrate3, m_calibrateResult, m_calibrateStepRate,
+                                                  m_calibrateTimesKept, m_calibrateSRTKept,
+                                                  m_helpInterleave1, m_helpInterleave2, m_helpInterleave3, m_interleaveScratch,
+                                                  m_interleaveTimings, m_interleaveTiming, m_interleaveResult,
+                                                  m_helpQuickFormat1, m_helpQuickFormat2,
                                                   m_helpPath1, m_helpPath2, m_helpPath3,
                                                   m_helpPath4, m_helpCd1, m_helpCd2, m_helpCd3, m_helpCd4,
                                                   m_helpDir1, m_helpDir2, m_helpDir3, m_helpDel1, m_helpDel2,
                                                   m_helpType1, m_helpType2, m_helpMd1, m_helpMd2, 
                                                   m_helpRd1, m_helpRd2, m_helpTypeInto1, m_helpTypeInto2, 
                                                   m_helpTypeInto3, m_helpXfer1, m_helpXfer2,
+                                                  m_helpDefrag1, m_helpDefrag2, m_helpDefrag3,
                                                   
                                                   m_waitingForDrives, m_countDrives, m_specifyParams1, m_specifyParams2, 
                                                   m_driveInches, m_drive8InchText1, m_drive8InchText2, m_drive8InchText3, 
@@ -906,7 +1057,7 @@ private:
                                                   m_drivParmCaption, m_drivParmTypeText, m_drivParmType8SD, m_drivParmType8DD,
                                                   m_drivParmType5DD, m_drivParmType5HD, m_drivParmType3DD, m_drivParmType3HD, m_drivParmType3ED,
                                                   m_drivParmDoubleStep, m_drivParmDiskChange, m_drivParmSRT, m_drivParmHLT,
-                                                  m_drivParmHUT, m_drivParmCyls, m_drivParmHeads, m_drivParmHeadsOne,
+                                                  m_drivParmHUT, m_drivParmSpinUp, m_drivParmSettle, m_drivParmInterleave, m_drivParmCyls, m_drivParmHeads, m_drivParmHeadsOne,
                                                   m_drivParmHeadsTwo, m_drivParmSpt,  m_drivParmSectorSize, m_drivParmEncoding,
                                                   m_drivParmFM, m_drivParmMFM, m_drivParmDataRate, m_drivParmFDCRate,
                                                   m_drivParmKbps, m_drivParmMbps, m_drivParmSectorGap, m_drivParmFormatGap,
@@ -922,18 +1073,21 @@ private:
                                                   m_xferReadFile, m_xferSaveFile, m_imageReadDisk, m_imageWriteDisk,
                                                   m_imageTransferLen, m_imageGeometry, m_xmodemUse1k, m_xmodemPrefix,
                                                   m_xmodem1kPrefix, m_xmodemWaitSend, m_xmodemWaitRecv, m_xmodemTransferEnd,
-                                                  m_xmodemTransferFail,
+                                                  m_xmodemTransferFail, m_xmodemRevsPerTrack,
                                                   
                                                   m_dirDirectory, m_dirDirectoryEmpty, m_dirBytesFormat, m_dirBytesFree,
                                                   m_dirCPMUser, m_dirCPMBytes, m_dirCPMKilobytes, m_dirCPMEmpty, m_dirCPMSummary,
                                                   
                                                   m_typeIntoCaption,
                                                   
-                                                  m_fsCurrentDrive, m_fsForbiddenCharFAT, m_fsForbiddenCharCPM, m_fsDiskError,
+                                                  m_defragTempName, m_defragOldName, m_defragNameFile, m_defragFragments,
+                                                  m_defragSystemFile, m_defragNoRoom, m_defragNamesTaken, m_defragSeeks,
+                                                  
+                                                  m_fsCurrentDrive, m_fsForbiddenCharFAT, m_fsForbiddenCharCPM, m_fsDiskError, m_fsWritesLost,
                                                   m_fsInternalError, m_fsFileNotFound, m_fsPathNotFound, m_fsDirectoryFull,
                                                   m_fsFileExists, m_fsInvalidObject, m_fsNoVolumeWorkArea, m_fsMkfsError, m_fsNoFAT,
                                                   m_fsMemoryError, m_fsInvalidParameter, m_fsCPMFileNotFound, m_fsCPMFileEmpty,
-                                                  m_fsCPMNoFilesFound                                                  
+                                                  m_fsCPMNoFilesFound, m_fsCPMDiskFull                                                  
 #else
                                                   m_imdSplash, m_imdLCDRecommended, m_imdDriveLetter, m_imdDriveType, m_imdDriveCyls,
                                                   m_imdDoubleStepAuto, m_imdDoubleStep, m_imdDiskSidesAuto, m_imdDiskSides, m_imdInterleave, 
@@ -944,7 +1098,7 @@ private:
                                                   m_imdInsertRead, m_imdInsertWrite, m_imdNoteTestWrite, m_imdNoteNoFS, m_imdMemoryError,
   
                                                   m_imdOptionRead, m_imdOptionWrite, m_imdOptionFormat, m_imdOptionErase, 
-                                                  m_imdOptionTests, m_imdOptionXlat, m_imdOptionReset,
+                                                  m_imdOptionTests, m_imdOptionXlat, m_imdOptionStats, m_imdOptionReset,
                                                   
                                                   m_imdTestFDC, m_imdTestDrive, m_imdTestSkipped, m_imdTestController, m_imdTestHD, 
                                                   m_imdTestED, m_imdTest8inch, m_imdTestMFM128, m_imdTestMedia, 
@@ -1,19 +1,19 @@
 // MegaFDC diskio overrides
 // (c) 2023-2024 J. Bogin
 
-#include "..\..\config.h" // we
+#include "../../config.h" // we
 
 #ifndef BUILD_IMD_IMAGER
 
 #include "diskio.h"
 
-// disk rwBuffer[0...511] is current 512B FAT sector data (FatFs operates in single sectors)
-// minimum SECTOR_BUFFER_SIZE is 1K to support 8" DSDD, so use the upper half for FAT file data window
-// FATFS::win still holds directory and FAT information
+// the last 512B of disk rwBuffer are the FAT file data window, FATFS::win still holds directory and FAT information
+// everything below it takes the sectors of one disk_read or disk_write command, as many as fit there at a time
 BYTE* get_file_window()
 {
-  return &g_rwBuffer[512];
+  return &g_rwBuffer[SECTOR_BUFFER_SIZE - FF_MAX_SS];
 }
+#define DISKIO_BUFFER_SIZE (SECTOR_BUFFER_SIZE - FF_MAX_SS)
 #if SECTOR_BUFFER_SIZE < 1024
 #error Minimum sector buffer size is 1K
 #endif
@@ -30,79 +30,357 @@ DSTATUS disk_initialize(BYTE pdrv)
   return 0;
 }
 
-DRESULT disk_read(BYTE pdrv, BYTE *buf, DWORD sec, UINT count)
+// sector cache in the part below the file window, one 512B slot per sector:
+// a read miss reads on to the end of the track (or of the buffer) and the sectors after it are served from there,
+// writes stay in their slots until CTRL_SYNC, a read miss or a full cache flushes them, in track order
+// anything else reading or writing the disk goes through the same buffer, so the FDC count of those commands must not have moved;
+// dirty slots overwritten by another command fail the next disk_read or disk_write, fatMount() reports them lost on a remount
+#define DISKIO_SLOTS (DISKIO_BUFFER_SIZE / FF_MAX_SS)
+#if DISKIO_SLOTS > 8
+#error Dirty slots are a bitmask in a byte
+#endif
+DWORD cacheSector[DISKIO_SLOTS];
+BYTE cacheCount = 0;
+BYTE cacheDirty = 0;
+BYTE cacheDrive;
+WORD cacheBufferChanges;
+
+// drop what was read ahead, sectors not written out yet stay in their slots
+void disk_invalidate_cache()
 {
-  // FATFS operates in single sectors
-  if ((count != 1) || (sec > fdc->getTotalSectorCount()))
+  if (!cacheDirty)
   {
-    return RES_PARERR;
+    cacheCount = 0;
+    return;
   }
   
-  BYTE cyl;
-  BYTE head;
-  BYTE sector;
-  fdc->convertLogicalSectorToCHS(sec, cyl, head, sector);
+  for (BYTE slot = 0; slot < cacheCount; slot++)
+  {
+    if (!(cacheDirty & (1 << slot)))
+    {
+      cacheSector[slot] = 0xFFFFFFFF; // past any disk, never found
+    }
+  }
+}
+
+// drop everything, the sectors not written out yet included
+void disk_discard_cache()
+{
+  cacheCount = 0;
+  cacheDirty = 0;
+}
+
+int disk_cache_dirty()
+{
+  return cacheDirty != 0;
+}
+
+// the cache is still what we left there; if not, and sectors were waiting to be written out, they are lost
+DRESULT disk_cache_check()
+{
+  if ((cacheDrive == fdc->getParams()->DriveNumber) && (cacheBufferChanges == fdc->getBufferChanges()))
+  {
+    return RES_OK;
+  }
   
-  // seek, if necessary
-  if ((fdc->getCurrentCylinder() != cyl) || (fdc->getCurrentHead() != head))
+  const bool dirty = cacheDirty;
+  disk_discard_cache();
+  return dirty ? RES_ERROR : RES_OK;
+}
+
+void disk_cache_owned()
+{
+  cacheDrive = fdc->getParams()->DriveNumber;
+  cacheBufferChanges = fdc->getBufferChanges();
+}
+
+// nothing but us read or wrote this drive since our last command
+int disk_untouched()
+{
+  return (cacheDrive == fdc->getParams()->DriveNumber) && (cacheBufferChanges == fdc->getBufferChanges());
+}
+
+// slot of a sector, 0xFF if not cached
+BYTE disk_cache_find(DWORD sec)
+{
+  for (BYTE slot = 0; slot < cacheCount; slot++)
   {
-    fdc->seekDrive(cyl, head);
+    if (cacheSector[slot] == sec)
+    {
+      return slot;
+    }
   }
+  
+  return 0xFF;
+}
+
+DRESULT disk_error()
+{
+  disk_invalidate_cache();
+  if (fdc->wasErrorNoDiskInDrive())
+  {
+    return RES_NOTRDY;
+  }
+  
+  else if (fdc->wasErrorDiskProtected())
+  {
+    return RES_WRPRT;
+  }
+  
+  return RES_ERROR;
+}
+
+// write out the dirty slots, the sectors stay cached
+DRESULT disk_flush()
+{
+  if (!cacheDirty)
+  {
+    return RES_OK;
+  }
+  
+  // our own writes do not make the disk look changed to the next mount
+  const bool diskChangeInquired = fdc->wasDiskChangeInquired();
+  
+  // sort the slots by sector, so that adjacent ones on a track are adjacent in the buffer
+  for (BYTE slot = 0; slot < cacheCount; slot++)
+  {
+    BYTE lowest = slot;
+    for (BYTE next = slot + 1; next < cacheCount; next++)
+    {
+      if (cacheSector[next] < cacheSector[lowest])
+      {
+        lowest = next;
+      }
+    }
     
-  // read 1 sector
-  fdc->readWriteSectors(false, sector, sector);
-  if (fdc->getLastError())
+    if (lowest == slot)
+    {
+      continue;
+    }
+    
+    const DWORD sec = cacheSector[slot];
+    cacheSector[slot] = cacheSector[lowest];
+    cacheSector[lowest] = sec;
+    
+    const BYTE dirty = (cacheDirty >> slot) & 1;
+    cacheDirty = (cacheDirty & ~(1 << slot)) | (((cacheDirty >> lowest) & 1) << slot);
+    cacheDirty = (cacheDirty & ~(1 << lowest)) | (dirty << lowest);
+    
+    for (WORD index = 0; index < FF_MAX_SS; index++)
+    {
+      const BYTE data = g_rwBuffer[(slot * FF_MAX_SS) + index];
+      g_rwBuffer[(slot * FF_MAX_SS) + index] = g_rwBuffer[(lowest * FF_MAX_SS) + index];
+      g_rwBuffer[(lowest * FF_MAX_SS) + index] = data;
+    }
+  }
+  
+  // one command per run of adjacent sectors on a track, from its first dirty one to the last
+  BYTE first = 0;
+  while (first < cacheCount)
   {
-    if (fdc->wasErrorNoDiskInDrive())
+    if (!(cacheDirty & (1 << first)))
     {
-      return RES_NOTRDY;
+      first++;
+      continue;
     }
-
-    return RES_ERROR;
+    
+    BYTE cyl;
+    BYTE head;
+    BYTE sector;
+    fdc->convertLogicalSectorToCHS(cacheSector[first], cyl, head, sector);
+    
+    BYTE last = first;
+    for (BYTE next = first + 1; next < cacheCount; next++)
+    {
+      const BYTE distance = next - first;
+      if ((cacheSector[next] != cacheSector[first] + distance) || (sector + distance > fdc->getParams()->SectorsPerTrack))
+      {
+        break;
+      }
+      
+      if (cacheDirty & (1 << next))
+      {
+        last = next;
+      }
+    }
+    
+    // the run on the next cylinder comes right after the last one, not settled the head would miss sector 1 past the index
+    // and the command gives up on the second index pulse; a step is not left to an implied seek
+    if (fdc->getCurrentCylinder() != cyl)
+    {
+      fdc->seekDrive(cyl, head);
+      delay(fdc->getSettleTime(fdc->getParams()->DriveNumber));
+    }
+    else if (fdc->getCurrentHead() != head)
+    {
+      fdc->seekDrive(cyl, head, true);
+    }
+    
+    WORD position = first * FF_MAX_SS;
+    fdc->readWriteSectors(true, sector, sector + last - first, &position);
+    if (fdc->getLastError())
+    {
+      return disk_error();
+    }
+    
+    first = last + 1;
   }
   
-  memmove(buf, g_rwBuffer, fdc->getParams()->SectorSizeBytes);
+  cacheDirty = 0;
+  disk_cache_owned();
+  if (diskChangeInquired)
+  {
+    fdc->setDiskChangeInquired();
+  }
   return RES_OK;
 }
 
-
-// analog to the one above
-DRESULT disk_write(BYTE pdrv, BYTE *buf, DWORD sec, UINT count)
+// 16-bit rotating sum of the boot sector, to tell disks apart on drives without a change line
+// read to the file window with the cache slots left as they are
+DRESULT disk_boot_checksum(WORD* checksum)
 {
-  if ((count != 1) || (sec > fdc->getTotalSectorCount()))
+  const bool untouched = disk_untouched();
+  
+  if ((fdc->getCurrentCylinder() != 0) || (fdc->getCurrentHead() != 0))
   {
-    return RES_PARERR;
+    fdc->seekDrive(0, 0, true);
   }
   
-  BYTE cyl;
-  BYTE head;
-  BYTE sector;
-  fdc->convertLogicalSectorToCHS(sec, cyl, head, sector);
+  WORD position = DISKIO_BUFFER_SIZE;
+  fdc->readWriteSectors(false, 1, 1, &position);
+  if (fdc->getLastError())
+  {
+    return disk_error();
+  }
   
-  memcpy(g_rwBuffer, buf, fdc->getParams()->SectorSizeBytes);
+  const BYTE* boot = get_file_window();
+  *checksum = 0;
+  for (WORD index = 0; index < FF_MAX_SS; index++)
+  {
+    *checksum = ((*checksum << 1) | (*checksum >> 15)) + boot[index];
+  }
   
-  if ((fdc->getCurrentCylinder() != cyl) || (fdc->getCurrentHead() != head))
+  if (untouched)
   {
-    fdc->seekDrive(cyl, head);
+    disk_cache_owned();
   }
-    
-  // write
-  fdc->readWriteSectors(true, sector, sector);
-  if (fdc->getLastError())
+  return RES_OK;
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE *buf, DWORD sec, UINT count)
+{
+  // FatFs reads contiguous sectors of a cluster at once, straight into the caller's buffer
+  if (!count || (sec + count > fdc->getTotalSectorCount()))
+  {
+    return RES_PARERR;
+  }
+  
+  DRESULT result = disk_cache_check();
+  if (result != RES_OK)
   {
-    if (fdc->wasErrorNoDiskInDrive())
+    return result;
+  }
+  
+  while (count)
+  {
+    // hit
+    const BYTE slot = disk_cache_find(sec);
+    if (slot != 0xFF)
+    {
+      memcpy(buf, &g_rwBuffer[slot * FF_MAX_SS], FF_MAX_SS);
+      buf += FF_MAX_SS;
+      sec++;
+      count--;
+      continue;
+    }
+    
+    // the read-ahead takes the whole buffer, written sectors go out first
+    result = disk_flush();
+    if (result != RES_OK)
+    {
+      return result;
+    }
+    
+    BYTE cyl;
+    BYTE head;
+    BYTE sector;
+    fdc->convertLogicalSectorToCHS(sec, cyl, head, sector);
+    
+    // seek, if necessary
+    if ((fdc->getCurrentCylinder() != cyl) || (fdc->getCurrentHead() != head))
     {
-      return RES_NOTRDY;
+      fdc->seekDrive(cyl, head, true);
     }
     
-    else if (fdc->wasErrorDiskProtected())
+    // up to the end of track or of the buffer in one command, whether asked for or not
+    BYTE chunk = fdc->getMaximumSectorCountForRW(sector, DISKIO_BUFFER_SIZE);
+    fdc->readWriteSectors(false, sector, sector + chunk - 1);
+    
+    // a bad sector past the ones asked for is not our business, read just those
+    if (fdc->getLastError() && (chunk > count) && !fdc->wasErrorNoDiskInDrive())
+    {
+      chunk = count;
+      fdc->readWriteSectors(false, sector, sector + chunk - 1);
+    }
+    
+    if (fdc->getLastError())
+    {
+      return disk_error();
+    }
+    
+    for (cacheCount = 0; cacheCount < chunk; cacheCount++)
+    {
+      cacheSector[cacheCount] = sec + cacheCount;
+    }
+    disk_cache_owned();
+  }
+  
+  return RES_OK;
+}
+
+// written into the cache, rewriting a sector there (FAT, directory) only changes the slot
+DRESULT disk_write(BYTE pdrv, BYTE *buf, DWORD sec, UINT count)
+{
+  if (!count || (sec + count > fdc->getTotalSectorCount()))
+  {
+    return RES_PARERR;
+  }
+  
+  DRESULT result = disk_cache_check();
+  if (result != RES_OK)
+  {
+    return result;
+  }
+  
+  while (count)
+  {
+    BYTE slot = disk_cache_find(sec);
+    if (slot == 0xFF)
     {
-      return RES_WRPRT;
+      // full, write it out and start over
+      if (cacheCount == DISKIO_SLOTS)
+      {
+        result = disk_flush();
+        if (result != RES_OK)
+        {
+          return result;
+        }
+        
+        cacheCount = 0;
+      }
+      
+      slot = cacheCount++;
+      cacheSector[slot] = sec;
     }
     
-    return RES_ERROR;
+    memcpy(&g_rwBuffer[slot * FF_MAX_SS], buf, FF_MAX_SS);
+    cacheDirty |= 1 << slot;
+    buf += FF_MAX_SS;
+    sec++;
+    count--;
   }
   
+  disk_cache_owned();
   return RES_OK;
 }
 
@@ -114,7 +392,7 @@ DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void* buff)
   switch (cmd)
   {
   case CTRL_SYNC: 
-    res = RES_OK; 
+    res = disk_flush(); 
     break;
 
   case GET_SECTOR_COUNT:
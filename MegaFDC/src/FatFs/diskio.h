@@ -32,6 +32,11 @@ typedef enum {
 /* Prototypes for disk control functions */
 
 BYTE* get_file_window();
+void disk_invalidate_cache();
+void disk_discard_cache();
+int disk_cache_dirty();
+int disk_untouched();
+DRESULT disk_boot_checksum(WORD* checksum);
 DSTATUS disk_initialize (BYTE pdrv);
 DSTATUS disk_status (BYTE pdrv);
 DRESULT disk_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count);
@@ -46,7 +46,11 @@ typedef unsigned __int64 QWORD;
 #elif (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L) || defined(__cplusplus)	/* C99 or later */
 #define FF_INTDEF 2
 #include <stdint.h>
+#ifdef MEGAFDC_HOST
+typedef uint16_t		UINT;	/* MegaFDC host build: 16-bit as on the AVR */
+#else
 typedef unsigned int	UINT;	/* int must be 16-bit or 32-bit */
+#endif
 typedef unsigned char	BYTE;	/* char must be 8-bit */
 typedef uint16_t		WORD;	/* 16-bit unsigned integer */
 typedef uint32_t		DWORD;	/* 32-bit unsigned integer */
@@ -14,7 +14,11 @@
 #endif
 
 // reset by null pointer function call
+#ifndef MEGAFDC_HOST
 void (*resetBoard)() = NULL;
+#else
+void (*resetBoard)() = hostResetBoard;
+#endif
 
 // singleton, needs to be constructed during setup()
 Ui::Ui()
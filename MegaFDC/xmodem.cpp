@@ -9,12 +9,60 @@ WORD totalSectorsCount;
 WORD badSectorsCount;
 bool success;
 
+// during disk image transfers the serial line is driven from here instead of the Arduino core:
+// the FDC data ISRs run with interrupts disabled for whole sectors, so the core's USART ISRs would stall
+// the Timer4 ISR and the idle loops of the FDC ISRs move the bytes with xmodemSerialPump() instead
+volatile bool xmSerialActive = false;
+const BYTE* volatile xmTxData;
+volatile WORD xmTxCount;
+volatile BYTE* xmRxBuffer;
+WORD xmRxMask;          // ring size - 1, size a power of 2
+volatile BYTE xmRxReplyBuffer[16];
+volatile WORD xmRxHead;
+volatile WORD xmRxTail;
+BYTE xmTxByte;
+DWORD xmSerialByteTime; // microseconds per byte on the serial line
+
+// disk work done while waiting for the serial line
+void (*xmBackgroundTask)() = NULL;
+
+ISR(TIMER4_COMPA_vect)
+{
+  xmodemSerialPump();
+}
+
+// bytes in the receive ring
+WORD xmodemRxPending()
+{
+  cli();
+  const WORD head = xmRxHead;
+  sei();
+  return (head - xmRxTail) & xmRxMask;
+}
+
 int xmodemRx(int msDelay) 
 { 
   const DWORD start = millis();
   while ((millis()-start) < msDelay)
   { 
-    if (Serial.available())
+    // every call, the disk needs the next command in time even while a packet is coming in
+    if (xmBackgroundTask)
+    {
+      xmBackgroundTask();
+    }
+    
+    if (xmSerialActive)
+    {
+      if (xmodemRxPending())
+      {
+        const BYTE data = xmRxBuffer[xmRxTail];
+        cli();
+        xmRxTail = (xmRxTail+1) & xmRxMask;
+        sei();
+        return data;
+      }
+    }
+    else if (Serial.available())
     {
       return (BYTE)Serial.read();
     }
@@ -25,7 +73,71 @@ int xmodemRx(int msDelay)
 
 void xmodemTx(const char *data, int size)
 {  
-  Serial.write((const BYTE*)data, size);
+  if (!xmSerialActive)
+  {
+    Serial.write((const BYTE*)data, size);
+    return;
+  }
+  
+  // previous data still going out; packets are acknowledged before the next one is built, so this is mostly single bytes
+  while (xmTxCount)
+  {
+    HOST_POLL_DELAY();
+  }
+  
+  // XMODEM sends single bytes from its stack, packets from its own buffer that stays put until acknowledged
+  if (size == 1)
+  {
+    xmTxByte = *data;
+    data = (const char*)&xmTxByte;
+  }
+  
+  cli();
+  xmTxData = (const BYTE*)data;
+  xmTxCount = size;
+  xmodemSerialPump();
+  sei();
+}
+
+// take USART0 over from the Arduino core for an image transfer
+void xmodemSerialStart(volatile BYTE* rxBuffer, WORD rxSize)
+{
+  // let the core send out what it has, then stop its receive ISR and move over what it has received
+  Serial.flush();
+  UCSR0B &= ~(1 << RXCIE0);
+  xmRxBuffer = rxBuffer;
+  xmRxMask = rxSize - 1;
+  xmRxHead = xmRxTail = 0;
+  while (Serial.available() && (xmRxHead < xmRxMask))
+  {
+    xmRxBuffer[xmRxHead++] = Serial.read();
+  }
+  xmTxCount = 0;
+  
+  // Timer4 in CTC mode, F_CPU/8, compare match twice per byte on the line
+  const DWORD byteCycles = 10UL * ((UCSR0A & (1 << U2X0)) ? 8 : 16) * (UBRR0 + 1);
+  xmSerialByteTime = byteCycles / (F_CPU / 1000000UL);
+  TCCR4A = 0;
+  TCCR4B = (1 << WGM42) | (1 << CS41);
+  TCNT4 = 0;
+  OCR4A = (byteCycles / 16) - 1;
+  xmSerialActive = true;
+  TIMSK4 = (1 << OCIE4A);
+}
+
+// give it back, anything left unread is dumped afterwards
+void xmodemSerialStop()
+{
+  while (xmTxCount)
+  {
+    HOST_POLL_DELAY();
+  }
+  
+  TIMSK4 = 0;
+  TCCR4B = 0;
+  xmSerialActive = false;
+  xmBackgroundTask = NULL;
+  UCSR0B |= (1 << RXCIE0);
 }
 
 // dump serial transfer if not successful
@@ -60,153 +172,448 @@ void dumpSerialTransfer()
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-// 2 callbacks to send over disk image files
-// data sent over XMODEM in 128 or 1024 byte chunks
-bool xmodemImageRxCallback(DWORD no, BYTE* data, WORD size)
-{ 
-  // break on overflow
-  if (xmDataPos + size > SECTOR_BUFFER_SIZE)
+// image transfers use the disk R/W buffer as a ring of whole sectors: the disk reads ahead into it or writes out of it
+// with overlapped commands, run from xmodemRx() while XMODEM waits on the serial line, so both keep going at once
+// on writes, the serial receive ring takes the end of the buffer
+WORD xmRingSize;        // bytes, whole sectors
+WORD xmRingFill;        // read: data from disk not sent yet; write: data received not written yet
+bool xmDiskBusy;        // overlapped command issued
+BYTE xmDiskStartSector;
+BYTE xmDiskSectorCount;
+bool xmDiskMultiTrack;  // head 0 through head 1 in one command, the FDC switches heads (MT bit)
+
+// a write keeps interrupts disabled from the command on, while the next packet may be coming in over serial
+// so write commands are issued only a little before their sector comes under the head, and kept short
+DWORD xmReferenceTime;  // end of the last transfer and its last sector, tell the rotational position
+BYTE xmReferenceSector;
+bool xmReferenceValid;
+BYTE xmReferenceCyl;    // and the track it was on
+BYTE xmReferenceHead;
+DWORD xmSettledTime;    // after a step
+DWORD xmSlotTime;       // microseconds per sector on the track, with its ID and gaps
+DWORD xmIndexTime;      // what the gap at the index takes longer than the others
+DWORD xmSectorTime;     // the data field alone
+
+// a disk formatted with skew has each track rotated against the previous one, in sectors from the index
+// learned on the first track change of either kind, so that the following ones are known in advance; 0xFF not yet
+BYTE xmReferenceRotation;
+BYTE xmHeadSkew;
+BYTE xmCylinderSkew;
+
+// disk revolutions spent per track
+DWORD xmRevolutionTime; // microseconds per revolution, measured before the transfer
+DWORD xmSectorPitch;    // and from one ID to the next
+DWORD xmCommandStart;
+BYTE xmTrackCyl;
+BYTE xmTrackHead;
+BYTE xmTrackSides;      // 2 if the current track was done together with the other side
+DWORD xmTrackTime;      // disk time spent on the current track: seeks, rotational waits and transfers
+DWORD xmTotalTrackTime;
+DWORD xmMaxTrackTime;
+WORD xmTracks;
+
+void xmodemEndOfTrack()
+{
+  if (!xmTrackTime)
   {
-    success = false;
-    return false;
+    return;
   }
   
-  // copy data to RW buffer
-  memcpy(&g_rwBuffer[xmDataPos], data, size);
-  xmDataPos += size;  
- 
-  if (xmDataPos == SECTOR_BUFFER_SIZE)
+  xmTotalTrackTime += xmTrackTime;
+  xmMaxTrackTime = max(xmMaxTrackTime, xmTrackTime / xmTrackSides);
+  xmTracks += xmTrackSides;
+  xmTrackTime = 0;
+}
+
+// EOT of the command issued; with MT it is the last sector of head 1, ending both heads
+BYTE xmodemDiskEndSector()
+{
+  return xmDiskMultiTrack ? fdc->getParams()->SectorsPerTrack : xmDiskStartSector + xmDiskSectorCount-1;
+}
+
+void xmodemInitRing(WORD bufferSize)
+{
+  const WORD sectorSize = fdc->getParams()->SectorSizeBytes;
+  xmRingSize = (bufferSize / sectorSize) * sectorSize;
+  xmRingFill = 0;
+  xmDiskBusy = false;
+  xmReferenceValid = false;
+  xmReferenceRotation = 0;
+  xmHeadSkew = xmCylinderSkew = 0xFF;
+  xmSettledTime = fdcMicros();
+  
+  FDC::DiskDriveMediaParams* params = fdc->getParams();
+  xmSectorTime = ((DWORD)sectorSize * 8000UL * (params->FM ? 2 : 1)) / params->CommRate;
+  xmSlotTime = xmSectorPitch ? xmSectorPitch : xmRevolutionTime ? xmRevolutionTime / params->SectorsPerTrack : xmSectorTime;
+  xmIndexTime = 0;
+  if (xmRevolutionTime > xmSlotTime * params->SectorsPerTrack)
   {
-    // flush buffer to disk
-    xmDataPos = xmRWPos = 0;  
+    xmIndexTime = xmRevolutionTime - (xmSlotTime * params->SectorsPerTrack);
   }
-  else
+  
+  xmTrackTime = xmTotalTrackTime = xmMaxTrackTime = 0;
+  xmTracks = 0;
+  xmTrackCyl = xmTrackHead = 0xFF;
+  xmTrackSides = 1;
+}
+
+// start an overlapped read or write of the sectors at totalSectorsCount into or from xmRWPos
+// no more than till end of track, end of the ring, maxBytes and maxSectors
+// if the rest of head 0 and all of head 1 fit in there, both go in one multi-track command
+void xmodemBeginDiskIO(bool writeOperation, WORD maxBytes, BYTE maxSectors)
+{
+  // ring empty: start over at its beginning, for the longest command possible
+  if (!xmRingFill)
   {
-    // continue filling up
-    return true;
+    xmRWPos = xmDataPos = 0;
+  }
+  
+  BYTE cyl;
+  BYTE head;
+  fdc->convertLogicalSectorToCHS(totalSectorsCount, cyl, head, xmDiskStartSector);
+  const WORD bytes = min(maxBytes, xmRingSize - xmRWPos);
+  xmDiskSectorCount = min(fdc->getMaximumSectorCountForRW(xmDiskStartSector, bytes), maxSectors);
+  
+  // the FDC cannot be stopped on head 1 without TC, so it is the whole of it or nothing
+  const BYTE multiTrackCount = head ? 0 : fdc->getMaximumSectorCountForMT(xmDiskStartSector, bytes);
+  xmDiskMultiTrack = multiTrackCount && (multiTrackCount <= maxSectors);
+  if (xmDiskMultiTrack)
+  {
+    xmDiskSectorCount = multiTrackCount;
+  }
+  
+  if ((cyl != xmTrackCyl) || (head != xmTrackHead))
+  {
+    xmodemEndOfTrack();
+    xmTrackCyl = cyl;
+    xmTrackHead = head;
+    xmTrackSides = 1;
   }
+  if (xmDiskMultiTrack)
+  {
+    xmTrackSides = 2;
+  }
+  
+  ui->print(Progmem::getString(Progmem::diskIoProgress), cyl, head);
   
-  // write operation
-  while(xmRWPos != SECTOR_BUFFER_SIZE)
+  xmCommandStart = fdcMicros();
+  if ((fdc->getCurrentCylinder() != cyl) || (fdc->getCurrentHead() != head))
   {
-    if (totalSectorsCount >= fdc->getTotalSectorCount())
+    fdc->seekDrive(cyl, head, true);
+  }
+  
+  xmDiskBusy = fdc->beginReadWriteSectors(writeOperation, xmDiskStartSector, xmodemDiskEndSector(), xmRWPos, xmDiskMultiTrack);
+}
+
+// whether the sectors of a track can be told from the reference: the same track, or the skews on the way are known
+bool xmodemTrackRotationKnown(BYTE cyl, BYTE head)
+{
+  const bool headSkew = (xmHeadSkew != 0xFF) || (fdc->getParams()->Heads == 1);
+  return !xmReferenceValid || (((head == xmReferenceHead) || headSkew) && ((cyl == xmReferenceCyl) || ((xmCylinderSkew != 0xFF) && headSkew)));
+}
+
+// rotation of a track in sectors from the index, relative to the reference track and the skews known so far
+BYTE xmodemTrackRotation(BYTE cyl, BYTE head)
+{
+  FDC::DiskDriveMediaParams* params = fdc->getParams();
+  const int headSkew = (xmHeadSkew != 0xFF) ? xmHeadSkew : 0;
+  const int cylinderSkew = (xmCylinderSkew != 0xFF) ? xmCylinderSkew : 0;
+  const int skew = ((cyl - xmReferenceCyl) * (cylinderSkew + ((params->Heads - 1) * headSkew))) + ((head - xmReferenceHead) * headSkew);
+  const int rotation = (xmReferenceRotation + skew) % params->SectorsPerTrack;
+  return (rotation < 0) ? rotation + params->SectorsPerTrack : rotation;
+}
+
+// new reference, a sector whose data ended at endTime; on a new track, find out where its sectors lie from that
+void xmodemUpdateReference(BYTE cyl, BYTE head, BYTE sector, DWORD endTime, bool valid)
+{
+  const BYTE sectorsPerTrack = fdc->getParams()->SectorsPerTrack;
+  
+  if (valid && xmReferenceValid && xmRevolutionTime && ((cyl != xmReferenceCyl) || (head != xmReferenceHead)))
+  {
+    // sector ends from the old reference that come nearest to the time elapsed, the index gap once on the way
+    const BYTE from = (xmReferenceSector - 1 + xmReferenceRotation) % sectorsPerTrack;
+    const DWORD elapsed = (endTime - xmReferenceTime) % xmRevolutionTime;
+    BYTE slots = 0;
+    DWORD nearest = xmRevolutionTime;
+    for (BYTE count = 0; count < sectorsPerTrack; count++)
     {
-      // end of disk reached, transfer over
-      return false;
+      const DWORD time = (count * xmSlotTime) + ((from + count >= sectorsPerTrack) ? xmIndexTime : 0);
+      const DWORD distance = (time > elapsed) ? min(time - elapsed, elapsed + xmRevolutionTime - time) : min(elapsed - time, time + xmRevolutionTime - elapsed);
+      if (distance < nearest)
+      {
+        nearest = distance;
+        slots = count;
+      }
     }
-
-    // convert current position to CHS    
-    BYTE cyl;
-    BYTE head;
-    BYTE startSector;
-    fdc->convertLogicalSectorToCHS(totalSectorsCount, cyl, head, startSector);
     
-    // how many sectors till end of track or SECTOR_BUFFER_SIZE constraint
-    const BYTE sectorCount = fdc->getMaximumSectorCountForRW(startSector, SECTOR_BUFFER_SIZE - xmRWPos);
-    const BYTE endSector = startSector + sectorCount-1;
+    const BYTE rotation = ((from + slots) + sectorsPerTrack - (sector - 1)) % sectorsPerTrack;
+    const BYTE skew = (rotation + sectorsPerTrack - xmReferenceRotation) % sectorsPerTrack;
     
-    ui->print(Progmem::getString(Progmem::diskIoProgress), cyl, head);
-    
-    // seek if needed, inform about cyl and head
-    if ((fdc->getCurrentCylinder() != cyl) || (fdc->getCurrentHead() != head))
+    // on to the other side, or on to the next cylinder from its last side
+    if ((cyl == xmReferenceCyl) && (head == 1) && (xmReferenceHead == 0))
     {
-      fdc->seekDrive(cyl, head);      
+      xmHeadSkew = skew;
     }
-    
-    // write    
-    fdc->readWriteSectors(true, startSector, endSector, &xmRWPos);
-    if (fdc->getLastError())
+    else if ((cyl == xmReferenceCyl + 1) && (head == 0) && (xmReferenceHead == fdc->getParams()->Heads - 1))
     {
-      // do not retry if disk is write protected or there is no disk in drive
-      if (fdc->wasErrorNoDiskInDrive() || fdc->wasErrorDiskProtected())
-      {
-        success = false;
-        return false;
-      }
-      
-      // mark bad sectors range
-      badSectorsCount += sectorCount;
+      xmCylinderSkew = skew;
+    }
+    xmReferenceRotation = rotation;
+  }
+  else if (valid && xmReferenceValid)
+  {
+    xmReferenceRotation = xmodemTrackRotation(cyl, head);
+  }
+  
+  xmReferenceTime = endTime;
+  xmReferenceSector = sector;
+  xmReferenceCyl = cyl;
+  xmReferenceHead = head;
+  xmReferenceValid = valid;
+}
+
+// collect the overlapped command, retry with the usual error handling if it failed; false if the transfer cannot go on
+bool xmodemEndDiskIO(bool writeOperation)
+{
+  xmDiskBusy = false;
+  if (!fdc->endReadWriteSectors() && !fdc->wasErrorNoDiskInDrive())
+  {
+    WORD position = xmRWPos;
+    fdc->readWriteSectors(writeOperation, xmDiskStartSector, xmodemDiskEndSector(), &position, false, NULL, NULL, xmDiskMultiTrack);
+  }
+  
+  xmTrackTime += fdcMicros() - xmCommandStart;
+  xmodemUpdateReference(xmTrackCyl, xmDiskMultiTrack ? 1 : xmTrackHead, xmodemDiskEndSector(), fdc->getTransferEndTime(), !fdc->getLastError());
+  
+  const WORD length = xmDiskSectorCount * fdc->getParams()->SectorSizeBytes;
+  if (fdc->getLastError())
+  {
+    // do not retry if disk is write protected or there is no disk in drive
+    if (fdc->wasErrorNoDiskInDrive() || (writeOperation && fdc->wasErrorDiskProtected()))
+    {
+      success = false;
+      return false;
     }
     
-    // increment RW buffer position
-    totalSectorsCount += sectorCount;
-    xmRWPos += fdc->getParams()->SectorSizeBytes * sectorCount;
+    // clear out offending bad sectors with 0s inside the disk R/W buffer, or just mark them when writing
+    if (!writeOperation)
+    {
+      memset((BYTE*)&g_rwBuffer[xmRWPos], 0, length);
+    }
+    badSectorsCount += xmDiskSectorCount;
   }
   
+  totalSectorsCount += xmDiskSectorCount;
+  xmRWPos = (xmRWPos + length) % xmRingSize;
+  if (writeOperation)
+  {
+    xmRingFill -= length;
+  }
+  else
+  {
+    xmRingFill += length;
+  }
   return true;
 }
 
-// transmit callback, analog to the one above
-bool xmodemImageTxCallback(DWORD no, BYTE* data, WORD size)
+// microseconds till the ID of a sector on the current track comes under the head, 0 if not known
+DWORD xmodemRotationalWait(BYTE sector)
+{
+  if (!xmReferenceValid || !xmRevolutionTime)
+  {
+    return 0;
+  }
+  
+  // sectors follow each other in order, the ID of the one after the reference is in the gap after its end
+  // around the track, the index gap comes in between; where that is, depends on how the tracks are rotated
+  const BYTE sectorsPerTrack = fdc->getParams()->SectorsPerTrack;
+  const BYTE from = (xmReferenceSector - 1 + xmReferenceRotation) % sectorsPerTrack;
+  const BYTE to = (sector - 1 + xmodemTrackRotation(fdc->getCurrentCylinder(), fdc->getCurrentHead())) % sectorsPerTrack;
+  DWORD arrival = (((to + sectorsPerTrack - from - 1) % sectorsPerTrack) * xmSlotTime) + ((xmSlotTime - xmSectorTime) / 2);
+  if (to <= from)
+  {
+    arrival += xmIndexTime;
+  }
+  const DWORD elapsed = (fdcMicros() - xmReferenceTime) % xmRevolutionTime;
+  return (arrival >= elapsed) ? arrival - elapsed : arrival + xmRevolutionTime - elapsed;
+}
+
+// disk side of an image read: once half of the ring is free, fill it up
+void xmodemReadStep()
+{
+  if (xmDiskBusy && (!fdc->isReadWriteDone() || !xmodemEndDiskIO(false)))
+  {
+    return;
+  }
+  
+  if (!success || (totalSectorsCount >= fdc->getTotalSectorCount()))
+  {
+    return;
+  }
+  
+  // a whole cylinder in one command if the ring can take it, otherwise right away if the disk can go on,
+  // before the following sector passes under the head
+  BYTE cyl;
+  BYTE head;
+  BYTE sector;
+  fdc->convertLogicalSectorToCHS(totalSectorsCount, cyl, head, sector);
+  const WORD multiTrackBytes = head ? 0 : fdc->getMaximumSectorCountForMT(sector, xmRingSize) * fdc->getParams()->SectorSizeBytes;
+  const WORD free = xmRingSize - xmRingFill;
+  if (free >= max(multiTrackBytes, xmRingSize / 2))
+  {
+    xmodemBeginDiskIO(false, free, 0xFF);
+  }
+}
+
+// microseconds the serial receive ring can go on without being read, with some reserve
+DWORD xmodemRxBudget()
+{
+  const WORD pending = xmodemRxPending();
+  if (pending + 32 >= xmRxMask)
+  {
+    return 0;
+  }
+  return (DWORD)(xmRxMask - 32 - pending) * xmSerialByteTime;
+}
+
+// disk side of an image write: write out whole sectors as they come in
+void xmodemWriteStep()
 {
-  bool endOfDisk = false;
+  if (xmDiskBusy && (!fdc->isReadWriteDone() || !xmodemEndDiskIO(true)))
+  {
+    return;
+  }
+  
+  // data beyond the end of disk is dropped
+  if (totalSectorsCount >= fdc->getTotalSectorCount())
+  {
+    xmRingFill = 0;
+    return;
+  }
+  if (!success)
+  {
+    return;
+  }
   
-  // read from disk until buffer full
-  while(xmRWPos != SECTOR_BUFFER_SIZE)
+  // on to the next track right away, the head settles while the data comes in
+  // a step is not left to an implied seek, which would settle only within the write command
+  BYTE cyl;
+  BYTE head;
+  BYTE sector;
+  fdc->convertLogicalSectorToCHS(totalSectorsCount, cyl, head, sector);
+  if ((fdc->getCurrentCylinder() != cyl) || (fdc->getCurrentHead() != head))
   {
-    if (totalSectorsCount >= fdc->getTotalSectorCount())
+    // the step keeps this loop busy till the seek is over, the receive ring takes what comes in meanwhile
+    const bool step = (fdc->getCurrentCylinder() != cyl);
+    if (step && (xmodemRxBudget() < (DWORD)fdc->getParams()->SRT * (fdc->getParams()->DoubleStepping ? 2000UL : 1000UL)))
     {
-      endOfDisk = true;
-      break;
+      return;
     }
-            
-    BYTE cyl;
-    BYTE head;
-    BYTE startSector;
-    fdc->convertLogicalSectorToCHS(totalSectorsCount, cyl, head, startSector);
-    
-    const BYTE sectorCount = fdc->getMaximumSectorCountForRW(startSector, SECTOR_BUFFER_SIZE - xmRWPos);
-    const BYTE endSector = startSector + sectorCount-1;
-    
-    ui->print(Progmem::getString(Progmem::diskIoProgress), cyl, head);
-    
-    if ((fdc->getCurrentCylinder() != cyl) || (fdc->getCurrentHead() != head))
+    fdc->seekDrive(cyl, head, !step);
+    if (step)
     {
-      fdc->seekDrive(cyl, head);
+      xmSettledTime = fdcMicros() + (fdc->getSettleTime(fdc->getParams()->DriveNumber) * 1000UL);
     }
-       
-    fdc->readWriteSectors(false, startSector, endSector, &xmRWPos);
-    if (fdc->getLastError())
+  }
+  
+  if (xmRingFill < fdc->getParams()->SectorSizeBytes)
+  {
+    return;
+  }
+  
+  // the first time on to the other side or to the next cylinder, how the track is rotated is not known yet
+  // the next ID passing under the head tells, its data ends a sector later; the ring must take what comes in till then
+  // if it never could, the first write on the track finds out instead
+  const DWORD readID = xmSlotTime + ((xmSlotTime - xmSectorTime) / 2);
+  if (!xmodemTrackRotationKnown(cyl, head) && (readID < (DWORD)(xmRxMask - 32) * xmSerialByteTime))
+  {
+    if (((long)(fdcMicros() - xmSettledTime) < 0) || (xmodemRxBudget() < readID))
     {
-      // write protect check skipped here as we are reading
-      if (fdc->wasErrorNoDiskInDrive())
-      {
-        success = false;
-        return false;
-      }
-      
-      // clear out offending bad sectors with 0s inside the disk R/W buffer
-      memset(&g_rwBuffer[xmRWPos], 0, sectorCount * fdc->getParams()->SectorSizeBytes);
-      badSectorsCount += sectorCount;
+      return;
     }
     
-    totalSectorsCount += sectorCount;
-    xmRWPos += fdc->getParams()->SectorSizeBytes * sectorCount;
+    BYTE passing;
+    const bool read = fdc->readSectorID(NULL, NULL, &passing);
+    xmodemUpdateReference(cyl, head, passing, fdcMicros() + xmSectorTime, read);
+  }
+  
+  // not while the head is still settling
+  const DWORD wait = xmodemRotationalWait(sector);
+  if ((long)(fdcMicros() + wait - xmSettledTime) < 0)
+  {
+    return;
   }
   
-  // last sector reached?
-  if (endOfDisk)
+  // the wait for the sector and the writing need to fit in what the receive ring can still take
+  // the first sector also takes its ID and gaps till the data, about half of what is not data in a slot
+  const DWORD budget = xmodemRxBudget();
+  const DWORD first = wait + xmSectorTime + ((xmSlotTime - xmSectorTime) / 2);
+  if (budget < first)
   {
-    if (xmDataPos >= xmRWPos)
+    return;
+  }
+  
+  xmodemBeginDiskIO(true, xmRingFill, ((budget - first) / xmSlotTime) + 1);
+}
+
+// 2 callbacks to send over disk image files
+// data sent over XMODEM in 128 or 1024 byte chunks
+bool xmodemImageRxCallback(DWORD no, BYTE* data, WORD size)
+{ 
+  // end of disk reached, transfer over
+  if (totalSectorsCount >= fdc->getTotalSectorCount())
+  {
+    return false;
+  }
+  
+  // copy data into the ring, waiting for the disk to make room
+  WORD copied = 0;
+  while (copied < size)
+  {
+    xmodemWriteStep();
+    if (!success)
     {
-      // buffer finished, transfer over
       return false;
     }
     
-    // buffer not yet finished, transfer the remainder
-    memcpy(data, &g_rwBuffer[xmDataPos], size);
-    xmDataPos += size;    
-    return true;
+    const WORD length = min(min(size - copied, xmRingSize - xmRingFill), xmRingSize - xmDataPos);
+    memcpy((BYTE*)&g_rwBuffer[xmDataPos], &data[copied], length);
+    copied += length;
+    xmRingFill += length;
+    xmDataPos = (xmDataPos + length) % xmRingSize;
   }
   
-  // not the end of disk, continuing read - copy rw buffer to data
-  memcpy(data, &g_rwBuffer[xmDataPos], size);
-  xmDataPos += size;
-  if (xmDataPos == xmRWPos) // buffer full, read disk at next call
+  xmodemWriteStep();
+  return success;
+}
+
+// transmit callback, analog to the one above
+bool xmodemImageTxCallback(DWORD no, BYTE* data, WORD size)
+{
+  WORD copied = 0;
+  while (copied < size)
   {
-    xmDataPos = xmRWPos = 0;  
+    xmodemReadStep();
+    if (!xmRingFill && (!success || (!xmDiskBusy && (totalSectorsCount >= fdc->getTotalSectorCount()))))
+    {
+      // end of disk and the buffer finished, transfer over; the last packet is padded with zeros
+      if (!success || !copied)
+      {
+        return false;
+      }
+      
+      memset(&data[copied], 0, size - copied);
+      break;
+    }
+    
+    const WORD length = min(min(size - copied, xmRingFill), xmRingSize - xmDataPos);
+    memcpy(&data[copied], (BYTE*)&g_rwBuffer[xmDataPos], length);
+    copied += length;
+    xmRingFill -= length;
+    xmDataPos = (xmDataPos + length) % xmRingSize;
   }
   
+  xmodemReadStep();
   return true;
 }
 
@@ -224,6 +631,8 @@ bool xmodemReadDiskIntoImageFile(bool useXMODEM_1K)
   
   // set auto motor off disabled during waits on serial
   fdc->setAutomaticMotorOff(false);
+  xmRevolutionTime = fdc->measureRevolutionTime(&xmSectorPitch);
+  xmodemInitRing(SECTOR_BUFFER_SIZE);
   
   ui->print("");
   ui->print(Progmem::getString(useXMODEM_1K ? Progmem::xmodem1kPrefix : Progmem::xmodemPrefix));
@@ -233,9 +642,23 @@ bool xmodemReadDiskIntoImageFile(bool useXMODEM_1K)
   ui->disableKeyboard(true);
   ui->setPrintDisabled(false, true);
   
+  // the disk starts filling the buffer while waiting for the receiver
+  xmodemSerialStart(xmRxReplyBuffer, sizeof(xmRxReplyBuffer));
+  xmBackgroundTask = xmodemReadStep;
+  
   XModem modem(xmodemRx, xmodemTx, xmodemImageTxCallback, useXMODEM_1K);
   bool result = modem.transmit() && success;
+  
+  // a read ahead still in progress when the transfer ended
+  if (xmDiskBusy)
+  {
+    while (!fdc->isReadWriteDone()) {};
+    fdc->endReadWriteSectors();
+  }
+  
+  xmodemSerialStop();
   dumpSerialTransfer();
+  xmodemEndOfTrack();
     
   fdc->seekDrive(0, 0);
   ui->setPrintDisabled(false, false);
@@ -244,6 +667,14 @@ bool xmodemReadDiskIntoImageFile(bool useXMODEM_1K)
   ui->print(Progmem::getString(Progmem::uiVT100ClearScreen));
   ui->print(Progmem::getString(Progmem::uiDeleteLine));
   
+  // disk revolutions spent per track, in hundredths
+  if (xmRevolutionTime && xmTracks)
+  {
+    const WORD average = ((xmTotalTrackTime / xmTracks) * 100) / xmRevolutionTime;
+    const WORD maximum = (xmMaxTrackTime * 100) / xmRevolutionTime;
+    ui->print(Progmem::getString(Progmem::xmodemRevsPerTrack), average / 100, average % 100, maximum / 100, maximum % 100);
+  }
+  
   if (!result)
   { 
     ui->print(Progmem::getString(Progmem::xmodemTransferFail));
@@ -284,6 +715,8 @@ bool xmodemWriteDiskFromImageFile(bool useXMODEM_1K)
   }
   
   fdc->setAutomaticMotorOff(false);
+  xmRevolutionTime = fdc->measureRevolutionTime(&xmSectorPitch);
+  xmodemInitRing(SECTOR_BUFFER_SIZE - XM_RX_RING_SIZE);
   
   ui->print("");
   ui->print(Progmem::getString(useXMODEM_1K ? Progmem::xmodem1kPrefix : Progmem::xmodemPrefix));
@@ -291,17 +724,27 @@ bool xmodemWriteDiskFromImageFile(bool useXMODEM_1K)
   
   ui->disableKeyboard(true);
   ui->setPrintDisabled(false, true);
+  xmodemSerialStart(&g_rwBuffer[SECTOR_BUFFER_SIZE - XM_RX_RING_SIZE], XM_RX_RING_SIZE);
+  xmBackgroundTask = xmodemWriteStep;
+  
   XModem modem(xmodemRx, xmodemTx, xmodemImageRxCallback, useXMODEM_1K);
   bool result = modem.receive() && success;
     
-  // if transfer is over and there's any remainder in buffer, flush it
-  if (result && (xmDataPos < SECTOR_BUFFER_SIZE))
+  // if transfer is over and there's any remainder in buffer, flush it in whole sectors
+  const WORD sectorSize = fdc->getParams()->SectorSizeBytes;
+  xmRingFill = ((xmRingFill + sectorSize - 1) / sectorSize) * sectorSize;
+  while (result && success && (xmDiskBusy || xmRingFill))
+  {
+    xmodemWriteStep();
+  }
+  if (xmDiskBusy)
   {
-    BYTE dummy = 0;
-    xmDataPos = SECTOR_BUFFER_SIZE;
-    xmodemImageRxCallback(0, &dummy, 0);
-  }  
+    while (!fdc->isReadWriteDone()) {};
+    fdc->endReadWriteSectors();
+  }
+  result = result && success;
   
+  xmodemSerialStop();
   dumpSerialTransfer();  
   ui->setPrintDisabled(false, false);
   fdc->seekDrive(0, 0);
@@ -404,24 +847,39 @@ bool xmodemFileTxCallback(DWORD no, BYTE* data, WORD size)
 bool xmodemFileRxCallback(DWORD no, BYTE* data, WORD size)
 {
   // FAT12
-  if (!fdc->getParams()->UseFAT12)
+  if (fdc->getParams()->UseFAT12)
   {
-    return false;
+    lastResult = f_write(getFatFile(), data, size, &xmRWPos);
+    if (lastResult != FR_OK)
+    {
+      success = false;
+      return false;
+    }
+    
+    // continue RX; callback won't be fired on transfer over
+    return true;
   }
   
-  lastResult = f_write(getFatFile(), data, size, &xmRWPos);
-  if (lastResult != FR_OK)
+  // CP/M, a record per each 128 bytes
+  else if (fdc->getParams()->UseCPMFS)
   {
-    success = false;
-    return false;
+    for (WORD offset = 0; offset < size; offset += 128)
+    {
+      if (!cpmWriteFileRecord(&data[offset]))
+      {
+        success = false;
+        return false;
+      }
+    }
+    
+    return true;
   }
   
-  // continue RX; callback won't be fired on transfer over
-  return true;
+  return false;
 }
 
 // analog to sending images, but works with file access
-bool xmodemSendFile(const BYTE* existingFileName)
+bool xmodemSendFile(const BYTE* existingFileName, bool useXMODEM_1K)
 {
   xmRWPos = 0;
   lastResult = FR_OK;
@@ -453,14 +911,14 @@ bool xmodemSendFile(const BYTE* existingFileName)
   }
   
   ui->print("");
-  ui->print(Progmem::getString(Progmem::xmodemPrefix));
+  ui->print(Progmem::getString(useXMODEM_1K ? Progmem::xmodem1kPrefix : Progmem::xmodemPrefix));
   ui->print(Progmem::getString(Progmem::xmodemWaitRecv));
   
   ui->disableKeyboard(true);  
   ui->setPrintDisabled(false, true);
   fdc->setAutomaticMotorOff(false);
   
-  XModem modem(xmodemRx, xmodemTx, xmodemFileTxCallback);
+  XModem modem(xmodemRx, xmodemTx, xmodemFileTxCallback, useXMODEM_1K);
   bool result = modem.transmit() && success;
   if (fat)
   {
@@ -505,37 +963,63 @@ bool xmodemSendFile(const BYTE* existingFileName)
   return result;
 }
 
-bool xmodemReceiveFile(const BYTE* newFileName)
+bool xmodemReceiveFile(const BYTE* newFileName, bool useXMODEM_1K)
 {
   xmRWPos = 0;
   lastResult = FR_OK;
   success = true;
   
-  if (!fatMount())
+  const bool fat = fdc->getParams()->UseFAT12;
+  
+  if (fat)
   {
-    return false;
+    if (!fatMount())
+    {
+      return false;
+    }
+    
+    BYTE addPath[MAX_PATH+1] = {0};
+    strcat(addPath, g_path);
+    strcat(addPath, newFileName);
+    
+    // attempt to delete the file if it already exists (CREATE_NEW would fail otherwise)
+    f_unlink(addPath);
+    
+    FAT_EXECUTE_0(f_open(getFatFile(), addPath, FA_WRITE | FA_CREATE_NEW));
+    fatPrepareContiguous(getFatFile());
   }
   
-  BYTE addPath[MAX_PATH+1] = {0};
-  strcat(addPath, g_path);
-  strcat(addPath, newFileName);
-  
-  // attempt to delete the file if it already exists (CREATE_NEW would fail otherwise)
-  f_unlink(addPath);
-  
-  FAT_EXECUTE_0(f_open(getFatFile(), addPath, FA_WRITE | FA_CREATE_NEW));
+  // CP/M, create file name for user 0, an existing one is replaced once it has been received
+  else
+  {
+    if (!cpmCreateFile(newFileName, 0))
+    {
+      return false;
+    }
+  }
   
   ui->print("");
-  ui->print(Progmem::getString(Progmem::xmodemPrefix));
+  ui->print(Progmem::getString(useXMODEM_1K ? Progmem::xmodem1kPrefix : Progmem::xmodemPrefix));
   ui->print(Progmem::getString(Progmem::xmodemWaitSend));
   
   ui->disableKeyboard(true);  
   ui->setPrintDisabled(false, true);
   fdc->setAutomaticMotorOff(false);
   
-  XModem modem(xmodemRx, xmodemTx, xmodemFileRxCallback);
+  XModem modem(xmodemRx, xmodemTx, xmodemFileRxCallback, useXMODEM_1K);
   bool result = modem.receive() && success;
-  FAT_EXECUTE(f_close(getFatFile()));  
+  if (fat)
+  {
+    FAT_EXECUTE(f_close(getFatFile()));
+  }
+  else if (result)
+  {
+    result = cpmCloseNewFile();
+  }
+  else
+  {
+    cpmCloseFile();
+  }
   
   ui->disableKeyboard(false);
     
@@ -548,7 +1032,15 @@ bool xmodemReceiveFile(const BYTE* newFileName)
   
   if (!result)
   {
-    fatResult(lastResult);
+    if (fat)
+    {
+      fatResult(lastResult);
+    }
+    else
+    {
+      ui->print(Progmem::getString(cpmIsDiskFull() ? Progmem::fsCPMDiskFull : Progmem::fsDiskError));
+      ui->print(Progmem::getString(Progmem::uiNewLine2x));
+    }
     
     ui->print(Progmem::getString(Progmem::xmodemTransferFail));
     ui->print(Progmem::getString(Progmem::uiNewLine2x));
@@ -7,8 +7,48 @@
 bool xmodemReadDiskIntoImageFile(bool useXMODEM_1K);
 bool xmodemWriteDiskFromImageFile(bool useXMODEM_1K);
 
-bool xmodemSendFile(const BYTE* existingFileName);
-bool xmodemReceiveFile(const BYTE* newFileName);
+bool xmodemSendFile(const BYTE* existingFileName, bool useXMODEM_1K = false);
+bool xmodemReceiveFile(const BYTE* newFileName, bool useXMODEM_1K = false);
+
+// serial line during disk image transfers, served by the Timer4 ISR and by the FDC data ISRs
+// image writes receive into a ring at the end of the disk R/W buffer, reads only need a small one for the replies
+#define XM_RX_RING_SIZE 512
+
+extern volatile bool xmSerialActive;
+extern const BYTE* volatile xmTxData;
+extern volatile WORD xmTxCount;
+extern volatile BYTE* xmRxBuffer;
+extern WORD xmRxMask;
+extern volatile WORD xmRxHead;
+extern volatile WORD xmRxTail;
+
+// move at most one byte each way between USART0 and the transfer buffers
+inline void xmodemSerialPump() __attribute__((always_inline));
+void xmodemSerialPump()
+{
+  if (!xmSerialActive)
+  {
+    return;
+  }
+  
+  // received byte: into the ring, or left in the USART while the ring is full
+  if (UCSR0A & (1 << RXC0))
+  {
+    const WORD next = (xmRxHead+1) & xmRxMask;
+    if (next != xmRxTail)
+    {
+      xmRxBuffer[xmRxHead] = UDR0;
+      xmRxHead = next;
+    }
+  }
+  
+  // transmit holding register empty
+  if (xmTxCount && (UCSR0A & (1 << UDRE0)))
+  {
+    UDR0 = *xmTxData++;
+    xmTxCount--;
+  }
+}
 
 // make these helpers public when building with IMD
 #ifdef BUILD_IMD_IMAGER